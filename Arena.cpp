@@ -0,0 +1,113 @@
+/**
+ * @file Arena.cpp - implementation of Arena
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <algorithm>
+#include "Arena.h"
+
+using namespace std;
+
+thread_local Arena *Arena::the_current = nullptr;
+
+static const size_t ALIGNMENT = alignof(max_align_t);
+
+static size_t aligned(size_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+Arena::Arena() : chunks(), chunk(0), top(0), in_use(0) {
+}
+
+Arena::~Arena() {
+    for (auto const &c: this->chunks)
+        delete[] c.memory;
+}
+
+/**
+ * Get some memory, moving on to the next chunk (or adding one at least twice as big as the last)
+ * when this one is full.
+ * @param size  number of bytes wanted
+ * @return      the memory, good until the next reset()
+ */
+void *Arena::allocate(size_t size) {
+    size = aligned(max(size, (size_t) 1));
+    while (this->chunk < this->chunks.size() && this->top + size > this->chunks[this->chunk].size) {
+        this->in_use += this->top;
+        this->chunk++;
+        this->top = 0;
+    }
+    if (this->chunk == this->chunks.size()) {
+        size_t chunk_size = this->chunks.empty() ? CHUNK_SZ : this->chunks.back().size * 2;
+        chunk_size = max(chunk_size, aligned(size));
+        // new[] of char only promises alignment for things of its own size, so over-allocate and line it up
+        Chunk c;
+        c.memory = new char[chunk_size + ALIGNMENT];
+        c.size = chunk_size;
+        this->chunks.push_back(c);
+    }
+    char *base = this->chunks[this->chunk].memory;
+    base += (ALIGNMENT - (reinterpret_cast<size_t>(base) % ALIGNMENT)) % ALIGNMENT;
+    void *p = base + this->top;
+    this->top += size;
+    return p;
+}
+
+/**
+ * Give back memory. If it was the most recent allocation, the space is reused straight away.
+ * @param p     memory gotten from allocate
+ * @param size  number of bytes asked for
+ */
+void Arena::deallocate(void *p, size_t size) {
+    size = aligned(max(size, (size_t) 1));
+    if (this->chunk < this->chunks.size() && this->top >= size) {
+        char *base = this->chunks[this->chunk].memory;
+        base += (ALIGNMENT - (reinterpret_cast<size_t>(base) % ALIGNMENT)) % ALIGNMENT;
+        if (static_cast<char *>(p) + size == base + this->top)
+            this->top -= size;
+    }
+}
+
+/**
+ * Does this memory belong to one of our chunks?
+ * @param p  the memory
+ * @return   true if it came from allocate
+ */
+bool Arena::owns(const void *p) const {
+    const char *q = static_cast<const char *>(p);
+    for (auto const &c: this->chunks)
+        if (q >= c.memory && q < c.memory + c.size + ALIGNMENT)
+            return true;
+    return false;
+}
+
+/**
+ * Take back everything handed out, keeping the first chunks (up to RETAIN_SZ of them) for next time.
+ */
+void Arena::reset() {
+    size_t retained = 0, keep = 0;
+    while (keep < this->chunks.size() && retained + this->chunks[keep].size <= RETAIN_SZ)
+        retained += this->chunks[keep++].size;
+    for (size_t i = keep; i < this->chunks.size(); i++)
+        delete[] this->chunks[i].memory;
+    this->chunks.resize(keep);
+    this->chunk = 0;
+    this->top = 0;
+    this->in_use = 0;
+}
+
+void *arena_allocate(size_t size) {
+    Arena *arena = Arena::current();
+    if (arena != nullptr)
+        return arena->allocate(size);
+    return ::operator new(size);
+}
+
+void arena_deallocate(void *p, size_t size) {
+    if (p == nullptr)
+        return;
+    Arena *arena = Arena::current();
+    if (arena != nullptr && arena->owns(p))
+        arena->deallocate(p, size);
+    else
+        ::operator delete(p);
+}
@@ -0,0 +1,158 @@
+/**
+ * @file Arena.h - bump allocation for things that only live as long as one statement.
+ * Arena
+ * ArenaScope
+ * ArenaAllocator
+ * ArenaAllocated
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ * @class Arena - hands out memory by bumping a pointer through large chunks and takes it all back at once
+ *
+ * Individual frees are (nearly) free: the most recent allocation can be given back, anything else waits
+ * for reset(). Chunks up to RETAIN_SZ in total are kept across resets so that a steady stream of
+ * statements stops calling the system allocator at all.
+ */
+class Arena {
+public:
+    static const size_t CHUNK_SZ = 64 * 1024;
+    static const size_t RETAIN_SZ = 1024 * 1024;
+
+    Arena();
+
+    virtual ~Arena();
+
+    Arena(const Arena &other) = delete;
+
+    Arena(Arena &&temp) = delete;
+
+    Arena &operator=(const Arena &other) = delete;
+
+    Arena &operator=(Arena &&temp) = delete;
+
+    /**
+     * Get some memory (suitably aligned for anything).
+     * @param size  number of bytes wanted
+     * @return      the memory, good until the next reset()
+     */
+    virtual void *allocate(size_t size);
+
+    /**
+     * Give back memory. Only the most recent allocation is actually reused before the next reset().
+     * @param p     memory gotten from allocate
+     * @param size  number of bytes asked for
+     */
+    virtual void deallocate(void *p, size_t size);
+
+    /**
+     * Does this memory belong to one of our chunks?
+     */
+    virtual bool owns(const void *p) const;
+
+    /**
+     * Take back everything handed out since the last reset.
+     */
+    virtual void reset();
+
+    /**
+     * Bytes handed out since the last reset (for tests and tuning).
+     */
+    virtual size_t used() const { return this->in_use + this->top; }
+
+    /**
+     * The arena of the statement being executed, if any.
+     */
+    static Arena *current() { return Arena::the_current; }
+
+protected:
+    struct Chunk {
+        char *memory;
+        size_t size;
+    };
+    std::vector<Chunk> chunks;
+    size_t chunk;   // index of the chunk we are allocating from
+    size_t top;     // offset of the first free byte in it
+    size_t in_use;  // bytes used in the chunks before it
+
+    static thread_local Arena *the_current;  // each thread has its own (worker threads have none)
+
+    friend class ArenaScope;
+};
+
+/**
+ * @class ArenaScope - makes an arena current for as long as it is in scope, then resets it
+ *
+ * Anything allocated from the arena inside the scope must be gone (or never touched again)
+ * by the time the scope ends.
+ */
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena &arena) : arena(arena), previous(Arena::the_current) { Arena::the_current = &arena; }
+
+    virtual ~ArenaScope() {
+        Arena::the_current = this->previous;
+        this->arena.reset();
+    }
+
+    ArenaScope(const ArenaScope &other) = delete;
+
+    ArenaScope &operator=(const ArenaScope &other) = delete;
+
+protected:
+    Arena &arena;
+    Arena *previous;
+};
+
+/**
+ * Get memory from the current arena, or from the heap if there isn't one.
+ */
+void *arena_allocate(size_t size);
+
+/**
+ * Give back memory from arena_allocate (to whichever of the current arena or the heap it came from).
+ */
+void arena_deallocate(void *p, size_t size);
+
+/**
+ * @class ArenaAllocator - standard library allocator drawing on the current arena
+ *
+ * Containers using this must not outlive the statement they were filled in.
+ */
+template<typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    ArenaAllocator() {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(arena_allocate(n * sizeof(T))); }
+
+    void deallocate(T *p, size_t n) { arena_deallocate(p, n * sizeof(T)); }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return true; }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return false; }
+};
+
+/**
+ * @class ArenaAllocated - base class for objects that should come from the current arena when created
+ * during a statement (delete still runs their destructors, but the memory waits for the reset)
+ */
+class ArenaAllocated {
+public:
+    static void *operator new(size_t size) { return arena_allocate(size); }
+
+    static void operator delete(void *p, size_t size) { arena_deallocate(p, size); }
+};
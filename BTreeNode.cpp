@@ -17,7 +17,9 @@ BTreeNode::BTreeNode(HeapFile &file, BlockID block_id, const KeyProfile &key_pro
                                                                                                      file(file),
                                                                                                      id(block_id),
                                                                                                      key_profile(
-                                                                                                             key_profile) {
+                                                                                                             key_profile),
+                                                                                                     key_codec(RowCodec::get(
+                                                                                                             key_profile)) {
     if (create) {
         this->block = file.get_new();
         this->id = this->block->get_block_id();
@@ -55,31 +57,8 @@ Handle BTreeNode::get_handle(RecordID record_id) const {
 // Get the record and turn it into a KeyValue.
 KeyValue *BTreeNode::get_key(RecordID record_id) const {
     Dbt *dbt = this->block->get(record_id);
-    char *bytes = (char *) dbt->get_data();
     KeyValue *key_value = new KeyValue();
-    Value value;
-    uint offset = 0;
-    for (auto const &data_type: this->key_profile) {
-        value.data_type = data_type;
-        if (data_type == ColumnAttribute::DataType::INT) {
-            value.n = *(int32_t *) (bytes + offset);
-            offset += sizeof(int32_t);
-        } else if (data_type == ColumnAttribute::DataType::TEXT) {
-            uint16_t size = *(uint16_t *) (bytes + offset);
-            offset += sizeof(uint16_t);
-            char buffer[DbBlock::BLOCK_SZ];
-            memcpy(buffer, bytes + offset, size);
-            buffer[size] = '\0';
-            value.s = std::string(buffer);  // assume ascii for now
-            offset += size;
-        } else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
-            value.n = *(uint8_t *) (bytes + offset);
-            offset += sizeof(uint8_t);
-        } else {
-            throw DbRelationError("Only know how to unmarshal INT, TEXT, or BOOLEAN");
-        }
-        key_value->push_back(value);
-    }
+    this->key_codec->decode((const char *) dbt->get_data(), *key_value, false);
     delete dbt;
     return key_value;
 }
@@ -103,41 +82,16 @@ Dbt *BTreeNode::marshal_handle(Handle handle) {
 
 // Convert KeyValue into bytes.
 Dbt *BTreeNode::marshal_key(const KeyValue *key) {
+    if (key->size() != this->key_codec->size())
+        throw DbRelationError("index key has the wrong number of values");
     char *bytes = new char[DbBlock::BLOCK_SZ]; // more than we need
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const &data_type: this->key_profile) {
-        Value value = (*key)[col_num];
-
-        if (data_type == ColumnAttribute::DataType::INT) {
-            if (offset + 4 > DbBlock::BLOCK_SZ - 4)
-                throw DbRelationError("index key too big to marshal");
-
-            *(int32_t *) (bytes + offset) = value.n;
-            offset += sizeof(int32_t);
-
-        } else if (data_type == ColumnAttribute::DataType::TEXT) {
-            u_long size = (uint16_t) value.s.length();
-            if (size > UINT16_MAX)
-                throw DbRelationError("text field too long to marshal");
-            if (offset + 2 + size > DbBlock::BLOCK_SZ)
-                throw DbRelationError("index key too big to marshal");
-
-            *(uint16_t *) (bytes + offset) = (uint16_t) size;
-            offset += sizeof(uint16_t);
-            memcpy(bytes + offset, value.s.c_str(), size); // assume ascii for now
-            offset += size;
-
-        } else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
-            if (offset + 1 > DbBlock::BLOCK_SZ - 1)
-                throw DbRelationError("index key too big to marshal");
-
-            *(uint8_t *) (bytes + offset) = (uint8_t) value.n;
-            offset += sizeof(uint8_t);
-
-        } else {
-            throw DbRelationError("only know how to marshal INT, TEXT, or BOOLEAN for BTree index");
-        }
+    std::vector<const Value *> values;
+    for (auto const &value: *key)
+        values.push_back(&value);
+    u_int32_t offset = this->key_codec->encode(values.data(), bytes, DbBlock::BLOCK_SZ);
+    if (offset == 0) {
+        delete[] bytes;
+        throw DbRelationError("index key too big to marshal");
     }
     char *right_size_bytes = new char[offset];
     memcpy(right_size_bytes, bytes, offset);
@@ -385,6 +339,22 @@ Handle BTreeLeaf::find_eq(const KeyValue *key) const {
     return this->key_map.at(*key);
 }
 
+BTreeLeaf *BTreeLeaf::next() const {
+    if (this->next_leaf == 0)
+        return nullptr;
+    return new BTreeLeaf(this->file, this->next_leaf, this->key_profile, false);
+}
+
+// Read the next leaf's block ahead of time in a task of the given group, which must be waited for before the
+// file is closed. Only the file and block id go with the task, so this leaf can go first.
+void BTreeLeaf::prefetch_next(TaskGroup &group) const {
+    if (this->next_leaf == 0)
+        return;
+    HeapFile &file = this->file;
+    BlockID block_id = this->next_leaf;
+    group.run([&file, block_id]() { file.prefetch(block_id, 1); });
+}
+
 // Save the key_map and next_leaf data in the correct order
 void BTreeLeaf::save() {
     Dbt *dbt;
@@ -472,3 +442,10 @@ Insertion BTreeLeaf::insert(const KeyValue *key, Handle handle) {
         return Insertion(nleaf->id, boundary);
     }
 }
+
+// Remove key from the leaf. Leaves are never merged, so one can be left with no keys at all.
+void BTreeLeaf::del(const KeyValue *key) {
+    if (this->key_map.erase(*key) == 0)
+        throw DbRelationError("key not found in index");
+    save();
+}
@@ -8,6 +8,8 @@
 
 #include "storage_engine.h"
 #include "heap_storage.h"
+#include "RowCodec.h"
+#include "Scheduler.h"
 
 typedef std::vector<ColumnAttribute::DataType> KeyProfile;
 typedef std::vector<Value> KeyValue;
@@ -34,6 +36,7 @@ protected:
     HeapFile &file;
     BlockID id;
     const KeyProfile &key_profile;
+    const RowCodec *key_codec;  // marshals keys of this profile
 
     static Dbt *marshal_block_id(BlockID block_id);
 
@@ -106,8 +109,16 @@ public:
     Handle find_eq(const KeyValue *key) const;  // throws if not found
     Insertion insert(const KeyValue *key, Handle handle);
 
+    void del(const KeyValue *key);
+
     virtual void save();
 
+    const std::map<KeyValue, Handle> &get_key_map() const { return this->key_map; }
+
+    BTreeLeaf *next() const;  // read in the leaf after this one (nullptr if this is the last)
+
+    void prefetch_next(TaskGroup &group) const;  // start the leaf after this one on its way into memory
+
 protected:
     BlockID next_leaf;
     std::map<KeyValue, Handle> key_map;
@@ -0,0 +1,135 @@
+/**
+ * @file Batch.cpp - implementation of Batch and ColumnVector
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <cstring>
+#include "Batch.h"
+#include "SimdKernels.h"
+
+using namespace std;
+
+Batch::Batch(const vector<ColumnAttribute::DataType> &data_types) : size(0), columns(), selected(0) {
+    for (auto const &data_type: data_types)
+        this->columns.push_back(new ColumnVector(data_type));
+}
+
+Batch::~Batch() {
+    for (auto const &column: this->columns)
+        delete column;
+}
+
+void Batch::select_all() {
+    for (u_int16_t row = 0; row < this->size; row++)
+        this->selection[row] = row;
+    this->selected = this->size;
+}
+
+void Batch::clear() {
+    this->size = 0;
+    this->selected = 0;
+    for (auto const &column: this->columns)
+        column->clear();
+}
+
+/**
+ * While most of the batch is still selected, the condition is tested on every row at once with one of the
+ * SimdKernels, and the selection is narrowed by the resulting bitmask. Once only a few rows are left, each kind
+ * of value has its own loop down the selection vector instead. Either way every selected row is written back to
+ * the vector and the count only moves on for the ones that match, so there is no branch on the comparison.
+ */
+void Batch::filter(uint column, const Value &value) {
+    const ColumnVector &vector = *this->columns[column];
+    const uint8_t *nulls = vector.nulls;
+    u_int16_t kept = 0;
+    if (value.data_type != vector.data_type) {
+        this->selected = 0;  // never equal (see Value::operator==)
+        return;
+    }
+    if (this->selected >= this->size / 4) {
+        uint8_t mask[BATCH_SZ / 8];
+        bool is_null = value.is_null();
+        if (is_null) {
+            SimdKernels::byte_equal(nulls, this->size, 1, mask);
+        } else if (value.data_type != ColumnAttribute::TEXT) {
+            SimdKernels::int32_equal(vector.numbers, this->size, value.n, mask);
+        } else {
+            SimdKernels::text_equal(vector.texts, vector.sizes, this->size, value.text_data(), value.text_size(),
+                                    mask);
+        }
+        for (u_int16_t i = 0; i < this->selected; i++) {
+            u_int16_t row = this->selection[i];
+            this->selection[kept] = row;
+            uint8_t match = (uint8_t) ((mask[row >> 3] >> (row & 7)) & 1);
+            kept += is_null ? match : (u_int16_t) (match & (nulls[row] ^ 1));  // a NULL never equals a value
+        }
+    } else if (value.is_null()) {
+        for (u_int16_t i = 0; i < this->selected; i++) {
+            u_int16_t row = this->selection[i];
+            this->selection[kept] = row;
+            kept += nulls[row];
+        }
+    } else if (value.data_type != ColumnAttribute::TEXT) {
+        const int32_t *numbers = vector.numbers;
+        int32_t n = value.n;
+        for (u_int16_t i = 0; i < this->selected; i++) {
+            u_int16_t row = this->selection[i];
+            this->selection[kept] = row;
+            kept += (u_int16_t) ((numbers[row] == n) & (nulls[row] ^ 1));
+        }
+    } else {
+        const char *data = value.text_data();
+        u_int32_t size = value.text_size();
+        for (u_int16_t i = 0; i < this->selected; i++) {
+            u_int16_t row = this->selection[i];
+            this->selection[kept] = row;
+            kept += (u_int16_t) (!nulls[row] && vector.sizes[row] == size
+                                 && memcmp(vector.texts[row], data, size) == 0);
+        }
+    }
+    this->selected = kept;
+}
+
+/**
+ * The tuples are all made first and then filled in a column at a time.
+ */
+void Batch::project(const ColumnOrdinals &columns, Tuples &out) const {
+    size_t first = out.size();
+    for (u_int16_t i = 0; i < this->selected; i++)
+        out.push_back(new Tuple(columns.size()));
+    for (uint c = 0; c < columns.size(); c++) {
+        const ColumnVector &vector = *this->columns[columns[c]];
+        for (u_int16_t i = 0; i < this->selected; i++)
+            vector.get(this->selection[i], (*out[first + i])[c]);
+    }
+}
+
+void Batch::selected_handles(Handles &out) const {
+    for (u_int16_t i = 0; i < this->selected; i++)
+        out.push_back(this->handles[this->selection[i]]);
+}
+
+void Batch::selected_handles(vector<Handle> &out) const {
+    for (u_int16_t i = 0; i < this->selected; i++)
+        out.push_back(this->handles[this->selection[i]]);
+}
+
+void ColumnVector::set(u_int16_t row, const Value &value) {
+    if (value.is_null()) {
+        set_null(row);
+    } else if (this->data_type == ColumnAttribute::TEXT) {
+        this->owned.push_back(value);  // copying a Value always copies its text
+        set_view(row, this->owned.back().text_data(), this->owned.back().text_size());
+    } else {
+        this->numbers[row] = value.n;
+        this->nulls[row] = 0;
+    }
+}
+
+void ColumnVector::get(u_int16_t row, Value &value) const {
+    if (this->nulls[row])
+        value.set_null(this->data_type);
+    else if (this->data_type == ColumnAttribute::TEXT)
+        value.set_text(this->texts[row], this->sizes[row]);
+    else
+        value.set_number(this->data_type, this->numbers[row]);
+}
@@ -0,0 +1,163 @@
+/**
+ * @file Batch.h - batches of rows held column by column, for batch-at-a-time evaluation.
+ * Batch
+ * ColumnVector
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <deque>
+#include "storage_engine.h"
+
+class ColumnVector;
+
+/**
+ * @class Batch - up to BATCH_SZ rows of some of a relation's columns, with a selection vector
+ *
+ * A scan (see DbRelation::scan_batches) fills a batch a row at a time with add and the ColumnVector setters,
+ * or a column at a time straight into the vectors' arrays, and then hands it to its visitor with every row
+ * selected. Filters narrow the selection vector in place (see filter) rather than moving any values, and
+ * project turns the rows that are left into tuples.
+ * TEXT in a batch may be a view of the block it came from, so a batch is only good for the visit.
+ */
+class Batch {
+public:
+    static const uint16_t BATCH_SZ = 1024;
+
+    /**
+     * @param data_types  type of each column of the batch, in order
+     */
+    Batch(const std::vector<ColumnAttribute::DataType> &data_types);
+
+    virtual ~Batch();
+
+    Batch(const Batch &other) = delete;
+
+    Batch &operator=(const Batch &other) = delete;
+
+    u_int16_t size;  // number of rows
+    Handle handles[BATCH_SZ];  // each row's handle
+    std::vector<ColumnVector *> columns;
+    u_int16_t selection[BATCH_SZ];  // rows still selected, in order
+    u_int16_t selected;  // how many of them
+
+    bool full() const { return this->size == BATCH_SZ; }
+
+    /**
+     * Start a new row (its values are then set in each column).
+     * @param handle  the row's handle
+     * @return        its position in the batch
+     */
+    u_int16_t add(Handle handle) {
+        this->handles[this->size] = handle;
+        return this->size++;
+    }
+
+    /**
+     * Select every row.
+     */
+    void select_all();
+
+    /**
+     * Empty the batch.
+     */
+    void clear();
+
+    /**
+     * Select every row, hand the batch to a visitor, and then empty it.
+     * @param visit  the visitor
+     */
+    void flush(const BatchVisitor &visit) {
+        select_all();
+        visit(*this);
+        clear();
+    }
+
+    /**
+     * Narrow the selection to the rows whose value in a column equals the given one (with Value's idea of
+     * equality, so NULLs match NULLs of the same type).
+     * @param column  position of the column in the batch
+     * @param value   what it has to equal
+     */
+    void filter(uint column, const Value &value);
+
+    /**
+     * Turn the selected rows into tuples (which own their values).
+     * @param columns  positions in the batch of the columns wanted, in the order wanted
+     * @param out      where to add the tuples
+     */
+    void project(const ColumnOrdinals &columns, Tuples &out) const;
+
+    /**
+     * Add the handles of the selected rows to a list.
+     */
+    void selected_handles(Handles &out) const;
+
+    /**
+     * Same, into a plain vector (for worker threads, which have no arena for Handles to draw on).
+     */
+    void selected_handles(std::vector<Handle> &out) const;
+};
+
+/**
+ * @class ColumnVector - the values of one column of a batch
+ *
+ * INT and BOOLEAN values are kept in an array of int32s and TEXT as an array of pointers and one of lengths,
+ * with a byte per row saying if it is NULL, so that filters are a plain loop down an array.
+ */
+class ColumnVector {
+public:
+    ColumnVector(ColumnAttribute::DataType data_type) : data_type(data_type), owned() {}
+
+    ColumnVector(const ColumnVector &other) = delete;
+
+    ColumnVector &operator=(const ColumnVector &other) = delete;
+
+    ColumnAttribute::DataType data_type;
+    int32_t numbers[Batch::BATCH_SZ];  // INT and BOOLEAN
+    const char *texts[Batch::BATCH_SZ];  // TEXT
+    u_int32_t sizes[Batch::BATCH_SZ];  // TEXT lengths
+    uint8_t nulls[Batch::BATCH_SZ];
+
+    /**
+     * Set a row's value to a copy of the given one.
+     * @param row    position in the batch
+     * @param value  the value
+     */
+    void set(u_int16_t row, const Value &value);
+
+    /**
+     * Set a row's TEXT value to the given characters without copying them.
+     * @param row   position in the batch
+     * @param data  the text, which has to last as long as the batch
+     * @param size  its length
+     */
+    void set_view(u_int16_t row, const char *data, u_int32_t size) {
+        this->texts[row] = data;
+        this->sizes[row] = size;
+        this->nulls[row] = 0;
+    }
+
+    void set_null(u_int16_t row) {
+        this->numbers[row] = 0;
+        this->texts[row] = nullptr;
+        this->sizes[row] = 0;
+        this->nulls[row] = 1;
+    }
+
+    /**
+     * Get a row's value.
+     * @param row    position in the batch
+     * @param value  set to a copy of it
+     */
+    void get(u_int16_t row, Value &value) const;
+
+    /**
+     * Let go of copied text.
+     */
+    void clear() { this->owned.clear(); }
+
+protected:
+    std::deque<Value> owned;  // copies of text set with set (a deque, so they stay put as it grows)
+};
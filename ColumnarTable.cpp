@@ -0,0 +1,725 @@
+/**
+ * @file ColumnarTable.cpp - implementation of ColumnarTable
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <cstring>
+#include <iostream>
+#include "ColumnarTable.h"
+#include "SimdKernels.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ * @param table_name
+ * @param column_names
+ * @param column_attributes
+ */
+ColumnarTable::ColumnarTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes)
+        : DbRelation(table_name, column_names, column_attributes), file(table_name), layout(column_attributes),
+          null_row() {
+    for (auto ca: column_attributes)
+        this->null_row.push_back(Value::null(ca.get_data_type()));
+}
+
+ColumnarTable::~ColumnarTable() {
+}
+
+/**
+ * Execute: CREATE TABLE <table_name> ( <columns> ) USING COLUMNAR
+ * Is not responsible for metadata storage or validation.
+ */
+void ColumnarTable::create() {
+    this->file.create();
+}
+
+/**
+ * Execute: CREATE TABLE IF NOT EXISTS <table_name> ( <columns> ) USING COLUMNAR
+ * Is not responsible for metadata storage or validation.
+ */
+void ColumnarTable::create_if_not_exists() {
+    try {
+        open();
+    } catch (DbException &e) {
+        create();
+    }
+}
+
+/**
+ * Execute: DROP TABLE <table_name>
+ */
+void ColumnarTable::drop() {
+    this->file.drop();
+}
+
+/**
+ * Open existing table. Enables: insert, update, delete, select, project
+ */
+void ColumnarTable::open() {
+    this->file.open();
+}
+
+/**
+ * Closes the table. Disables: insert, update, delete, select, project
+ */
+void ColumnarTable::close() {
+    this->file.close();
+}
+
+/**
+ * Execute: INSERT INTO <table_name> (<row_keys>) VALUES (<row_values>)
+ * @param row  a dictionary with column name keys
+ * @return     the handle of the inserted row
+ */
+Handle ColumnarTable::insert(const ValueDict *row) {
+    open();
+    Tuple values;
+    validate(row, values);
+    PaxPage *tail = get(this->file.get_last_block_id());
+    Handle handle;
+    try {
+        handle = append(tail, values);
+    } catch (DbRelationError &e) {
+        delete tail;
+        throw;
+    }
+    this->file.put(tail);
+    delete tail;
+    return handle;
+}
+
+/**
+ * Insert a batch of rows, checking them all before writing any. The last block, and as many new ones as
+ * it takes, are each written out once when they are full.
+ * @param rows  the rows to insert
+ * @return      handles of the new rows, in order (freed by caller)
+ */
+Handles *ColumnarTable::insert(const ValueDicts *rows) {
+    open();
+    vector<Tuple> batch(rows->size());
+    for (uint i = 0; i < rows->size(); i++)
+        validate(rows->at(i), batch[i]);
+    Handles *handles = new Handles();
+    PaxPage *tail = get(this->file.get_last_block_id());
+    try {
+        for (auto const &values: batch)
+            handles->push_back(append(tail, values));
+    } catch (DbRelationError &e) {
+        this->file.put(tail);
+        delete tail;
+        for (auto const &handle: *handles)
+            del(handle);
+        delete handles;
+        throw;
+    }
+    this->file.put(tail);
+    delete tail;
+    return handles;
+}
+
+/**
+ * Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
+ * The row is rewritten in its slot, so its handle (and every index entry) stays valid.
+ * @param handle      the row to be updated
+ * @param new_values  a dictionary with column name keys
+ * @throws DbRelationError if the row's new text doesn't fit in its block
+ */
+void ColumnarTable::update(const Handle handle, const ValueDict *new_values) {
+    open();
+    ColumnNames changed;
+    for (auto const &column: *new_values)
+        changed.push_back(column.first);
+    ColumnOrdinals *ordinals = get_column_ordinals(&changed);
+
+    PaxPage *page = get(handle.first);
+    u_int16_t row = (u_int16_t) (handle.second - 1);
+    if (handle.second == 0 || row >= page->rows() || !page->is_live(row)) {
+        delete page;
+        delete ordinals;
+        throw DbRelationError("no such row in " + this->table_name);
+    }
+    Tuple values(this->column_names.size());
+    vector<const Value *> pointers;
+    for (uint column = 0; column < values.size(); column++) {
+        page->get(row, column, values[column], false);  // copies, since put may shuffle the page's text
+        pointers.push_back(&values[column]);
+    }
+    uint i = 0;
+    for (auto const &column: *new_values)
+        values[ordinals->at(i++)] = column.second;
+    delete ordinals;
+    try {
+        page->put(handle.second, pointers.data());
+    } catch (DbBlockNoRoomError &e) {
+        delete page;
+        throw DbRelationError("no room in " + this->table_name + "'s block for the updated row");
+    }
+    this->file.put(page);
+    delete page;
+}
+
+/**
+ * Make sure the new text of every row will fit in its block. Each block's live text is totted up, then the rows
+ * are gone through in the order they'll be updated, as a row's update compacts its block if it has to.
+ * @param handles     the rows to be updated, in the order they will be
+ * @param new_values  a dictionary with column name keys
+ * @throws DbRelationError if a row's new text won't fit in its block even once the block is compacted
+ */
+void ColumnarTable::check_update(const Handles *handles, const ValueDict *new_values) {
+    vector<uint> text_columns, all_text_columns;
+    vector<u_int32_t> new_sizes;
+    for (uint column = 0; column < this->column_names.size(); column++) {
+        if (this->column_attributes[column].get_data_type() != ColumnAttribute::TEXT)
+            continue;
+        all_text_columns.push_back(column);
+        auto value = new_values->find(this->column_names[column]);
+        if (value != new_values->end()) {
+            text_columns.push_back(column);
+            new_sizes.push_back(value->second.is_null() ? 0 : value->second.text_size());
+        }
+    }
+    if (text_columns.empty())
+        return;
+    open();
+    const u_int32_t room = DbBlock::BLOCK_SZ - this->layout.text_start;
+    map<BlockID, u_int32_t> used;  // by each block's live rows
+    PaxPage *page = nullptr;
+    u_int16_t size;
+    for (auto const &handle: *handles) {
+        if (page == nullptr || page->get_block_id() != handle.first) {
+            delete page;  // only one block at a time (see HeapFile::get)
+            page = get(handle.first);
+        }
+        if (used.find(handle.first) == used.end()) {
+            u_int32_t total = 0;
+            for (u_int16_t row = 0; row < page->rows(); row++) {
+                for (uint i = 0; i < all_text_columns.size() && page->is_live(row); i++) {
+                    page->text(row, all_text_columns[i], size);
+                    total += size;
+                }
+            }
+            used[handle.first] = total;
+        }
+        u_int16_t row = (u_int16_t) (handle.second - 1);
+        if (handle.second == 0 || row >= page->rows() || !page->is_live(row))
+            continue;  // update will say so
+        u_int32_t &total = used[handle.first];
+        for (uint i = 0; i < text_columns.size(); i++) {
+            page->text(row, text_columns[i], size);
+            total = total - size + new_sizes[i];
+        }
+        if (total > room) {
+            delete page;
+            throw DbRelationError("no room in " + this->table_name + "'s block " + to_string(handle.first)
+                                  + " for the updated rows");
+        }
+    }
+    delete page;
+}
+
+/**
+ * Conceptually, execute: DELETE FROM <table_name> WHERE <handle>
+ * @param handle  the row to be deleted
+ */
+void ColumnarTable::del(const Handle handle) {
+    open();
+    PaxPage *page = get(handle.first);
+    page->del(handle.second);
+    this->file.put(page);
+    delete page;
+}
+
+/**
+ * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE 1
+ * @return a list of handles for qualifying rows
+ */
+Handles *ColumnarTable::select() {
+    return select(nullptr);
+}
+
+/**
+ * The select command
+ * Each page is checked as a whole, one condition at a time, against the minipage of the column it names
+ * (see select(page, where, matches)).
+ * @param where  predicates to match
+ * @return       list of handles of the selected rows
+ */
+Handles *ColumnarTable::select(const ValueDict *where) {
+    open();
+    Conjunction *conjunction = where == nullptr ? nullptr : get_conjunction(where);
+    Handles *handles = new Handles();
+    vector<uint8_t> matches;
+    this->file.scan([&](SlottedPage *block) {
+        PaxPage page(*block->get_block(), block->get_block_id(), this->layout);
+        select(page, conjunction, matches);
+        for (u_int16_t i = 0; i < matches.size(); i++) {
+            for (uint8_t byte = matches[i]; byte != 0; byte &= (uint8_t) (byte - 1)) {
+                u_int16_t row = (u_int16_t) (i * 8 + __builtin_ctz(byte));
+                handles->push_back(Handle(block->get_block_id(), (RecordID) (row + 1)));
+            }
+        }
+    });
+    delete conjunction;
+    return handles;
+}
+
+/**
+ * Refine another selection
+ * @param current_selection  range of handles to filter
+ * @param where              predicates to match
+ * @return                   list of handles of the selected rows
+ */
+Handles *ColumnarTable::select(Handles *current_selection, const ValueDict *where) {
+    if (where == nullptr)
+        return new Handles(*current_selection);
+    open();
+    Conjunction *conjunction = get_conjunction(where);
+    Handles *handles = new Handles();
+    PaxPage *page = nullptr;
+    Value value;
+    for (auto const &handle: *current_selection) {
+        if (page == nullptr || page->get_block_id() != handle.first) {
+            delete page;  // only one block at a time (see HeapFile::get)
+            page = get(handle.first);
+        }
+        u_int16_t row = (u_int16_t) (handle.second - 1);
+        bool ok = row < page->rows() && page->is_live(row);
+        for (auto const &condition: *conjunction) {
+            if (!ok)
+                break;
+            page->get(row, condition.first, value, true);
+            ok = value == condition.second;
+        }
+        if (ok)
+            handles->push_back(handle);
+    }
+    delete page;
+    delete conjunction;
+    return handles;
+}
+
+/**
+ * Project all columns from a given row.
+ * @param handle  row to be projected
+ * @return        a sequence of all values for handle
+ */
+ValueDict *ColumnarTable::project(Handle handle) {
+    return project(handle, &this->column_names);
+}
+
+/**
+ * Project given columns from a given row.
+ * @param handle        row to be projected
+ * @param column_names  of columns to be included in the result
+ * @return              a sequence of values for handle given by column_names
+ */
+ValueDict *ColumnarTable::project(Handle handle, const ColumnNames *column_names) {
+    ColumnOrdinals *ordinals = get_column_ordinals(column_names);
+    Tuple *values;
+    try {
+        values = project(handle, ordinals);
+    } catch (DbRelationError &e) {
+        delete ordinals;
+        throw;
+    }
+    ValueDict *result = new ValueDict();
+    for (uint i = 0; i < ordinals->size(); i++)
+        (*result)[this->column_names[ordinals->at(i)]] = values->at(i);
+    delete values;
+    delete ordinals;
+    return result;
+}
+
+/**
+ * Project given columns from a given row, by position. Only the named columns' minipages are read.
+ * @param handle    row to be projected
+ * @param ordinals  positions of the columns to project, in the order wanted
+ * @return          values for handle in the order of ordinals
+ */
+Tuple *ColumnarTable::project(Handle handle, const ColumnOrdinals *ordinals) {
+    open();
+    PaxPage *page = get(handle.first);
+    u_int16_t row = (u_int16_t) (handle.second - 1);
+    if (handle.second == 0 || row >= page->rows() || !page->is_live(row)) {
+        delete page;
+        throw DbRelationError("no such row in " + this->table_name);
+    }
+    Tuple *result = new Tuple(ordinals->size());
+    for (uint i = 0; i < ordinals->size(); i++)
+        page->get(row, ordinals->at(i), result->at(i), false);
+    delete page;
+    return result;
+}
+
+/**
+ * Visit every row in one pass over the file, reading just the wanted columns' minipages.
+ * @param ordinals  positions of the columns to project, in the order wanted
+ * @param visit     called with each row's handle and projected values
+ */
+void ColumnarTable::scan(const ColumnOrdinals *ordinals, TupleVisitor visit) {
+    open();
+    Tuple projected(ordinals->size());
+    this->file.scan([&](SlottedPage *block) {
+        PaxPage page(*block->get_block(), block->get_block_id(), this->layout);
+        for (u_int16_t row = 0; row < page.rows(); row++) {
+            if (!page.is_live(row))
+                continue;
+            for (uint i = 0; i < ordinals->size(); i++)
+                page.get(row, ordinals->at(i), projected[i], true);
+            visit(Handle(block->get_block_id(), (RecordID) (row + 1)), &projected);
+        }
+    });
+}
+
+/**
+ * Fill batches in one pass over the file, a column at a time: each wanted column's values are copied
+ * straight out of its minipage for the page's live rows. TEXT is left as views of the pages, so when there is
+ * any a batch is handed on at the end of each page rather than when it's full.
+ * @param ordinals  positions of the columns to put in the batches, in the order wanted
+ * @param visit     called with each batch
+ * @param where     not used (every page is scanned)
+ */
+void ColumnarTable::scan_batches(const ColumnOrdinals *ordinals, BatchVisitor visit, const Conjunction *where) {
+    open();
+    vector<ColumnAttribute::DataType> data_types;
+    bool has_text = false;
+    for (auto const &ordinal: *ordinals) {
+        data_types.push_back(this->layout.data_types[ordinal]);
+        has_text = has_text || data_types.back() == ColumnAttribute::TEXT;
+    }
+    Batch batch(data_types);
+    u_int16_t slots[Batch::BATCH_SZ];  // row slot on the page of each row being added to the batch
+    this->file.scan([&](SlottedPage *block) {
+        PaxPage page(*block->get_block(), block->get_block_id(), this->layout);
+        u_int16_t rows = page.rows();
+        const uint8_t *live = page.live_bits();
+        u_int16_t row = 0;
+        while (row < rows) {
+            u_int16_t first = batch.size, n = 0;
+            for (; row < rows && !batch.full(); row++) {
+                if ((live[row >> 3] >> (row & 7)) & 1) {
+                    slots[n++] = row;
+                    batch.add(Handle(block->get_block_id(), (RecordID) (row + 1)));
+                }
+            }
+            for (uint i = 0; i < ordinals->size(); i++) {
+                ColumnVector &column = *batch.columns[i];
+                uint ordinal = (*ordinals)[i];
+                const uint8_t *nulls = page.null_bits(ordinal);
+                for (u_int16_t k = 0; k < n; k++)
+                    column.nulls[first + k] = (uint8_t) ((nulls[slots[k] >> 3] >> (slots[k] & 7)) & 1);
+                switch (column.data_type) {
+                    case ColumnAttribute::INT: {
+                        const int32_t *ints = page.int_values(ordinal);
+                        for (u_int16_t k = 0; k < n; k++)
+                            column.numbers[first + k] = ints[slots[k]];
+                        break;
+                    }
+                    case ColumnAttribute::BOOLEAN: {
+                        const uint8_t *booleans = page.boolean_values(ordinal);
+                        for (u_int16_t k = 0; k < n; k++)
+                            column.numbers[first + k] = booleans[slots[k]];
+                        break;
+                    }
+                    default:
+                        for (u_int16_t k = 0; k < n; k++) {
+                            u_int16_t size;
+                            column.texts[first + k] = page.text(slots[k], ordinal, size);
+                            column.sizes[first + k] = column.nulls[first + k] ? 0 : size;
+                        }
+                }
+            }
+            if (batch.full())
+                batch.flush(visit);
+        }
+        if (has_text && batch.size > 0)
+            batch.flush(visit);
+    });
+    if (batch.size > 0)
+        batch.flush(visit);
+}
+
+/**
+ * Get a block from the file as one of our pages.
+ * @param block_id  which block
+ * @return          the page (freed by caller, and only good until the next get or get_new)
+ */
+PaxPage *ColumnarTable::get(BlockID block_id) {
+    SlottedPage *block = this->file.get(block_id);
+    PaxPage *page = new PaxPage(*block->get_block(), block_id, this->layout);
+    delete block;
+    return page;
+}
+
+/**
+ * Add a block to the end of the file as an empty page.
+ * @return  the page (freed by caller, and only good until the next get or get_new)
+ */
+PaxPage *ColumnarTable::get_new() {
+    SlottedPage *block = this->file.get_new();
+    PaxPage *page = new PaxPage(*block->get_block(), block->get_block_id(), this->layout, true);
+    delete block;
+    return page;
+}
+
+/**
+ * Put a row's values in column order, with NULL for any column that isn't given.
+ * @param row     values keyed by column name
+ * @param values  where to put them
+ * @throws DbRelationError if a value isn't of its column's type
+ */
+void ColumnarTable::validate(const ValueDict *row, Tuple &values) const {
+    values.resize(this->column_names.size());
+    for (uint i = 0; i < this->column_names.size(); i++) {
+        ValueDict::const_iterator column = row->find(this->column_names[i]);
+        if (column == row->end()) {
+            values[i] = this->null_row[i];  // no defaults yet, so NULL
+            continue;
+        }
+        const Value &value = column->second;
+        bool is_text = this->layout.data_types[i] == ColumnAttribute::TEXT;
+        if (!value.is_null() && (value.data_type == ColumnAttribute::TEXT) != is_text)
+            throw DbRelationError("wrong type of value for column " + this->column_names[i]);
+        values[i] = value;
+    }
+}
+
+/**
+ * Add a row to the tail page, or if it is full, write it out and replace it with a new page. Nothing is
+ * written until the tail page fills, so the caller has to put the final one.
+ * @param tail    the last page of the file (may be replaced)
+ * @param values  the row, in column order
+ * @return        handle of the new row
+ * @throws DbRelationError if the row won't fit even in an empty page
+ */
+Handle ColumnarTable::append(PaxPage *&tail, const Tuple &values) {
+    vector<const Value *> pointers;
+    for (auto const &value: values)
+        pointers.push_back(&value);
+    RecordID record_id;
+    try {
+        record_id = tail->add(pointers.data());
+    } catch (DbBlockNoRoomError &e) {
+        this->file.put(tail);
+        delete tail;
+        tail = get_new();
+        try {
+            record_id = tail->add(pointers.data());
+        } catch (DbBlockNoRoomError &e) {
+            throw DbRelationError("row too big for a " + this->table_name + " block");
+        }
+    }
+    return Handle(tail->get_block_id(), record_id);
+}
+
+/**
+ * Find which of a page's row slots are live and satisfy the where clause. Each INT or BOOLEAN condition is one
+ * pass of a SimdKernels kernel down the column's minipage, and its bitmask is ANDed into the live bitmap along
+ * with the column's null bitmap a byte at a time.
+ * @param page     the page
+ * @param where    predicates to match (all live rows if nullptr)
+ * @param matches  set to a bitmap of the selected row slots (bit i%8 of byte i/8 for slot i)
+ */
+void ColumnarTable::select(const PaxPage &page, const Conjunction *where, vector<uint8_t> &matches) const {
+    u_int16_t rows = page.rows();
+    u_int16_t bytes = (u_int16_t) ((rows + 7) / 8);
+    const uint8_t *live = page.live_bits();
+    matches.assign(live, live + bytes);
+    if (where == nullptr)
+        return;
+    vector<uint8_t> mask(bytes);
+    for (auto const &condition: *where) {
+        uint column = condition.first;
+        const Value &value = condition.second;
+        const uint8_t *nulls = page.null_bits(column);
+        if (value.data_type != this->layout.data_types[column]) {
+            matches.assign(bytes, 0);  // never equal (see Value::operator==)
+            return;
+        }
+        if (value.is_null()) {
+            for (u_int16_t i = 0; i < bytes; i++)
+                matches[i] &= nulls[i];
+            continue;
+        }
+        switch (value.data_type) {
+            case ColumnAttribute::INT:
+                SimdKernels::int32_equal(page.int_values(column), rows, value.n, mask.data());
+                break;
+            case ColumnAttribute::BOOLEAN:
+                SimdKernels::byte_equal(page.boolean_values(column), rows, (uint8_t) value.n, mask.data());
+                break;
+            default: {
+                // the text is found through the minipage's offsets, so just check the rows still in the running
+                const char *data = value.text_data();
+                u_int32_t size = value.text_size();
+                for (u_int16_t row = 0; row < rows; row++) {
+                    uint8_t bit = (uint8_t) (1 << (row & 7));
+                    if (!(matches[row >> 3] & bit) || (nulls[row >> 3] & bit))
+                        continue;
+                    u_int16_t text_size;
+                    const char *text = page.text(row, column, text_size);
+                    if (text_size != size || memcmp(text, data, size) != 0)
+                        matches[row >> 3] &= (uint8_t) ~bit;
+                }
+                continue;
+            }
+        }
+        for (u_int16_t i = 0; i < bytes; i++)
+            matches[i] &= (uint8_t) (mask[i] & ~nulls[i]);
+    }
+}
+
+/**
+ * Testing function for the columnar storage engine.
+ * @return true if the tests all succeeded
+ */
+bool test_columnar_table() {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    column_names.push_back("c");
+    ColumnAttributes column_attributes;
+    ColumnAttribute ca(ColumnAttribute::INT);
+    column_attributes.push_back(ca);
+    ca.set_data_type(ColumnAttribute::TEXT);
+    column_attributes.push_back(ca);
+    ca.set_data_type(ColumnAttribute::BOOLEAN);
+    column_attributes.push_back(ca);
+
+    ColumnarTable table("_test_columnar_cpp", column_names, column_attributes);
+    table.create_if_not_exists();
+
+    // half the rows one at a time and half as a batch, across several pages
+    ValueDict row;
+    ValueDicts batch;
+    for (int i = 0; i < 1000; i++) {
+        ValueDict *values = i < 500 ? &row : new ValueDict();
+        (*values)["a"] = Value(i);
+        (*values)["b"] = Value("row " + to_string(i % 10));
+        (*values)["c"] = Value(i % 2 == 0);
+        if (i < 500)
+            table.insert(values);
+        else
+            batch.push_back(values);
+    }
+    Handles *handles = table.insert(&batch);
+    for (auto const &values: batch)
+        delete values;
+    delete handles;
+    handles = table.select();
+    bool ok = handles->size() == 1000 && handles->back().first > 1;
+    ValueDict *got = ok ? table.project(handles->at(123)) : nullptr;
+    ok = ok && got->at("a").n == 123 && got->at("b").s() == "row 3" && got->at("c").n == 0;
+    delete got;
+    delete handles;
+    if (!ok)
+        return false;
+    cout << "columnar insert/select/project ok" << endl;
+
+    // conditions on each type of column, NULLs, and refining a selection
+    ValueDict where;
+    where["b"] = Value("row 4");
+    where["c"] = Value(1);
+    where["c"].data_type = ColumnAttribute::BOOLEAN;
+    handles = table.select(&where);
+    ok = handles->size() == 100;
+    ValueDict narrower;
+    narrower["a"] = Value(504);
+    Handles *refined = table.select(handles, &narrower);
+    ok = ok && refined->size() == 1 && refined->at(0) == handles->at(50);
+    delete refined;
+    delete handles;
+    ValueDict partial;
+    partial["a"] = Value(-1);
+    Handle with_null = table.insert(&partial);
+    where.clear();
+    where["b"] = Value::null(ColumnAttribute::TEXT);
+    handles = table.select(&where);
+    got = table.project(with_null);
+    ok = ok && handles->size() == 1 && handles->at(0) == with_null && got->at("b").is_null() && got->at("c").is_null();
+    delete got;
+    delete handles;
+    if (!ok)
+        return false;
+    cout << "columnar where ok" << endl;
+
+    // batches come straight from the minipages, NULLs and all
+    ColumnOrdinals b_and_a;
+    b_and_a.push_back(1);
+    b_and_a.push_back(0);
+    size_t batched_rows = 0;
+    Tuples found;
+    table.scan_batches(&b_and_a, [&](Batch &batch) {
+        batched_rows += batch.size;
+        batch.filter(0, Value("row 7"));
+        batch.filter(1, Value(997));
+        batch.project(b_and_a, found);  // the same positions, so (a, b)
+    });
+    ok = batched_rows == 1001 && found.size() == 1 && found[0]->at(0) == Value(997)
+         && found[0]->at(1) == Value("row 7");
+    for (auto const &values: found)
+        delete values;
+    if (!ok)
+        return false;
+    cout << "columnar batch scan ok" << endl;
+
+    // an update stays put, a delete drops the row from selections and scans
+    string longer(200, 'x');
+    ValueDict changes;
+    changes["b"] = Value(longer);
+    table.update(with_null, &changes);
+    where.clear();
+    where["b"] = Value(longer);
+    handles = table.select(&where);
+    ok = handles->size() == 1 && handles->at(0) == with_null;
+    delete handles;
+
+    // but one of many rows whose new text would overflow their block is caught before any of them is changed
+    handles = table.select();
+    Handles first_rows(handles->begin(), handles->begin() + 50);
+    Handles two_rows(handles->begin(), handles->begin() + 2);
+    delete handles;
+    try {
+        table.check_update(&first_rows, &changes);
+        ok = false;
+    } catch (DbRelationError &e) {
+        table.check_update(&two_rows, &changes);  // these two fit
+    }
+    table.del(with_null);
+    ColumnNames just_a;
+    just_a.push_back("a");
+    int next = 0;
+    table.scan(&just_a, [&](Handle handle, const ValueDict *values) {
+        if (values->size() != 1 || values->at("a").n != next++)
+            ok = false;
+    });
+    if (!ok || next != 1000)
+        return false;
+    cout << "columnar update/del/scan ok" << endl;
+    table.drop();
+
+    // after a reopen, inserts carry on in the last page, however few rows it has (here, one on the second page)
+    ColumnNames ints;
+    ints.push_back("a");
+    ints.push_back("b");
+    ColumnarTable reopened("_test_columnar_reopen", ints, ColumnAttributes(2, ColumnAttribute(ColumnAttribute::INT)));
+    reopened.create_if_not_exists();
+    row.clear();
+    for (int i = 0; i < 489; i++) {
+        row["a"] = Value(i);
+        row["b"] = Value(-i);
+        if (i == 488) {
+            reopened.close();
+            reopened.open();
+        }
+        reopened.insert(&row);
+    }
+    handles = reopened.select();
+    ok = handles->size() == 489 && handles->back() == Handle(2, 2);
+    delete handles;
+    reopened.drop();
+    if (!ok)
+        return false;
+    cout << "columnar reopen ok" << endl;
+    return true;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file ColumnarTable.h - Implementation of storage_engine with column-major (PAX) pages.
+ * ColumnarTable: DbRelation
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include "storage_engine.h"
+#include "HeapFile.h"
+#include "PaxPage.h"
+#include "Batch.h"
+
+/**
+ * @class ColumnarTable - columnar storage engine (implementation of DbRelation), storage engine "COLUMNAR"
+ *
+ * Blocks are kept in a Berkeley DB RecNo file just as for HeapTable, but each one is a PaxPage, which
+ * stores its rows column by column. Selections and scans work down the minipages of just the columns they
+ * need, and a where clause is checked a whole page at a time against each column's array of values.
+ * A handle is the row's block and its slot on the page, and rows never move, so an update that grows a
+ * row's text past what its page has room for fails rather than relocating it (see check_update).
+ */
+class ColumnarTable : public DbRelation {
+public:
+    ColumnarTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes);
+
+    virtual ~ColumnarTable();
+
+    ColumnarTable(const ColumnarTable &other) = delete;
+
+    ColumnarTable(ColumnarTable &&temp) = delete;
+
+    ColumnarTable &operator=(const ColumnarTable &other) = delete;
+
+    ColumnarTable &operator=(ColumnarTable &&temp) = delete;
+
+    virtual void create();
+
+    virtual void create_if_not_exists();
+
+    virtual void drop();
+
+    virtual void open();
+
+    virtual void close();
+
+    virtual Handle insert(const ValueDict *row);
+
+    virtual Handles *insert(const ValueDicts *rows);
+
+    virtual void update(const Handle handle, const ValueDict *new_values);
+
+    virtual void check_update(const Handles *handles, const ValueDict *new_values);
+
+    virtual void del(const Handle handle);
+
+    virtual Handles *select();
+
+    virtual Handles *select(const ValueDict *where);
+
+    virtual Handles *select(Handles *current_selection, const ValueDict *where);
+
+    virtual ValueDict *project(Handle handle);
+
+    virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
+
+    virtual Tuple *project(Handle handle, const ColumnOrdinals *ordinals);
+
+    using DbRelation::project;
+
+    virtual void scan(const ColumnOrdinals *ordinals, TupleVisitor visit);
+
+    using DbRelation::scan;
+
+    virtual void scan_batches(const ColumnOrdinals *ordinals, BatchVisitor visit, const Conjunction *where = nullptr);
+
+protected:
+    HeapFile file;
+    PaxLayout layout;
+    Tuple null_row;  // a NULL for each column
+
+    virtual PaxPage *get(BlockID block_id);
+
+    virtual PaxPage *get_new();
+
+    virtual void validate(const ValueDict *row, Tuple &values) const;
+
+    virtual Handle append(PaxPage *&tail, const Tuple &values);
+
+    virtual void select(const PaxPage &page, const Conjunction *where, std::vector<uint8_t> &matches) const;
+};
+
+bool test_columnar_table();
@@ -0,0 +1,241 @@
+/**
+ * @file CsvCodec.cpp - implementation of CsvReader and CsvWriter
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "CsvCodec.h"
+
+using namespace std;
+
+/**
+ * Open the file for reading.
+ * @param path  file to read
+ * @throws CsvError if it can't be opened
+ */
+CsvReader::CsvReader(string path) : path(path), fd(-1), buffer(nullptr), buffer_end(0), buffer_pos(0), record(),
+                                    starts(), line_number(1), record_line(0) {
+    this->fd = ::open(path.c_str(), O_RDONLY);
+    if (this->fd < 0)
+        throw CsvError("could not open " + path + ": " + strerror(errno));
+    posix_fadvise(this->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    this->buffer = new char[BUFFER_SZ];
+}
+
+CsvReader::~CsvReader() {
+    delete[] this->buffer;
+    if (this->fd >= 0)
+        ::close(this->fd);
+}
+
+/**
+ * Read the next record into our record buffer. Each field is followed by a NUL and starts
+ * remembers where each one begins.
+ * @return  false if there are no more records
+ */
+bool CsvReader::next() {
+    do {
+        this->record.clear();
+        this->starts.clear();
+        this->starts.push_back(0);
+        this->record_line = this->line_number;
+        bool quoted = false;       // inside a quoted field
+        bool was_quoted = false;   // record has had a quoted field (so it isn't blank)
+        bool any = false;          // found anything at all for this record
+        while (true) {
+            if (this->buffer_pos == this->buffer_end && !fill()) {
+                if (!any)
+                    return false;
+                break;  // last line with no newline
+            }
+            char c = this->buffer[this->buffer_pos++];
+            any = true;
+            if (quoted) {
+                if (c == '"') {
+                    if (this->buffer_pos == this->buffer_end && !fill()) {
+                        quoted = false;
+                    } else if (this->buffer[this->buffer_pos] == '"') {
+                        this->record += '"';
+                        this->buffer_pos++;
+                    } else {
+                        quoted = false;
+                    }
+                } else {
+                    if (c == '\n')
+                        this->line_number++;
+                    this->record += c;
+                }
+            } else if (c == '"') {
+                quoted = was_quoted = true;
+            } else if (c == ',') {
+                this->record += '\0';
+                this->starts.push_back((uint) this->record.size());
+            } else if (c == '\n') {
+                this->line_number++;
+                break;
+            } else if (c != '\r') {
+                this->record += c;
+            }
+        }
+        if (quoted)
+            throw CsvError(this->path + " line " + to_string(this->record_line) + ": unterminated quoted field");
+        this->record += '\0';
+        if (this->starts.size() > 1 || this->record.size() > 1 || was_quoted)
+            return true;
+    } while (true);  // blank line, so try again
+}
+
+/**
+ * The length of the given field of the current record.
+ * @param i  field number, starting from 0
+ * @return   number of characters in the field (not counting its terminating NUL)
+ */
+uint CsvReader::field_size(uint i) const {
+    uint end = i + 1 < this->starts.size() ? this->starts[i + 1] : (uint) this->record.size();
+    return end - this->starts[i] - 1;
+}
+
+/**
+ * Read the next chunk of the file into the buffer.
+ * @return  false at end of file
+ */
+bool CsvReader::fill() {
+    ssize_t n;
+    do {
+        n = ::read(this->fd, this->buffer, BUFFER_SZ);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        throw CsvError("could not read " + this->path + ": " + strerror(errno));
+    this->buffer_pos = 0;
+    this->buffer_end = (size_t) n;
+    return n > 0;
+}
+
+/**
+ * Create (or truncate) the file for writing.
+ * @param path  file to write
+ * @throws CsvError if it can't be created
+ */
+CsvWriter::CsvWriter(string path) : path(path), fd(-1), buffer(nullptr), buffer_end(0), first_field(true) {
+    this->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (this->fd < 0)
+        throw CsvError("could not create " + path + ": " + strerror(errno));
+    this->buffer = new char[BUFFER_SZ];
+}
+
+/**
+ * Closes the file if close() wasn't called (any errors are lost).
+ */
+CsvWriter::~CsvWriter() {
+    if (this->fd >= 0) {
+        try {
+            flush();
+        } catch (CsvError &e) {
+            // nobody to tell
+        }
+        ::close(this->fd);
+    }
+    delete[] this->buffer;
+}
+
+/**
+ * Add a text field to the current record, quoting it if it has anything in it that would confuse a reader.
+ * @param data  the text
+ * @param size  its length
+ */
+void CsvWriter::field(const char *data, uint size) {
+    if (!this->first_field)
+        put(",", 1);
+    this->first_field = false;
+    bool needs_quotes = false;
+    for (uint i = 0; i < size && !needs_quotes; i++)
+        needs_quotes = data[i] == ',' || data[i] == '"' || data[i] == '\n' || data[i] == '\r';
+    if (!needs_quotes) {
+        put(data, size);
+        return;
+    }
+    put("\"", 1);
+    uint start = 0;
+    for (uint i = 0; i < size; i++) {
+        if (data[i] == '"') {
+            put(data + start, i + 1 - start);  // through the quote, and then double it
+            put("\"", 1);
+            start = i + 1;
+        }
+    }
+    put(data + start, size - start);
+    put("\"", 1);
+}
+
+/**
+ * Add a number field to the current record.
+ * @param n  the number
+ */
+void CsvWriter::field(int32_t n) {
+    char digits[16];
+    int size = snprintf(digits, sizeof(digits), "%d", n);
+    if (!this->first_field)
+        put(",", 1);
+    this->first_field = false;
+    put(digits, (size_t) size);
+}
+
+/**
+ * Finish the current record.
+ */
+void CsvWriter::end_record() {
+    put("\n", 1);
+    this->first_field = true;
+}
+
+/**
+ * Write out what is left in the buffer and close the file.
+ * @throws CsvError if the file couldn't be written
+ */
+void CsvWriter::close() {
+    if (this->fd < 0)
+        return;
+    flush();
+    int result = ::close(this->fd);
+    this->fd = -1;
+    if (result < 0)
+        throw CsvError("could not write " + this->path + ": " + strerror(errno));
+}
+
+/**
+ * Add bytes to the buffer, writing it out whenever it fills.
+ * @param data  the bytes
+ * @param size  how many of them
+ */
+void CsvWriter::put(const char *data, size_t size) {
+    while (size > 0) {
+        if (this->buffer_end == BUFFER_SZ)
+            flush();
+        size_t n = min(size, BUFFER_SZ - this->buffer_end);
+        memcpy(this->buffer + this->buffer_end, data, n);
+        this->buffer_end += n;
+        data += n;
+        size -= n;
+    }
+}
+
+/**
+ * Write out the buffer.
+ * @throws CsvError if the file couldn't be written
+ */
+void CsvWriter::flush() {
+    size_t written = 0;
+    while (written < this->buffer_end) {
+        ssize_t n = ::write(this->fd, this->buffer + written, this->buffer_end - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw CsvError("could not write " + this->path + ": " + strerror(errno));
+        written += (size_t) n;
+    }
+    this->buffer_end = 0;
+}
@@ -0,0 +1,147 @@
+/**
+ * @file CsvCodec.h - streaming reader and writer for comma-separated value files.
+ * CsvReader
+ * CsvWriter
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @class CsvError - problems reading or writing a CSV file
+ */
+class CsvError : public std::runtime_error {
+public:
+    explicit CsvError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * @class CsvReader - reads a CSV file one record at a time
+ *
+ * Fields are separated by commas and records by newlines (a carriage return before the newline is dropped).
+        A field in double quotes may hold commas, newlines and doubled quotes ("") standing for one quote.
+        Blank lines are skipped.
+        The file is read BUFFER_SZ bytes at a time and the current record is held in one buffer that is reused
+        for every record, so the fields of a record are only good until the next call to next().
+ */
+class CsvReader {
+public:
+    CsvReader(std::string path);
+
+    virtual ~CsvReader();
+
+    CsvReader(const CsvReader &other) = delete;
+
+    CsvReader(CsvReader &&temp) = delete;
+
+    CsvReader &operator=(const CsvReader &other) = delete;
+
+    CsvReader &operator=(CsvReader &&temp) = delete;
+
+    /**
+     * Move on to the next record in the file.
+     * @return  false if there are no more records
+     */
+    virtual bool next();
+
+    /**
+     * Number of fields in the current record.
+     */
+    virtual uint size() const { return (uint) this->starts.size(); }
+
+    /**
+     * The text of the given field of the current record (with quoting undone and a terminating NUL).
+     * @param i  field number, starting from 0
+     */
+    virtual const char *field(uint i) const { return this->record.data() + this->starts[i]; }
+
+    /**
+     * The length of the given field of the current record.
+     * @param i  field number, starting from 0
+     */
+    virtual uint field_size(uint i) const;
+
+    /**
+     * Line in the file the current record starts on (for error messages).
+     */
+    virtual u_long line() const { return this->record_line; }
+
+    static const uint BUFFER_SZ = 64 * 1024;
+
+protected:
+    std::string path;
+    int fd;
+    char *buffer;
+    size_t buffer_end;
+    size_t buffer_pos;
+    std::string record;
+    std::vector<uint> starts;
+    u_long line_number;
+    u_long record_line;
+
+    virtual bool fill();
+};
+
+/**
+ * @class CsvWriter - writes a CSV file one field at a time
+ *
+ * Output is gathered in a BUFFER_SZ buffer and written out whenever it fills. Fields are only quoted when
+        they have to be (they hold a comma, quote, newline or carriage return).
+        Call close() to find out whether everything made it out to the file.
+ */
+class CsvWriter {
+public:
+    CsvWriter(std::string path);
+
+    virtual ~CsvWriter();
+
+    CsvWriter(const CsvWriter &other) = delete;
+
+    CsvWriter(CsvWriter &&temp) = delete;
+
+    CsvWriter &operator=(const CsvWriter &other) = delete;
+
+    CsvWriter &operator=(CsvWriter &&temp) = delete;
+
+    /**
+     * Add a text field to the current record.
+     * @param data  the text
+     * @param size  its length
+     */
+    virtual void field(const char *data, uint size);
+
+    /**
+     * Add a number field to the current record.
+     * @param n  the number
+     */
+    virtual void field(int32_t n);
+
+    /**
+     * Finish the current record.
+     */
+    virtual void end_record();
+
+    /**
+     * Write out what is left in the buffer and close the file.
+     */
+    virtual void close();
+
+    static const uint BUFFER_SZ = 64 * 1024;
+
+protected:
+    std::string path;
+    int fd;
+    char *buffer;
+    size_t buffer_end;
+    bool first_field;
+
+    virtual void put(const char *data, size_t size);
+
+    virtual void flush();
+};
@@ -4,7 +4,15 @@
  * @see "Seattle University, CPSC5300, Spring 2022"
  */
 
+#include <algorithm>
+#include <map>
+#include <mutex>
 #include "EvalPlan.h"
+#include "HashJoin.h"
+#include "MergeJoin.h"
+#include "ExternalSort.h"
+
+using namespace std;
 
 
 class Dummy : public DbRelation {
@@ -43,24 +51,71 @@ public:
     virtual ValueDict *project(Handle handle, const ColumnNames *column_names) { return nullptr; }
 };
 
+bool EvalPlan::batch_execution = true;
+bool EvalPlan::parallel_execution = true;
+size_t EvalPlan::join_memory = 64 * 1024 * 1024;
+size_t EvalPlan::sort_memory = ExternalSort::DEFAULT_MEMORY;
+
 EvalPlan::EvalPlan(PlanType type, EvalPlan *relation) : type(type), relation(relation), projection(nullptr),
-                                                        select_conjunction(nullptr), table(Dummy::one()) {
+                                                        select_conjunction(nullptr), order(nullptr), limit(0),
+                                                        offset(0), table(Dummy::one()), alias(), indices(),
+                                                        right(nullptr), left_keys(nullptr), right_keys(nullptr),
+                                                        join_method(HashJoinMethod), build_left(false),
+                                                        index(nullptr), left_index(nullptr) {
 }
 
 EvalPlan::EvalPlan(ColumnNames *projection, EvalPlan *relation) : type(Project), relation(relation),
                                                                   projection(projection), select_conjunction(nullptr),
-                                                                  table(Dummy::one()) {
+                                                                  order(nullptr), limit(0), offset(0),
+                                                                  table(Dummy::one()), alias(), indices(),
+                                                                  right(nullptr), left_keys(nullptr),
+                                                                  right_keys(nullptr), join_method(HashJoinMethod),
+                                                                  build_left(false), index(nullptr),
+                                                                  left_index(nullptr) {
 }
 
 EvalPlan::EvalPlan(ValueDict *conjunction, EvalPlan *relation) : type(Select), relation(relation), projection(nullptr),
-                                                                 select_conjunction(conjunction), table(Dummy::one()) {
+                                                                 select_conjunction(conjunction), order(nullptr),
+                                                                 limit(0), offset(0), table(Dummy::one()), alias(),
+                                                                 indices(), right(nullptr), left_keys(nullptr),
+                                                                 right_keys(nullptr), join_method(HashJoinMethod),
+                                                                 build_left(false), index(nullptr),
+                                                                 left_index(nullptr) {
+}
+
+EvalPlan::EvalPlan(DbRelation &table, Identifier alias) : type(TableScan), relation(nullptr), projection(nullptr),
+                                                          select_conjunction(nullptr), order(nullptr), limit(0),
+                                                          offset(0), table(table),
+                                                          alias(alias.empty() ? table.get_table_name() : alias),
+                                                          indices(), right(nullptr), left_keys(nullptr),
+                                                          right_keys(nullptr), join_method(HashJoinMethod),
+                                                          build_left(false), index(nullptr), left_index(nullptr) {
+}
+
+EvalPlan::EvalPlan(EvalPlan *left, EvalPlan *right, ColumnNames *left_keys, ColumnNames *right_keys)
+        : type(Join), relation(left), projection(nullptr), select_conjunction(nullptr), order(nullptr), limit(0),
+          offset(0), table(Dummy::one()), alias(), indices(), right(right), left_keys(left_keys),
+          right_keys(right_keys), join_method(HashJoinMethod), build_left(false), index(nullptr),
+          left_index(nullptr) {
+}
+
+EvalPlan::EvalPlan(OrderBy *order, EvalPlan *relation)
+        : type(Sort), relation(relation), projection(nullptr), select_conjunction(nullptr), order(order), limit(0),
+          offset(0), table(Dummy::one()), alias(), indices(), right(nullptr), left_keys(nullptr),
+          right_keys(nullptr), join_method(HashJoinMethod), build_left(false), index(nullptr), left_index(nullptr) {
 }
 
-EvalPlan::EvalPlan(DbRelation &table) : type(TableScan), relation(nullptr), projection(nullptr),
-                                        select_conjunction(nullptr), table(table) {
+EvalPlan::EvalPlan(u_long limit, u_long offset, EvalPlan *relation)
+        : type(Limit), relation(relation), projection(nullptr), select_conjunction(nullptr), order(nullptr),
+          limit(limit), offset(offset), table(Dummy::one()), alias(), indices(), right(nullptr), left_keys(nullptr),
+          right_keys(nullptr), join_method(HashJoinMethod), build_left(false), index(nullptr), left_index(nullptr) {
 }
 
-EvalPlan::EvalPlan(const EvalPlan *other) : type(other->type), table(other->table) {
+EvalPlan::EvalPlan(const EvalPlan *other) : type(other->type), limit(other->limit), offset(other->offset),
+                                            table(other->table), alias(other->alias),
+                                            indices(other->indices), join_method(other->join_method),
+                                            build_left(other->build_left), index(other->index),
+                                            left_index(other->left_index) {
     if (other->relation != nullptr)
         relation = new EvalPlan(other->relation);
     else
@@ -73,31 +128,241 @@ EvalPlan::EvalPlan(const EvalPlan *other) : type(other->type), table(other->tabl
         select_conjunction = new ValueDict(*other->select_conjunction);
     else
         select_conjunction = nullptr;
+    if (other->order != nullptr)
+        order = new OrderBy(*other->order);
+    else
+        order = nullptr;
+    if (other->right != nullptr) {
+        right = new EvalPlan(other->right);
+        left_keys = new ColumnNames(*other->left_keys);
+        right_keys = new ColumnNames(*other->right_keys);
+    } else {
+        right = nullptr;
+        left_keys = right_keys = nullptr;
+    }
 }
 
 EvalPlan::~EvalPlan() {
     delete relation;
     delete projection;
     delete select_conjunction;
+    delete order;
+    delete right;
+    delete left_keys;
+    delete right_keys;
 }
 
 
+void EvalPlan::add_index(DbIndex &index) {
+    this->indices.push_back(&index);
+}
+
 EvalPlan *EvalPlan::optimize() {
-    return new EvalPlan(this);  // For now, we don't know how to do anything better
+    EvalPlan *plan = new EvalPlan(this);
+    plan->choose_join_methods();
+    return plan;
 }
 
-ValueDicts *EvalPlan::evaluate() {
-    ValueDicts *ret = nullptr;
+/*
+ * How each join is carried out, by the estimates of the rows on each side:
+ * - an index on the right side's table is probed for each row of the left side when the left side has few enough
+ *   rows that the probes cost less than scanning the whole right table;
+ * - otherwise the sides are merged when one can be read in key order through an ordered index on its join columns
+ *   and the other can be too, or has fewer rows (so sorting it costs less than hashing the other);
+ * - otherwise the smaller side is hashed, so the table built is as small as it can be.
+ */
+void EvalPlan::choose_join_methods() {
+    if (this->relation != nullptr)
+        this->relation->choose_join_methods();
+    if (this->right != nullptr)
+        this->right->choose_join_methods();
+    if (this->type != Join)
+        return;
+    u_long left_rows = this->relation->estimate_rows(), right_rows = this->right->estimate_rows();
+    vector<const ValueDict *> conjunctions;
+    EvalPlan *scan = this->right->scanned_table(conjunctions);
+    DbIndex *probed = this->right->key_index(*this->right_keys, false);
+    if (probed != nullptr && left_rows * INDEX_PROBE_ROWS < scan->estimate_rows()) {
+        this->join_method = IndexJoinMethod;
+        this->index = probed;
+        this->left_index = nullptr;
+        return;
+    }
+    this->left_index = this->relation->key_index(*this->left_keys, true);
+    this->index = this->right->key_index(*this->right_keys, true);
+    ColumnOrdinals order;
+    if (!index_order(order))
+        this->left_index = nullptr;  // the indices are on the columns in different orders, so sort the left side
+    bool left_ordered = this->left_index != nullptr, right_ordered = this->index != nullptr;
+    if ((left_ordered && right_ordered) || (left_ordered && right_rows < left_rows)
+        || (right_ordered && left_rows < right_rows)) {
+        this->join_method = MergeJoinMethod;
+        return;
+    }
+    this->join_method = HashJoinMethod;
+    this->index = this->left_index = nullptr;
+    this->build_left = left_rows < right_rows;
+}
+
+/*
+ * For a chain of Selects over a TableScan, an index on the table keyed on nothing but some of the given columns
+ * (as alias.column), so it can be probed with their values; or, if ordered, an ordered index keyed on all of them,
+ * so the table can be read in their order. Returns nullptr if there isn't one.
+ */
+DbIndex *EvalPlan::key_index(const ColumnNames &keys, bool ordered) {
+    vector<const ValueDict *> conjunctions;
+    EvalPlan *scan = scanned_table(conjunctions);
+    if (scan == nullptr)
+        return nullptr;
+    for (auto const &index: scan->indices) {
+        const ColumnNames &key_columns = index->get_key_columns();
+        if (ordered && (!index->is_ordered() || key_columns.size() != keys.size()))
+            continue;
+        bool covered = true;
+        for (auto const &column: key_columns)
+            if (find(keys.begin(), keys.end(), scan->alias + "." + column) == keys.end())
+                covered = false;
+        if (covered)
+            return index;
+    }
+    return nullptr;
+}
+
+/*
+ * For a merge Join, the order to compare its pairs of keys in (as positions in left_keys and right_keys): that of
+ * the key columns of the ordered index a side is read through. Returns false if both sides are read through
+ * indices and they don't agree.
+ */
+bool EvalPlan::index_order(ColumnOrdinals &order) {
+    order.clear();
+    EvalPlan *sides[] = {this->relation, this->right};
+    DbIndex *indices[] = {this->left_index, this->index};
+    ColumnNames *keys[] = {this->left_keys, this->right_keys};
+    for (uint side = 0; side < 2; side++) {
+        if (indices[side] == nullptr)
+            continue;
+        vector<const ValueDict *> conjunctions;
+        Identifier alias = sides[side]->scanned_table(conjunctions)->alias;
+        ColumnOrdinals side_order;
+        for (auto const &column: indices[side]->get_key_columns())
+            side_order.push_back((uint) (find(keys[side]->begin(), keys[side]->end(), alias + "." + column)
+                                         - keys[side]->begin()));
+        if (!order.empty() && order != side_order)
+            return false;
+        order = side_order;
+    }
+    if (order.empty())
+        for (uint i = 0; i < this->left_keys->size(); i++)
+            order.push_back(i);
+    return true;
+}
+
+/**
+ * A rough count of the rows the plan will produce: a table's own estimate, a tenth of that for each condition of
+ * a Select, as many rows as the bigger side for a Join (as when each row of it has one match in the other), and
+ * no more than its limit for a Limit.
+ * @return  the estimate
+ */
+u_long EvalPlan::estimate_rows() {
+    switch (this->type) {
+        case TableScan:
+            return this->table.estimate_rows();
+        case Select: {
+            u_long rows = this->relation->estimate_rows();
+            for (uint i = 0; i < this->select_conjunction->size() && rows > 1; i++)
+                rows = rows / 10 > 0 ? rows / 10 : 1;
+            return rows;
+        }
+        case Join:
+            return max(this->relation->estimate_rows(), this->right->estimate_rows());
+        case Limit: {
+            u_long rows = this->relation->estimate_rows();
+            rows = rows > this->offset ? rows - this->offset : 0;
+            return min(rows, this->limit);
+        }
+        default:
+            return this->relation->estimate_rows();
+    }
+}
+
+/*
+ * Where a column is in a list of table.column names: name may be table.column, or just column if there is only
+ * one table with a column of that name.
+ */
+static uint find_column(const ColumnNames &names, const Identifier &name) {
+    bool qualified = name.find('.') != string::npos;
+    string suffix = "." + name;
+    int found = -1;
+    for (uint i = 0; i < names.size(); i++) {
+        const Identifier &column = names[i];
+        bool match = qualified ? column == name : column.size() > suffix.size()
+                                                  && column.compare(column.size() - suffix.size(), suffix.size(),
+                                                                    suffix) == 0;
+        if (!match)
+            continue;
+        if (found >= 0)
+            throw DbRelationError("column " + name + " is ambiguous");
+        found = (int) i;
+    }
+    if (found < 0)
+        throw DbRelationError("unknown column " + name);
+    return (uint) found;
+}
+
+void EvalPlan::get_columns(ColumnNames &names, ColumnAttributes &attributes) {
+    switch (this->type) {
+        case TableScan: {
+            const ColumnNames &column_names = this->table.get_column_names();
+            ColumnAttributes column_attributes = this->table.get_column_attributes();
+            for (uint i = 0; i < column_names.size(); i++) {
+                names.push_back(this->alias + "." + column_names[i]);
+                attributes.push_back(column_attributes[i]);
+            }
+            break;
+        }
+        case Join:
+            this->relation->get_columns(names, attributes);
+            this->right->get_columns(names, attributes);
+            break;
+        case Project: {
+            ColumnNames all_names;
+            ColumnAttributes all_attributes;
+            this->relation->get_columns(all_names, all_attributes);
+            for (auto const &name: *this->projection) {
+                names.push_back(name);
+                attributes.push_back(all_attributes[find_column(all_names, name)]);
+            }
+            break;
+        }
+        default:
+            this->relation->get_columns(names, attributes);
+    }
+}
+
+bool EvalPlan::needs_rows() const {
+    return this->type == Join || this->type == Sort || this->type == Limit
+           || (this->relation != nullptr && this->relation->needs_rows());
+}
+
+Tuples *EvalPlan::evaluate() {
     if (this->type != ProjectAll && this->type != Project)
         throw DbRelationError("Invalid evaluation plan--not ending with a projection");
 
+    if (this->relation->needs_rows())
+        return evaluate_rows();
+    vector<const ValueDict *> conjunctions;
+    EvalPlan *scan = batch_execution ? this->relation->scanned_table(conjunctions) : nullptr;
+    if (scan != nullptr)
+        return evaluate_batches(scan->table, conjunctions);
+
     EvalPipeline pipeline = this->relation->pipeline();
     DbRelation *temp_table = pipeline.first;
     Handles *handles = pipeline.second;
-    if (this->type == ProjectAll)
-        ret = temp_table->project(handles);
-    else if (this->type == Project)
-        ret = temp_table->project(handles, this->projection);
+    // look the projected columns up once here rather than by name in every row
+    ColumnNames all_columns;
+    ColumnOrdinals *ordinals = temp_table->get_column_ordinals(this->type == ProjectAll ? &all_columns : this->projection);
+    Tuples *ret = temp_table->project(handles, ordinals);
+    delete ordinals;
     delete handles;
     return ret;
 }
@@ -106,6 +371,12 @@ EvalPipeline EvalPlan::pipeline() {
     // base cases
     if (this->type == TableScan)
         return EvalPipeline(&this->table, this->table.select());
+    if (this->type == Select && batch_execution) {
+        vector<const ValueDict *> conjunctions;
+        EvalPlan *scan = scanned_table(conjunctions);
+        if (scan != nullptr)
+            return EvalPipeline(&scan->table, select_batches(scan->table, conjunctions));
+    }
     if (this->type == Select && this->relation->type == TableScan)
         return EvalPipeline(&this->relation->table, this->relation->table.select(this->select_conjunction));
 
@@ -120,4 +391,515 @@ EvalPipeline EvalPlan::pipeline() {
     }
 
     throw DbRelationError("Not implemented: pipeline other than Select or TableScan");
-}
\ No newline at end of file
+}
+/**
+ * Scan a table a batch at a time, keeping the rows that satisfy every one of a list of where clauses.
+ * @param table         the table
+ * @param conjunctions  the where clauses
+ * @param wanted        columns (by ordinal) the visitor needs
+ * @param positions     set to where each of the wanted columns is in the batches
+ * @param visit         called with each batch that has any rows left selected, and its morsel (from several threads
+ *                      at once unless parallel_execution is off; see DbRelation::scan_morsels)
+ */
+static void filtered_batches(DbRelation &table, const vector<const ValueDict *> &conjunctions,
+                             const ColumnOrdinals &wanted, ColumnOrdinals &positions, MorselVisitor visit) {
+    ColumnOrdinals scanned = wanted;
+    Conjunction filters;  // keyed by position in the batch
+    Conjunction all;  // keyed by column ordinal, so the scan can skip blocks that can't match
+    for (auto const &conjunction: conjunctions) {
+        Conjunction *where = table.get_conjunction(conjunction);
+        for (auto const &condition: *where) {
+            auto found = find(scanned.begin(), scanned.end(), condition.first);
+            if (found == scanned.end())
+                found = scanned.insert(scanned.end(), condition.first);
+            filters.push_back(make_pair((uint) (found - scanned.begin()), condition.second));
+            all.push_back(condition);
+        }
+        delete where;
+    }
+    positions.clear();
+    for (uint i = 0; i < wanted.size(); i++)
+        positions.push_back(i);
+    MorselVisitor filter = [&](uint morsel, Batch &batch) {
+        for (auto const &filter: filters) {
+            batch.filter(filter.first, filter.second);
+            if (batch.selected == 0)
+                return;
+        }
+        visit(morsel, batch);
+    };
+    if (EvalPlan::parallel_execution)
+        table.scan_morsels(&scanned, filter, &all);
+    else
+        table.scan_batches(&scanned, [&](Batch &batch) { filter(0, batch); }, &all);
+}
+
+// Follow a chain of Selects down to the TableScan at the bottom, gathering their where clauses.
+EvalPlan *EvalPlan::scanned_table(vector<const ValueDict *> &conjunctions) {
+    EvalPlan *plan = this;
+    while (plan->type == Select) {
+        conjunctions.push_back(plan->select_conjunction);
+        plan = plan->relation;
+    }
+    return plan->type == TableScan ? plan : nullptr;
+}
+
+/**
+ * Evaluate a projection of a chain of Selects over a TableScan in one pass of batches: the scan brings up just
+ * the projected and filtered columns, each condition narrows the batches' selection vectors, and the rows left
+ * are projected a column at a time. Each morsel's rows are projected apart and put together in handle order.
+ * @param table         the scanned table
+ * @param conjunctions  the Selects' where clauses
+ * @return              the projected rows
+ */
+Tuples *EvalPlan::evaluate_batches(DbRelation &table, const vector<const ValueDict *> &conjunctions) {
+    ColumnNames all_columns;
+    ColumnOrdinals *ordinals = table.get_column_ordinals(this->type == ProjectAll ? &all_columns : this->projection);
+    ColumnOrdinals positions;
+    map<uint, Tuples> morsels;
+    mutex morsels_mutex;
+    try {
+        filtered_batches(table, conjunctions, *ordinals, positions, [&](uint morsel, Batch &batch) {
+            Tuples rows;
+            batch.project(positions, rows);
+            lock_guard<mutex> lock(morsels_mutex);
+            Tuples &projected = morsels[morsel];
+            projected.insert(projected.end(), rows.begin(), rows.end());
+        });
+    } catch (...) {
+        for (auto const &morsel: morsels)
+            for (auto const &row: morsel.second)
+                delete row;
+        delete ordinals;
+        throw;
+    }
+    delete ordinals;
+    Tuples *ret = new Tuples();
+    for (auto const &morsel: morsels)
+        ret->insert(ret->end(), morsel.second.begin(), morsel.second.end());
+    return ret;
+}
+
+/**
+ * Find the handles of the rows picked out by a chain of Selects over a TableScan in one pass of batches.
+ * The workers collect them in plain vectors, by morsel, and they are copied into the Handles (in handle order)
+ * on this thread, whose arena the Handles draw on.
+ * @param table         the scanned table
+ * @param conjunctions  the Selects' where clauses
+ * @return              the handles
+ */
+Handles *EvalPlan::select_batches(DbRelation &table, const vector<const ValueDict *> &conjunctions) {
+    ColumnOrdinals positions;
+    map<uint, vector<Handle>> morsels;
+    mutex morsels_mutex;
+    filtered_batches(table, conjunctions, ColumnOrdinals(), positions, [&](uint morsel, Batch &batch) {
+        vector<Handle> selected;
+        batch.selected_handles(selected);
+        lock_guard<mutex> lock(morsels_mutex);
+        vector<Handle> &found = morsels[morsel];
+        found.insert(found.end(), selected.begin(), selected.end());
+    });
+    Handles *handles = new Handles();
+    for (auto const &morsel: morsels)
+        handles->insert(handles->end(), morsel.second.begin(), morsel.second.end());
+    return handles;
+}
+
+/**
+ * Evaluate a projection of a plan with joins or a sort in it, projecting each row it produces.
+ * @return  the projected rows (in the order of the Sort, if there is one under the projection)
+ */
+Tuples *EvalPlan::evaluate_rows() {
+    ColumnNames names;
+    ColumnAttributes attributes;
+    this->relation->get_columns(names, attributes);
+    ColumnOrdinals positions;
+    if (this->type == ProjectAll) {
+        for (uint i = 0; i < names.size(); i++)
+            positions.push_back(i);
+    } else {
+        for (auto const &name: *this->projection)
+            positions.push_back(find_column(names, name));
+    }
+    Tuples *ret = new Tuples();
+    try {
+        this->relation->produce([&](const Tuple &row) {
+            Tuple *projected = new Tuple();
+            projected->reserve(positions.size());
+            for (auto const &position: positions)
+                projected->push_back(row[position]);
+            ret->push_back(projected);
+        });
+    } catch (...) {
+        for (auto const &row: *ret)
+            delete row;
+        delete ret;
+        throw;
+    }
+    return ret;
+}
+
+/**
+ * Hand each of the rows of the plan, with all its columns (see get_columns), to a visitor. Tables are scanned a
+ * batch at a time (in parallel if parallel_execution is on), but the visitor is only ever called by one thread at
+ * a time. It must not hang on to the row past the call.
+ * @param visit  called with each row, in no particular order (but in order for a Sort, and a Limit over one)
+ */
+void EvalPlan::produce(ResultVisitor visit) {
+    vector<const ValueDict *> conjunctions;
+    EvalPlan *scan = scanned_table(conjunctions);
+    if (scan != nullptr) {
+        ColumnOrdinals all, positions;
+        for (uint i = 0; i < scan->table.get_column_names().size(); i++)
+            all.push_back(i);
+        mutex visit_mutex;
+        filtered_batches(scan->table, conjunctions, all, positions, [&](uint morsel, Batch &batch) {
+            Tuples rows;
+            batch.project(positions, rows);
+            try {
+                lock_guard<mutex> lock(visit_mutex);
+                for (auto const &row: rows)
+                    visit(*row);
+            } catch (...) {
+                for (auto const &row: rows)
+                    delete row;
+                throw;
+            }
+            for (auto const &row: rows)
+                delete row;
+        });
+        return;
+    }
+    if (this->type == Select) {
+        ColumnNames names;
+        ColumnAttributes attributes;
+        this->relation->get_columns(names, attributes);
+        vector<pair<uint, Value>> conditions;
+        for (auto const &condition: *this->select_conjunction)
+            conditions.push_back(make_pair(find_column(names, condition.first), condition.second));
+        this->relation->produce([&](const Tuple &row) {
+            for (auto const &condition: conditions)
+                if (!(row[condition.first] == condition.second))
+                    return;
+            visit(row);
+        });
+        return;
+    }
+    if (this->type == Join) {
+        if (this->join_method == IndexJoinMethod)
+            index_join(visit);
+        else if (this->join_method == MergeJoinMethod)
+            merge_join(visit);
+        else
+            hash_join(visit);
+        return;
+    }
+    if (this->type == Sort) {
+        sort_rows(visit);
+        return;
+    }
+    if (this->type == Limit) {
+        limit_rows(visit);
+        return;
+    }
+    throw DbRelationError("Not implemented: rows of a projection as input");
+}
+
+/**
+ * Join the two sides with a HashJoin, building on the side optimize picked and probing with the other.
+ * @param visit  called with each joined row (the left side's columns then the right side's)
+ */
+void EvalPlan::hash_join(ResultVisitor visit) {
+    ColumnNames left_names, right_names;
+    ColumnAttributes left_attributes, right_attributes;
+    this->relation->get_columns(left_names, left_attributes);
+    this->right->get_columns(right_names, right_attributes);
+    ColumnOrdinals left_ordinals, right_ordinals;
+    for (uint i = 0; i < this->left_keys->size(); i++) {
+        left_ordinals.push_back(find_column(left_names, this->left_keys->at(i)));
+        right_ordinals.push_back(find_column(right_names, this->right_keys->at(i)));
+    }
+    RowCodec::Shape left_shape, right_shape;
+    for (auto &attribute: left_attributes)
+        left_shape.push_back(attribute.get_data_type());
+    for (auto &attribute: right_attributes)
+        right_shape.push_back(attribute.get_data_type());
+
+    bool build_left = this->build_left;
+    EvalPlan *build = build_left ? this->relation : this->right;
+    EvalPlan *probe = build_left ? this->right : this->relation;
+    Tuple joined(left_names.size() + right_names.size());
+    HashJoin join(build_left ? left_shape : right_shape, build_left ? right_shape : left_shape,
+                  build_left ? left_ordinals : right_ordinals, build_left ? right_ordinals : left_ordinals,
+                  join_memory, [&](const Tuple &build_row, const Tuple &probe_row) {
+                const Tuple &left = build_left ? build_row : probe_row;
+                const Tuple &right = build_left ? probe_row : build_row;
+                copy(left.begin(), left.end(), joined.begin());
+                copy(right.begin(), right.end(), joined.begin() + left.size());
+                visit(joined);
+            });
+    build->produce([&](const Tuple &row) { join.build(row); });
+    probe->produce([&](const Tuple &row) { join.probe(row); });
+    join.finish();
+}
+
+/**
+ * Join by looking the left side's rows up in an index on the right side's table (see key_index). The left rows
+ * are gathered a batch at a time; the batch's distinct keys are looked up in key order, so the probes go through
+ * the index from one end to the other, and the right rows found are then fetched in handle order, so each block of
+ * the table is read just once for the batch. A fetched row is checked against the right side's Selects and all of
+ * the join's keys (the index may cover only some of them) before it is joined with each left row that found it.
+ * @param visit  called with each joined row (the left side's columns then the right side's)
+ */
+void EvalPlan::index_join(ResultVisitor visit) {
+    ColumnNames left_names, right_names;
+    ColumnAttributes left_attributes, right_attributes;
+    this->relation->get_columns(left_names, left_attributes);
+    this->right->get_columns(right_names, right_attributes);
+    vector<const ValueDict *> conjunctions;
+    EvalPlan *scan = this->right->scanned_table(conjunctions);
+    DbRelation &table = scan->table;
+    DbIndex &index = *this->index;
+    index.open();
+
+    const ColumnNames &key_columns = index.get_key_columns();
+    ColumnOrdinals key_positions;  // where each of the index's key columns is found in the left rows
+    for (auto const &column: key_columns) {
+        long i = find(this->right_keys->begin(), this->right_keys->end(), scan->alias + "." + column)
+                 - this->right_keys->begin();
+        key_positions.push_back(find_column(left_names, this->left_keys->at(i)));
+    }
+    vector<pair<uint, uint>> join_keys;  // position in the left rows = position in the right rows
+    for (uint i = 0; i < this->left_keys->size(); i++)
+        join_keys.push_back(make_pair(find_column(left_names, this->left_keys->at(i)),
+                                      find_column(right_names, this->right_keys->at(i))));
+    Conjunction conditions;  // the right side's Selects, by position in the right rows
+    for (auto const &conjunction: conjunctions) {
+        Conjunction *where = table.get_conjunction(conjunction);
+        conditions.insert(conditions.end(), where->begin(), where->end());
+        delete where;
+    }
+    ColumnOrdinals all;
+    for (uint i = 0; i < right_names.size(); i++)
+        all.push_back(i);
+
+    vector<Tuple> batch;
+    Tuple joined(left_names.size() + right_names.size());
+    auto probe = [&]() {
+        vector<pair<Tuple, uint>> keys;  // each left row's key (unless it has a NULL), and which row it is
+        for (uint i = 0; i < batch.size(); i++) {
+            Tuple key;
+            for (auto const &position: key_positions)
+                key.push_back(batch[i][position]);
+            if (none_of(key.begin(), key.end(), [](const Value &value) { return value.is_null(); }))
+                keys.push_back(make_pair(key, i));
+        }
+        sort(keys.begin(), keys.end());
+        vector<pair<Handle, uint>> fetches;  // each right row found, and the left row that found it
+        ValueDict key_dict;
+        for (uint i = 0, j; i < keys.size(); i = j) {
+            for (uint k = 0; k < key_columns.size(); k++)
+                key_dict[key_columns[k]] = keys[i].first[k];
+            Handles *found = index.lookup(&key_dict);
+            for (j = i; j < keys.size() && keys[j].first == keys[i].first; j++)
+                for (auto const &handle: *found)
+                    fetches.push_back(make_pair(handle, keys[j].second));
+            delete found;
+        }
+        sort(fetches.begin(), fetches.end());
+        for (uint i = 0, j; i < fetches.size(); i = j) {
+            Tuple *row = table.project(fetches[i].first, &all);
+            bool selected = true;
+            for (auto const &condition: conditions)
+                selected = selected && (*row)[condition.first] == condition.second;
+            try {
+                for (j = i; j < fetches.size() && fetches[j].first == fetches[i].first; j++) {
+                    const Tuple &left = batch[fetches[j].second];
+                    bool matched = selected;
+                    for (auto const &key: join_keys)
+                        matched = matched && left[key.first] == (*row)[key.second];
+                    if (!matched)
+                        continue;
+                    copy(left.begin(), left.end(), joined.begin());
+                    copy(row->begin(), row->end(), joined.begin() + left.size());
+                    visit(joined);
+                }
+            } catch (...) {
+                delete row;
+                throw;
+            }
+            delete row;
+        }
+        batch.clear();
+    };
+    this->relation->produce([&](const Tuple &row) {
+        batch.push_back(row);
+        if (batch.size() == Batch::BATCH_SZ)
+            probe();
+    });
+    probe();
+}
+
+/**
+ * Join by merging the two sides in order of their keys (see MergeJoin). A side picked to be read through an ordered
+ * index on its join columns comes straight from the index (with its Selects checked on each row fetched), and the
+ * other is sorted.
+ * @param visit  called with each joined row (the left side's columns then the right side's)
+ */
+void EvalPlan::merge_join(ResultVisitor visit) {
+    ColumnNames left_names, right_names;
+    ColumnAttributes left_attributes, right_attributes;
+    this->relation->get_columns(left_names, left_attributes);
+    this->right->get_columns(right_names, right_attributes);
+    ColumnOrdinals order, left_ordinals, right_ordinals;
+    index_order(order);
+    for (auto const &i: order) {
+        left_ordinals.push_back(find_column(left_names, this->left_keys->at(i)));
+        right_ordinals.push_back(find_column(right_names, this->right_keys->at(i)));
+    }
+    RowCodec::Shape right_shape;
+    for (auto &attribute: right_attributes)
+        right_shape.push_back(attribute.get_data_type());
+
+    Tuple joined(left_names.size() + right_names.size());
+    MergeJoin join(right_shape, left_ordinals, right_ordinals, join_memory,
+                   [&](const Tuple &left, const Tuple &right) {
+                       copy(left.begin(), left.end(), joined.begin());
+                       copy(right.begin(), right.end(), joined.begin() + left.size());
+                       visit(joined);
+                   });
+    OrderedRows *left = this->relation->ordered_rows(this->left_index, left_ordinals);
+    OrderedRows *right = nullptr;
+    try {
+        right = this->right->ordered_rows(this->index, right_ordinals);
+        join.join(*left, *right);
+    } catch (...) {
+        delete left;
+        delete right;
+        throw;
+    }
+    delete left;
+    delete right;
+}
+
+/**
+ * The plan's rows in order of some of their columns.
+ * @param index  an ordered index keyed on those columns, to read them through (the plan must be a chain of
+ *               Selects over a TableScan of its table), or nullptr to sort them (see sort_memory)
+ * @param keys   positions of the columns
+ * @return       the rows, to be deleted by the caller
+ */
+OrderedRows *EvalPlan::ordered_rows(DbIndex *index, const ColumnOrdinals &keys) {
+    if (index != nullptr) {
+        vector<const ValueDict *> conjunctions;
+        EvalPlan *scan = scanned_table(conjunctions);
+        Conjunction conditions;
+        for (auto const &conjunction: conjunctions) {
+            Conjunction *where = scan->table.get_conjunction(conjunction);
+            conditions.insert(conditions.end(), where->begin(), where->end());
+            delete where;
+        }
+        index->open();
+        return new IndexedRows(scan->table, *index, conditions);
+    }
+    ColumnNames names;
+    ColumnAttributes attributes;
+    get_columns(names, attributes);
+    RowCodec::Shape shape;
+    for (auto &attribute: attributes)
+        shape.push_back(attribute.get_data_type());
+    SortKeys sort_keys;
+    for (auto const &key: keys)
+        sort_keys.push_back(SortKey(key));
+    ExternalSort *rows = new ExternalSort(shape, sort_keys, sort_memory);
+    try {
+        produce([&](const Tuple &row) { rows->add(row); });
+    } catch (...) {
+        delete rows;
+        throw;
+    }
+    return rows;
+}
+
+// A Sort's columns to sort by, as positions in the rows of the plan under it, and the data types of those rows.
+void EvalPlan::sort_keys(SortKeys &keys, RowCodec::Shape &shape) {
+    ColumnNames names;
+    ColumnAttributes attributes;
+    this->relation->get_columns(names, attributes);
+    for (auto &attribute: attributes)
+        shape.push_back(attribute.get_data_type());
+    for (auto const &column: *this->order)
+        keys.push_back(SortKey(find_column(names, column.first), column.second));
+}
+
+/**
+ * Sort the rows of the plan under a Sort with an ExternalSort, which spills sorted runs to temporary files when
+ * they come to more than sort_memory.
+ * @param visit  called with each row, in order
+ */
+void EvalPlan::sort_rows(ResultVisitor visit) {
+    SortKeys keys;
+    RowCodec::Shape shape;
+    sort_keys(keys, shape);
+    ExternalSort sorter(shape, keys, sort_memory);
+    this->relation->produce([&](const Tuple &row) { sorter.add(row); });
+    Tuple row;
+    while (sorter.next(row))
+        visit(row);
+}
+
+/**
+ * Hand on just the first rows a Sort would, found with a TopN: O(log n) a row and no more than n rows in memory.
+ * @param n      how many
+ * @param visit  called with each of them, in order
+ */
+void EvalPlan::top_rows(u_long n, ResultVisitor visit) {
+    SortKeys keys;
+    RowCodec::Shape shape;
+    sort_keys(keys, shape);
+    TopN top(keys, n);
+    this->relation->produce([&](const Tuple &row) { top.add(row); });
+    Tuple row;
+    while (top.next(row))
+        visit(row);
+}
+
+// Thrown by a Limit's visitor once it has had all the rows it wants, to stop the plans under it.
+struct LimitReached {
+    const EvalPlan *limit;
+};
+
+/**
+ * Skip the Limit's offset of rows of the plan under it and hand on its limit of the ones after. Over a Sort, only
+ * the rows up to the last one wanted are sorted out (see top_rows) if there are no more than TOP_N_ROWS of them.
+ * Otherwise the plan under it is stopped as soon as the last row wanted has been handed on, by throwing out of its
+ * produce: a scan stops there, and one in parallel morsels has its morsels that haven't started yet cancelled (the
+ * ones already running throw too as soon as they hand on another row, without it being visited).
+ * @param visit  called with each row handed on
+ */
+void EvalPlan::limit_rows(ResultVisitor visit) {
+    if (this->limit == 0)
+        return;
+    u_long skipped = 0, handed = 0;
+    ResultVisitor take = [&](const Tuple &row) {
+        if (handed == this->limit)
+            throw LimitReached{this};  // from a morsel that was already running when the limit was reached
+        if (skipped < this->offset) {
+            skipped++;
+            return;
+        }
+        visit(row);
+        if (++handed == this->limit)
+            throw LimitReached{this};
+    };
+    try {
+        if (this->relation->type == Sort && this->limit != NO_LIMIT && this->offset < TOP_N_ROWS
+            && this->limit <= TOP_N_ROWS - this->offset)
+            this->relation->top_rows(this->offset + this->limit, take);
+        else
+            this->relation->produce(take);
+    } catch (const LimitReached &reached) {
+        if (reached.limit != this)
+            throw;
+    }
+}
@@ -6,37 +6,127 @@
  */
 #pragma once
 
+#include <climits>
 #include "storage_engine.h"
+#include "Batch.h"
+#include "ExternalSort.h"
 
 
 typedef std::pair<DbRelation *, Handles *> EvalPipeline;
+typedef std::function<void(const Tuple &row)> ResultVisitor;  // see EvalPlan::produce
+typedef std::vector<std::pair<Identifier, bool>> OrderBy;  // column names, each with whether it is descending
 
-class EvalPlan {
+class EvalPlan : public ArenaAllocated {
 public:
     enum PlanType {
-        ProjectAll, Project, Select, TableScan
+        ProjectAll, Project, Select, TableScan, Join, Sort, Limit
+    };
+
+    // How a Join is carried out (picked by optimize)
+    enum JoinMethod {
+        HashJoinMethod, IndexJoinMethod, MergeJoinMethod
     };
 
     EvalPlan(PlanType type, EvalPlan *relation);  // use for ProjectAll, e.g., EvalPlan(EvalPlan::ProjectAll, table);
     EvalPlan(ColumnNames *projection, EvalPlan *relation); // use for Project
     EvalPlan(ValueDict *conjunction, EvalPlan *relation);  // use for Select
-    EvalPlan(DbRelation &table);  // use for TableScan
+    EvalPlan(DbRelation &table, Identifier alias = "");  // use for TableScan; columns are alias.column in joins
+    EvalPlan(EvalPlan *left, EvalPlan *right, ColumnNames *left_keys, ColumnNames *right_keys);  // use for Join
+    EvalPlan(OrderBy *order, EvalPlan *relation);  // use for Sort
+    EvalPlan(u_long limit, u_long offset, EvalPlan *relation);  // use for Limit (NO_LIMIT for just an offset)
     EvalPlan(const EvalPlan *other);  // use for copying
     virtual ~EvalPlan();
 
     // Attempt to get the best equivalent evaluation plan
     EvalPlan *optimize();
 
-    // Evaluate the plan: evaluate gets values, pipeline gets handles
-    ValueDicts *evaluate();
+    // Evaluate the plan: evaluate gets values (in the order of the projection), pipeline gets handles
+    Tuples *evaluate();
 
     EvalPipeline pipeline();
 
+    // Let a TableScan's table be probed through one of its indices when it is the right side of a join
+    void add_index(DbIndex &index);
+
+    // The columns the plan's rows have: table.column for the tables scanned, and as named for a Project
+    void get_columns(ColumnNames &names, ColumnAttributes &attributes);
+
+    // Rough number of rows the plan produces
+    u_long estimate_rows();
+
+    // Whether evaluate and pipeline go a batch at a time when they can (on by default)
+    static bool batch_execution;
+
+    // Whether batch execution scans bigger tables in parallel morsels (on by default)
+    static bool parallel_execution;
+
+    // Bytes of rows a join may hold in memory before it spills to temporary files
+    static size_t join_memory;
+
+    // Bytes of rows a sort may hold in memory before it spills a sorted run to a temporary file
+    static size_t sort_memory;
+
+    // A Limit with no limit on the number of rows, just an offset
+    static const u_long NO_LIMIT = ULONG_MAX;
+
+    // Most rows a sort under a Limit keeps in a heap to find the first of them (more are sorted with the others)
+    static const u_long TOP_N_ROWS = 100000;
+
+    // Rows a table scan gets through in about the time it takes to look a key up in an index and fetch its row
+    // (optimize probes an index for a join when the other side has few enough rows for that to be cheaper)
+    static const u_long INDEX_PROBE_ROWS = 16;
+
 protected:
+    // Batch-at-a-time evaluation of a chain of Selects over a TableScan (other plans go a row at a time)
+    EvalPlan *scanned_table(std::vector<const ValueDict *> &conjunctions);
+
+    Tuples *evaluate_batches(DbRelation &table, const std::vector<const ValueDict *> &conjunctions);
+
+    static Handles *select_batches(DbRelation &table, const std::vector<const ValueDict *> &conjunctions);
+
+    // Row-at-a-time evaluation of plans with joins, sorts or limits in them
+    bool needs_rows() const;
+
+    void produce(ResultVisitor visit);
+
+    Tuples *evaluate_rows();
+
+    void choose_join_methods();
+
+    DbIndex *key_index(const ColumnNames &keys, bool all_keys);
+
+    bool index_order(ColumnOrdinals &order);
+
+    void hash_join(ResultVisitor visit);
+
+    void index_join(ResultVisitor visit);
+
+    void merge_join(ResultVisitor visit);
+
+    OrderedRows *ordered_rows(DbIndex *index, const ColumnOrdinals &keys);
+
+    void sort_keys(SortKeys &keys, RowCodec::Shape &shape);
+
+    void sort_rows(ResultVisitor visit);
+
+    void top_rows(u_long n, ResultVisitor visit);
+
+    void limit_rows(ResultVisitor visit);
 
     PlanType type;
-    EvalPlan *relation;  // for everything except TableScan
+    EvalPlan *relation;  // for everything except TableScan (the left side of a Join)
     ColumnNames *projection;  // for Project
     ValueDict *select_conjunction;  // for Select
+    OrderBy *order;  // for Sort
+    u_long limit, offset;  // for Limit: how many rows to hand on after skipping how many
     DbRelation &table;  // for TableScan
+    Identifier alias;  // for TableScan
+    std::vector<DbIndex *> indices;  // for TableScan: indices on the table a join may probe
+    EvalPlan *right;  // for Join
+    ColumnNames *left_keys, *right_keys;  // for Join: left_keys[i] = right_keys[i]
+    JoinMethod join_method;  // for Join
+    bool build_left;  // for a hash Join: whether the hash table is of the left side's rows
+    DbIndex *index;  // for an index Join: the index on the right side's table that is probed; for a merge Join:
+                     // the ordered index the right side is read in the order of (if it isn't sorted)
+    DbIndex *left_index;  // for a merge Join: the same for the left side
 };
\ No newline at end of file
@@ -0,0 +1,358 @@
+/**
+ * @file ExternalSort.cpp - implementation of ExternalSort and TopN
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include "ExternalSort.h"
+#include "Scheduler.h"
+
+using namespace std;
+
+void normalized_key(const Tuple &row, const SortKeys &keys, string &key) {
+    for (auto const &sort_key: keys) {
+        const Value &value = row[sort_key.column];
+        size_t start = key.size();
+        if (value.is_null()) {
+            key.push_back('\0');
+        } else if (value.data_type == ColumnAttribute::TEXT) {
+            key.push_back('\1');
+            const char *data = value.text_data();
+            for (uint32_t i = 0; i < value.text_size(); i++) {
+                key.push_back(data[i]);
+                if (data[i] == '\0')
+                    key.push_back('\xff');
+            }
+            key.append(2, '\0');
+        } else {
+            key.push_back('\1');
+            uint32_t n = (uint32_t) value.n ^ 0x80000000U;
+            for (int shift = 24; shift >= 0; shift -= 8)
+                key.push_back((char) (n >> shift));
+        }
+        if (sort_key.descending)
+            for (size_t i = start; i < key.size(); i++)
+                key[i] = (char) ~key[i];
+    }
+}
+
+/**
+ * @class RunMerge - k-way merge of sorted runs with a tree of losers
+ *
+ * Each inner node of the tree holds the run that lost the match played there, and node 0 holds the overall
+ * winner, so once the winner's run has moved on to its next row only the matches on the way from its leaf to the
+ * root are played again: log k comparisons a row. Equal keys go to the earlier run.
+ */
+class RunMerge {
+public:
+    /**
+     * @param runs  the runs (each in order of its normalized keys, and none of them read from yet)
+     * @param keys  the columns the runs are sorted by
+     */
+    RunMerge(const vector<SpillFile *> &runs, const SortKeys &keys) : keys(keys), sources(runs.size()),
+                                                                        tree(runs.size(), (uint) runs.size()) {
+        for (uint i = 0; i < runs.size(); i++) {
+            this->sources[i].file = runs[i];
+            runs[i]->rewind();
+            advance(i);
+        }
+        for (uint i = (uint) runs.size(); i > 0; i--)
+            replay(i - 1);
+    }
+
+    /**
+     * Hand out the next row of all the runs.
+     * @param row  where to put it
+     * @return     false if there are no more
+     */
+    bool next(Tuple &row) {
+        if (this->tree.empty())
+            return false;
+        uint winner = this->tree[0];
+        Source &source = this->sources[winner];
+        if (source.done)
+            return false;
+        row = source.row;  // copied, since the run's row is only good until its file is read again
+        advance(winner);
+        replay(winner);
+        return true;
+    }
+
+protected:
+    struct Source {
+        SpillFile *file;
+        Tuple row;
+        string key;
+        bool done;
+    };
+
+    SortKeys keys;
+    vector<Source> sources;
+    vector<uint> tree;  // tree[0] is the winner, tree[1..] the losers; sources.size() stands for a sure winner
+
+    void advance(uint run) {
+        Source &source = this->sources[run];
+        source.done = !source.file->read(source.row);
+        source.key.clear();
+        if (!source.done)
+            normalized_key(source.row, this->keys, source.key);
+    }
+
+    // whether run a comes out before run b
+    bool beats(uint a, uint b) const {
+        uint k = (uint) this->sources.size();
+        if (a == k || b == k)
+            return a == k;
+        const Source &first = this->sources[a], &second = this->sources[b];
+        if (first.done || second.done)
+            return !first.done;
+        int order = first.key.compare(second.key);
+        return order < 0 || (order == 0 && a < b);
+    }
+
+    // play the matches from a run's leaf up to the root
+    void replay(uint run) {
+        uint k = (uint) this->sources.size();
+        uint winner = run;
+        for (uint node = (run + k) / 2; node > 0; node /= 2)
+            if (beats(this->tree[node], winner))
+                swap(this->tree[node], winner);
+        this->tree[0] = winner;
+    }
+};
+
+ExternalSort::ExternalSort(const RowCodec::Shape &shape, const SortKeys &keys, size_t memory)
+        : shape(shape), keys(keys), memory(memory), used(0), rows(), entries(), runs(), spilled(0), sorted(false),
+          position(0), merge(nullptr) {
+}
+
+ExternalSort::~ExternalSort() {
+    delete this->merge;
+    for (auto const &run: this->runs)
+        delete run;
+}
+
+void ExternalSort::add(const Tuple &row) {
+    Entry entry;
+    normalized_key(row, this->keys, entry.key);
+    entry.row = this->rows.size();
+    this->used += row_memory(row) + sizeof(Entry) + entry.key.size();
+    this->rows.push_back(row);
+    this->entries.push_back(move(entry));
+    if (this->used > this->memory)
+        spill();
+}
+
+bool ExternalSort::next(Tuple &row) {
+    if (!this->sorted) {
+        if (this->runs.empty())
+            sort_entries();
+        else
+            start_merge();
+        this->sorted = true;
+    }
+    if (this->merge != nullptr)
+        return this->merge->next(row);
+    if (this->position == this->entries.size())
+        return false;
+    row = move(this->rows[this->entries[this->position++].row]);
+    return true;
+}
+
+/*
+ * Sort the entries on their keys (and then the order they were added). A big run is cut into a piece for each
+ * worker (at least two), the pieces are sorted as tasks on the Scheduler, and then neighboring pieces are merged
+ * pairwise, also as tasks, until there is one.
+ */
+void ExternalSort::sort_entries() {
+    auto less = [](const Entry &a, const Entry &b) {
+        int order = a.key.compare(b.key);
+        return order < 0 || (order == 0 && a.row < b.row);
+    };
+    size_t n = this->entries.size();
+    if (n < PARALLEL_SORT_MIN) {
+        sort(this->entries.begin(), this->entries.end(), less);
+        return;
+    }
+    Scheduler &scheduler = Scheduler::instance();
+    size_t pieces = max(scheduler.get_workers(), 2U);
+    vector<size_t> bounds;
+    for (size_t i = 0; i <= pieces; i++)
+        bounds.push_back(n * i / pieces);
+    auto begin = this->entries.begin();
+    TaskGroup sorting(scheduler);
+    for (size_t i = 0; i < pieces; i++)
+        sorting.run([begin, &bounds, i, less]() { sort(begin + bounds[i], begin + bounds[i + 1], less); });
+    sorting.wait();
+    for (size_t width = 1; width < pieces; width *= 2) {
+        TaskGroup merging(scheduler);
+        for (size_t i = 0; i + width < pieces; i += 2 * width) {
+            size_t low = bounds[i], middle = bounds[i + width], high = bounds[min(i + 2 * width, pieces)];
+            merging.run([begin, low, middle, high, less]() {
+                inplace_merge(begin + low, begin + middle, begin + high, less);
+            });
+        }
+        merging.wait();
+    }
+}
+
+// Write out the rows held, in order, as a run.
+void ExternalSort::spill() {
+    sort_entries();
+    SpillFile *run = new SpillFile(this->shape);
+    this->runs.push_back(run);
+    for (auto const &entry: this->entries)
+        run->write(this->rows[entry.row]);
+    this->rows.clear();
+    this->entries.clear();
+    this->used = 0;
+    this->spilled++;
+}
+
+// Spill what's left, then merge the runs in passes, each merging MAX_FAN_IN neighboring runs into one, until there
+// are few enough to merge at once, and start on those.
+void ExternalSort::start_merge() {
+    if (!this->rows.empty())
+        spill();
+    while (this->runs.size() > MAX_FAN_IN) {
+        vector<SpillFile *> merged_runs;
+        try {
+            for (size_t i = 0; i < this->runs.size(); i += MAX_FAN_IN) {
+                vector<SpillFile *> group(this->runs.begin() + i,
+                                          this->runs.begin() + min(i + MAX_FAN_IN, this->runs.size()));
+                SpillFile *merged = new SpillFile(this->shape);
+                merged_runs.push_back(merged);
+                RunMerge merge(group, this->keys);
+                Tuple row;
+                while (merge.next(row))
+                    merged->write(row);
+                for (size_t j = i; j < i + group.size(); j++) {
+                    delete this->runs[j];
+                    this->runs[j] = nullptr;
+                }
+            }
+        } catch (...) {
+            for (auto const &run: merged_runs)
+                delete run;
+            throw;
+        }
+        this->runs.swap(merged_runs);
+    }
+    this->merge = new RunMerge(this->runs, this->keys);
+}
+
+TopN::TopN(const SortKeys &keys, u_long n) : keys(keys), n(n), added(0), heap(), sorted(false), position(0), key() {
+}
+
+bool TopN::before(const Entry &a, const Entry &b) {
+    int order = a.key.compare(b.key);
+    return order < 0 || (order == 0 && a.sequence < b.sequence);
+}
+
+void TopN::add(const Tuple &row) {
+    u_long sequence = this->added++;
+    if (this->n == 0)
+        return;
+    this->key.clear();
+    normalized_key(row, this->keys, this->key);
+    if (this->heap.size() < this->n) {
+        Entry entry;
+        entry.key.swap(this->key);
+        entry.sequence = sequence;
+        entry.row = row;
+        this->heap.push_back(move(entry));
+        push_heap(this->heap.begin(), this->heap.end(), before);
+        return;
+    }
+    if (this->key.compare(this->heap.front().key) >= 0)
+        return;  // it comes after all the rows kept (a tie goes to the one added first)
+    pop_heap(this->heap.begin(), this->heap.end(), before);
+    Entry &entry = this->heap.back();
+    entry.key.swap(this->key);
+    entry.sequence = sequence;
+    entry.row = row;
+    push_heap(this->heap.begin(), this->heap.end(), before);
+}
+
+bool TopN::next(Tuple &row) {
+    if (!this->sorted) {
+        sort_heap(this->heap.begin(), this->heap.end(), before);
+        this->sorted = true;
+    }
+    if (this->position == this->heap.size())
+        return false;
+    row = move(this->heap[this->position++].row);
+    return true;
+}
+
+/**
+ * Sort rows on an INT column (with NULLs) ascending and a TEXT column (with zero bytes and prefixes of each other)
+ * descending, in memory, spilling a few runs, and spilling a run a row (so the runs are merged in more than one
+ * pass), and check each comes out in the same order as a stable sort with Value's own comparisons; and check the
+ * first few, none, and all of them the same way with TopN.
+ * @return true if the tests all succeeded
+ */
+bool test_external_sort() {
+    RowCodec::Shape shape;
+    shape.push_back(ColumnAttribute::INT);
+    shape.push_back(ColumnAttribute::TEXT);
+    shape.push_back(ColumnAttribute::INT);
+    SortKeys keys;
+    keys.push_back(SortKey(0));
+    keys.push_back(SortKey(1, true));
+    vector<Tuple> rows;
+    for (int i = 0; i < 5000; i++) {
+        Tuple row(3);
+        if (i % 11 == 0)
+            row[0].set_null(ColumnAttribute::INT);
+        else
+            row[0] = Value((i * 7919) % 97 - 48);
+        string text = string("t") + to_string(i % 13);
+        if (i % 5 == 0)
+            text += string(1, '\0') + "z";
+        if (i % 3 == 0)
+            text = text.substr(0, 1);
+        row[1].set_text(text.data(), (uint32_t) text.size());
+        row[2] = Value(i);
+        rows.push_back(row);
+    }
+    vector<Tuple> expected = rows;
+    stable_sort(expected.begin(), expected.end(), [](const Tuple &a, const Tuple &b) {
+        if (a[0] < b[0] || b[0] < a[0])
+            return a[0] < b[0];
+        return b[1] < a[1];
+    });
+    size_t budgets[] = {numeric_limits<size_t>::max(), 100000, 1};
+    for (auto const &budget: budgets) {
+        ExternalSort sort(shape, keys, budget);
+        for (auto const &row: rows)
+            sort.add(row);
+        Tuple row;
+        size_t i = 0;
+        bool ok = true;
+        while (ok && sort.next(row))
+            ok = i < expected.size() && row[2] == expected[i++][2];
+        if (!ok || i != expected.size() || (sort.get_runs() > 0) == (budget == numeric_limits<size_t>::max())) {
+            cout << "external sort failed with budget " << budget << endl;
+            return false;
+        }
+    }
+    u_long tops[] = {0, 1, 50, 4999, 5000, 6000};
+    for (auto const &n: tops) {
+        TopN top(keys, n);
+        for (auto const &row: rows)
+            top.add(row);
+        Tuple row;
+        size_t i = 0;
+        bool ok = true;
+        while (ok && top.next(row))
+            ok = i < expected.size() && row[2] == expected[i++][2];
+        if (!ok || i != min((size_t) n, expected.size())) {
+            cout << "top " << n << " failed" << endl;
+            return false;
+        }
+    }
+    cout << "external sort ok" << endl;
+    return true;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file ExternalSort.h - sorting more rows than fit in memory.
+ * OrderedRows
+ * SortKey
+ * ExternalSort
+ * TopN
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <string>
+#include "storage_engine.h"
+#include "SpillFile.h"
+
+/**
+ * @class OrderedRows - rows handed out one at a time in order of some of their columns
+ */
+class OrderedRows {
+public:
+    virtual ~OrderedRows() {}
+
+    /**
+     * Hand out the next row.
+     * @param row  where to put it
+     * @return     false if there are no more
+     */
+    virtual bool next(Tuple &row) = 0;
+};
+
+/**
+ * A column to sort by.
+ */
+struct SortKey {
+    SortKey(uint column, bool descending = false) : column(column), descending(descending) {}
+
+    uint column;  // position in the rows
+    bool descending;
+};
+typedef std::vector<SortKey> SortKeys;  // most significant first
+
+/**
+ * Append the normalized form of a row's sort key: bytes that compare (as unsigned, with memcmp) the way the rows
+ * are to be ordered, so the rows can be sorted on the bytes alone. Each column's value comes as a byte that puts
+ * NULLs first, then an INT or BOOLEAN as four big-endian bytes with the sign bit flipped, or TEXT with any zero
+ * bytes escaped and two zero bytes after it (so a shorter text comes before a longer one it starts). A
+ * descending column has its bytes inverted.
+ * @param row   the row
+ * @param keys  the columns to sort by
+ * @param key   where to append the bytes
+ */
+void normalized_key(const Tuple &row, const SortKeys &keys, std::string &key);
+
+class RunMerge;
+
+/**
+ * @class ExternalSort - sort that spills to temporary files to stay within a memory budget
+ *
+ * Rows are added and then handed out in order (rows with the same key in the order they were added). Each row is
+ * held with its normalized key (see normalized_key), and when the rows held come to more than the budget they are
+ * sorted on their keys and written out as a run to a SpillFile. Once all the rows have been added, the runs are
+ * merged with a tree of losers, MAX_FAN_IN at a time (in more than one pass if there are more runs than that).
+ * If no run was spilled the rows are just handed out from memory. A big run is sorted in pieces on the Scheduler's
+ * workers and the pieces merged in parallel too.
+ */
+class ExternalSort : public OrderedRows {
+public:
+    /**
+     * @param shape   data type of each of the rows' columns
+     * @param keys    the columns to sort by
+     * @param memory  bytes of rows to hold before spilling a run
+     */
+    ExternalSort(const RowCodec::Shape &shape, const SortKeys &keys, size_t memory = DEFAULT_MEMORY);
+
+    virtual ~ExternalSort();
+
+    ExternalSort(const ExternalSort &other) = delete;
+
+    ExternalSort &operator=(const ExternalSort &other) = delete;
+
+    /**
+     * Add a row (all of them must come before the first call to next).
+     * @throws DbRelationError if a run can't be spilled
+     */
+    virtual void add(const Tuple &row);
+
+    virtual bool next(Tuple &row);
+
+    /**
+     * Number of runs spilled so far.
+     */
+    virtual u_long get_runs() const { return this->spilled; }
+
+    static const size_t DEFAULT_MEMORY = 64 * 1024 * 1024;
+    static const uint MAX_FAN_IN = 64;  // runs merged at once (each has a SpillFile open, with its buffer)
+    static const size_t PARALLEL_SORT_MIN = 4096;  // rows in a run before it is sorted in pieces
+
+protected:
+    struct Entry {
+        std::string key;
+        size_t row;  // position in rows
+    };
+
+    RowCodec::Shape shape;
+    SortKeys keys;
+    size_t memory;
+    size_t used;  // bytes of rows (and keys) held
+    std::vector<Tuple> rows;
+    std::vector<Entry> entries;
+    std::vector<SpillFile *> runs;
+    u_long spilled;
+    bool sorted;
+    size_t position;  // next entry to hand out, when there were no runs
+    RunMerge *merge;  // of the runs, once handing out has started
+
+    virtual void sort_entries();
+
+    virtual void spill();
+
+    virtual void start_merge();
+};
+
+/**
+ * @class TopN - the first n rows in order, kept in a bounded heap
+ *
+ * Rows are added and then the first n of them in order are handed out, as ExternalSort would have handed them out.
+ * The heap holds no more than the n rows found first so far, with the last of them on top, and a row added is only
+ * kept (in place of the top) if it comes before that one: O(log n) a row kept, and no more than n rows in memory.
+ */
+class TopN : public OrderedRows {
+public:
+    /**
+     * @param keys  the columns to sort by
+     * @param n     how many rows to hand out
+     */
+    TopN(const SortKeys &keys, u_long n);
+
+    virtual ~TopN() {}
+
+    /**
+     * Add a row (all of them must come before the first call to next).
+     */
+    virtual void add(const Tuple &row);
+
+    virtual bool next(Tuple &row);
+
+protected:
+    struct Entry {
+        std::string key;
+        u_long sequence;  // when it was added, so that rows with the same key keep that order
+        Tuple row;
+    };
+
+    SortKeys keys;
+    u_long n;
+    u_long added;
+    std::vector<Entry> heap;
+    bool sorted;
+    size_t position;  // next entry to hand out
+    std::string key;  // of the row being added
+
+    static bool before(const Entry &a, const Entry &b);
+};
+
+bool test_external_sort();
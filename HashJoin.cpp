@@ -0,0 +1,188 @@
+/**
+ * @file HashJoin.cpp - implementation of HashJoin
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <iostream>
+#include <limits>
+#include "HashJoin.h"
+
+using namespace std;
+
+static bool null_key(const Tuple &row, const ColumnOrdinals &keys) {
+    for (auto const &key: keys)
+        if (row[key].is_null())
+            return true;
+    return false;
+}
+
+HashJoin::HashJoin(const RowCodec::Shape &build_shape, const RowCodec::Shape &probe_shape,
+                   const ColumnOrdinals &build_keys, const ColumnOrdinals &probe_keys, size_t memory,
+                   MatchVisitor visit, uint level) : build_shape(build_shape), probe_shape(probe_shape),
+                                                     build_keys(build_keys), probe_keys(probe_keys), memory(memory),
+                                                     visit(visit), level(level), used(0), table(), build_files(),
+                                                     probe_files() {
+}
+
+HashJoin::~HashJoin() {
+    for (auto const &entry: this->table)
+        delete entry.second;
+    for (auto const &file: this->build_files)
+        delete file;
+    for (auto const &file: this->probe_files)
+        delete file;
+}
+
+void HashJoin::build(const Tuple &row) {
+    if (null_key(row, this->build_keys))
+        return;
+    size_t h = hash(row, this->build_keys);
+    if (is_spilled()) {
+        this->build_files[h % PARTITIONS]->write(row);
+        return;
+    }
+    this->table.insert(make_pair(h, new Tuple(row)));
+    this->used += row_memory(row);
+    if (this->used > this->memory && this->level < MAX_LEVEL)
+        spill();
+}
+
+void HashJoin::probe(const Tuple &row) {
+    if (null_key(row, this->probe_keys))
+        return;
+    size_t h = hash(row, this->probe_keys);
+    if (is_spilled()) {
+        this->probe_files[h % PARTITIONS]->write(row);
+        return;
+    }
+    auto found = this->table.equal_range(h);
+    for (auto entry = found.first; entry != found.second; entry++)
+        if (matches(*entry->second, row))
+            this->visit(*entry->second, row);
+}
+
+void HashJoin::finish() {
+    if (!is_spilled())
+        return;
+    Tuple row;
+    for (uint p = 0; p < PARTITIONS; p++) {
+        SpillFile *build_file = this->build_files[p], *probe_file = this->probe_files[p];
+        if (build_file->size() > 0 && probe_file->size() > 0) {
+            HashJoin partition(this->build_shape, this->probe_shape, this->build_keys, this->probe_keys, this->memory,
+                               this->visit, this->level + 1);
+            build_file->rewind();
+            while (build_file->read(row))
+                partition.build(row);
+            probe_file->rewind();
+            while (probe_file->read(row))
+                partition.probe(row);
+            partition.finish();
+        }
+        delete build_file;
+        delete probe_file;
+        this->build_files[p] = this->probe_files[p] = nullptr;
+    }
+    this->build_files.clear();
+    this->probe_files.clear();
+}
+
+// Write the table out to the partitions; from here on every row goes straight to its partition.
+void HashJoin::spill() {
+    for (uint p = 0; p < PARTITIONS; p++) {
+        this->build_files.push_back(new SpillFile(this->build_shape));
+        this->probe_files.push_back(new SpillFile(this->probe_shape));
+    }
+    for (auto const &entry: this->table) {
+        this->build_files[entry.first % PARTITIONS]->write(*entry.second);
+        delete entry.second;
+    }
+    this->table.clear();
+    this->used = 0;
+}
+
+/*
+ * FNV-1a over the key values, with the level folded into the starting point so each round of partitioning splits
+ * the rows differently, and then mixed so the low bits (which pick the partition and bucket) depend on all of it.
+ */
+size_t HashJoin::hash(const Tuple &row, const ColumnOrdinals &keys) const {
+    uint64_t h = 0xcbf29ce484222325ULL ^ (this->level * 0x9e3779b97f4a7c15ULL);
+    for (auto const &key: keys) {
+        const Value &value = row[key];
+        const char *bytes = (const char *) &value.n;
+        u_int32_t size = sizeof(value.n);
+        if (value.data_type == ColumnAttribute::TEXT) {
+            bytes = value.text_data();
+            size = value.text_size();
+        }
+        for (u_int32_t i = 0; i < size; i++)
+            h = (h ^ (uint8_t) bytes[i]) * 0x100000001b3ULL;
+        h = (h ^ 0xff) * 0x100000001b3ULL;  // so ("ab", "c") and ("a", "bc") differ
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t) h;
+}
+
+bool HashJoin::matches(const Tuple &build_row, const Tuple &probe_row) const {
+    for (uint i = 0; i < this->build_keys.size(); i++)
+        if (!(build_row[this->build_keys[i]] == probe_row[this->probe_keys[i]]))
+            return false;
+    return true;
+}
+
+/**
+ * Join rows with a key that repeats (and some NULL keys) both in memory and with a budget small enough to spill,
+ * and with a budget so small every key is too big for it, and check each finds every matching pair just once.
+ * @return true if the tests all succeeded
+ */
+bool test_hash_join() {
+    RowCodec::Shape build_shape, probe_shape;
+    build_shape.push_back(ColumnAttribute::INT);
+    build_shape.push_back(ColumnAttribute::TEXT);
+    probe_shape.push_back(ColumnAttribute::TEXT);
+    probe_shape.push_back(ColumnAttribute::INT);
+    ColumnOrdinals build_keys(1, 0), probe_keys(1, 1);
+    size_t budgets[] = {numeric_limits<size_t>::max(), 10000, 1};
+    for (auto const &budget: budgets) {
+        u_long matches = 0, sum = 0;
+        bool ok = true;
+        HashJoin join(build_shape, probe_shape, build_keys, probe_keys, budget,
+                      [&](const Tuple &build_row, const Tuple &probe_row) {
+                          matches++;
+                          sum += (u_long) build_row[0].n;
+                          ok = ok && build_row[0] == probe_row[1]
+                               && build_row[1].s() == "build " + to_string(build_row[0].n);
+                      });
+        Tuple row(2);
+        for (int i = 0; i < 1000; i++) {
+            row[0] = Value(i % 500);  // each key twice
+            row[1] = Value("build " + to_string(i % 500));
+            join.build(row);
+        }
+        row[0].set_null(ColumnAttribute::INT);
+        join.build(row);
+        for (int i = 0; i < 3000; i++) {
+            row[0] = Value("probe " + to_string(i));
+            if (i % 7 == 0)
+                row[1].set_null(ColumnAttribute::INT);
+            else
+                row[1] = Value(i);  // matches for 0..499 only
+            join.probe(row);
+        }
+        bool spilled = join.is_spilled();
+        join.finish();
+        u_long expected_matches = 0, expected_sum = 0;
+        for (int i = 1; i < 500; i++)
+            if (i % 7 != 0) {
+                expected_matches += 2;
+                expected_sum += 2 * (u_long) i;
+            }
+        if (!ok || matches != expected_matches || sum != expected_sum
+            || spilled == (budget == numeric_limits<size_t>::max())) {
+            cout << "hash join failed with budget " << budget << endl;
+            return false;
+        }
+    }
+    cout << "hash join ok" << endl;
+    return true;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file HashJoin.h - equi-join of two streams of rows by hashing one of them.
+ * HashJoin
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include "storage_engine.h"
+#include "SpillFile.h"
+
+typedef std::function<void(const Tuple &build_row, const Tuple &probe_row)> MatchVisitor;  // see HashJoin
+
+/**
+ * @class HashJoin - in-memory hash join that falls back to Grace partitioning
+ *
+ * The rows of the build side (usually the smaller input) are put in a hash table on their key columns, then each
+ * row of the probe side is looked up in it. A row with a NULL in any key column matches nothing.
+ * If the build rows come to more than the memory budget, every build row (those in the table and those still to
+ * come) is instead written out to one of PARTITIONS spill files by its hash, and so is every probe row; finish then
+ * joins each pair of partitions on its own with a fresh HashJoin, which hashes with another seed and so splits a
+ * partition that is still too big. After MAX_LEVEL rounds of that (a run of one key too big for memory) a
+ * partition is just joined in memory.
+ */
+class HashJoin {
+public:
+    /**
+     * @param build_shape  data type of each of the build side's columns
+     * @param probe_shape  data type of each of the probe side's columns
+     * @param build_keys   positions of the key columns in the build rows
+     * @param probe_keys   positions of the key columns in the probe rows (matching build_keys one for one)
+     * @param memory       bytes of build rows to hold before spilling
+     * @param visit        called with each pair of matching rows
+     * @param level        how many times the rows have been partitioned already
+     */
+    HashJoin(const RowCodec::Shape &build_shape, const RowCodec::Shape &probe_shape, const ColumnOrdinals &build_keys,
+             const ColumnOrdinals &probe_keys, size_t memory, MatchVisitor visit, uint level = 0);
+
+    virtual ~HashJoin();
+
+    HashJoin(const HashJoin &other) = delete;
+
+    HashJoin &operator=(const HashJoin &other) = delete;
+
+    /**
+     * Add a row of the build side (all of them must come before the first probe).
+     */
+    virtual void build(const Tuple &row);
+
+    /**
+     * Look up a row of the probe side (or put it aside for finish, once the build side has spilled).
+     */
+    virtual void probe(const Tuple &row);
+
+    /**
+     * After the last probe, join the partitions that were spilled (if any).
+     */
+    virtual void finish();
+
+    virtual bool is_spilled() const { return !this->build_files.empty(); }
+
+    static const uint PARTITIONS = 16;
+    static const uint MAX_LEVEL = 3;
+
+protected:
+    RowCodec::Shape build_shape, probe_shape;
+    ColumnOrdinals build_keys, probe_keys;
+    size_t memory;
+    MatchVisitor visit;
+    uint level;
+    size_t used;  // bytes of build rows in the table
+    std::unordered_multimap<size_t, Tuple *> table;  // keyed by the hash of the key columns
+    std::vector<SpillFile *> build_files, probe_files;  // a partition each, once spilled
+
+    virtual size_t hash(const Tuple &row, const ColumnOrdinals &keys) const;
+
+    virtual bool matches(const Tuple &build_row, const Tuple &probe_row) const;
+
+    virtual void spill();
+};
+
+bool test_hash_join();
@@ -6,24 +6,40 @@
 #include <cstring>
 #include "db_cxx.h"
 #include "HeapFile.h"
+#include "Scheduler.h"
 
 using namespace std;
 typedef uint16_t u16;
 
+std::set<HeapFile *> HeapFile::stale_headers;
+
 /**
  * Constructor
  * @param name
  */
-HeapFile::HeapFile(string name) : DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0) {
+HeapFile::HeapFile(string name) : DbFile(name), dbfilename(""), last(0), allocated(0), closed(true),
+                                  prefetch_window(PREFETCH_WINDOW), db(nullptr) {
     this->dbfilename = this->name + ".db";
 }
 
+/**
+ * Destructor - close the file if it is still open.
+ */
+HeapFile::~HeapFile() {
+    try {
+        close();
+    } catch (DbException &) {
+        // nothing more we can do about it here
+    }
+    stale_headers.erase(this);
+}
+
 /**
  * Create physical file.
  */
 void HeapFile::create(void) {
     db_open(DB_CREATE | DB_EXCL);
-    SlottedPage *page = get_new(); // force one page to exist
+    SlottedPage *page = get_new(); // force one page to exist (which writes the header, too)
     delete page;
 }
 
@@ -47,28 +63,37 @@ void HeapFile::open(void) {
  * Close the physical file.
  */
 void HeapFile::close(void) {
-    this->db.close(0);
+    if (this->closed)
+        return;
+    if (stale_headers.count(this))
+        put_last();
     this->closed = true;
+    Db *db = this->db;
+    this->db = nullptr;
+    db->close(0);  // a Berkeley DB handle cannot be used again once closed, even if close fails
+    delete db;
 }
 
 /**
  * Allocate a new block for the database file.
+ * The block is already out in the file as an empty page (see preallocate), so all we do here is count it and lay
+ * down a fresh page in our own buffer for the caller to fill and put. The header is only written along with a new
+ * extent; otherwise it waits for the next checkpoint, sync or close. As with get, the page is only good until the
+ * next call to get_new.
  * @return the new empty DbBlock that is managing the records in this block and its block id.
  */
 SlottedPage *HeapFile::get_new(void) {
-    char block[DbBlock::BLOCK_SZ];
-    memset(block, 0, sizeof(block));
-    Dbt data(block, sizeof(block));
-
-    int block_id = ++this->last;
-    Dbt key(&block_id, sizeof(block_id));
-
-    // write out an empty block and read it back in so Berkeley DB is managing the memory
-    SlottedPage *page = new SlottedPage(data, this->last, true);
-    this->db.put(nullptr, &key, &data, 0); // write it out with initialization done to it
-    delete page;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, this->last);
+    bool grown = this->last == this->allocated;
+    if (grown)
+        preallocate();
+    this->last++;
+    if (grown)
+        put_last();
+    else
+        stale_headers.insert(this);
+    memset(this->new_block, 0, sizeof(this->new_block));
+    Dbt data(this->new_block, sizeof(this->new_block));
+    return new SlottedPage(data, this->last, true);
 }
 
 /**
@@ -77,9 +102,16 @@ SlottedPage *HeapFile::get_new(void) {
  * @return          the given slotted page (freed by caller)
  */
 SlottedPage *HeapFile::get(BlockID block_id) {
-    Dbt key(&block_id, sizeof(block_id));
-    Dbt data;
-    this->db.get(nullptr, &key, &data, 0);
+    return get(block_id, this->got_block);
+}
+
+SlottedPage *HeapFile::get(BlockID block_id, char *buffer) {
+    db_recno_t recno = block_id + 1;
+    Dbt key(&recno, sizeof(recno));
+    Dbt data(buffer, DbBlock::BLOCK_SZ);
+    data.set_ulen(DbBlock::BLOCK_SZ);
+    data.set_flags(DB_DBT_USERMEM);
+    this->db->get(nullptr, &key, &data, 0);
     return new SlottedPage(data, block_id, false);
 }
 
@@ -88,9 +120,9 @@ SlottedPage *HeapFile::get(BlockID block_id) {
  * @param block
  */
 void HeapFile::put(DbBlock *block) {
-    int block_id = block->get_block_id();
-    Dbt key(&block_id, sizeof(block_id));
-    this->db.put(nullptr, &key, block->get_block(), 0);
+    db_recno_t recno = block->get_block_id() + 1;
+    Dbt key(&recno, sizeof(recno));
+    this->db->put(nullptr, &key, block->get_block(), 0);
 }
 
 /**
@@ -105,15 +137,207 @@ BlockIDs *HeapFile::block_ids() const {
 }
 
 /**
- * Ask BerkDb how many blocks we are currently using in the file.
+ * Read the whole file front to back (see the ranged scan).
+ * @param visit  called with each block
+ */
+void HeapFile::scan(BlockVisitor visit) {
+    scan(1, this->last, visit);
+}
+
+/**
+ * Read the blocks with a DB_MULTIPLE_KEY cursor, so each call into Berkeley DB fills our buffer with as many of
+ * them as will fit (but no more than BULK_BLOCKS, or than the range needs). Meanwhile, tasks on the scheduler keep
+ * the prefetch window of blocks past the ones the cursor has fetched being read into Berkeley DB's cache, so the
+ * cursor finds them there. A run the cursor fetches in one go, such as a morsel, isn't worth it.
+ */
+void HeapFile::scan(BlockID first, BlockID last, BlockVisitor visit) {
+    if (first > last)
+        return;
+    uint blocks = last - first + 1 < BULK_BLOCKS ? last - first + 1 : BULK_BLOCKS;
+    uint window = last - first + 1 > blocks ? this->prefetch_window : 0;
+    BlockID prefetched = first + blocks;  // blocks before this one have been asked for already
+    TaskGroup prefetching(Scheduler::instance());  // waited for when it goes, so before the scan returns
+    u_int32_t buffer_size = (blocks + 1) * DbBlock::BLOCK_SZ;  // extra block is room for the bulk bookkeeping
+    char *buffer = new char[buffer_size];
+    db_recno_t recno = first + 1;
+    Dbt key(&recno, sizeof(recno));
+    key.set_ulen(sizeof(recno));
+    key.set_flags(DB_DBT_USERMEM);
+    Dbt data(buffer, buffer_size);
+    data.set_ulen(buffer_size);
+    data.set_flags(DB_DBT_USERMEM);
+    Dbc *cursor;
+    this->db->cursor(nullptr, &cursor, 0);
+    try {
+        u_int32_t position = DB_SET;
+        bool done = false;
+        while (!done && cursor->get(&key, &data, DB_MULTIPLE_KEY | position) == 0) {
+            position = DB_NEXT;
+            DbMultipleRecnoDataIterator iterator(data);
+            Dbt block;
+            while (iterator.next(recno, block)) {
+                BlockID block_id = recno - 1;
+                if (block_id > last) {
+                    done = true;
+                    break;
+                }
+                if (window > 0 && block_id + window / 2 >= prefetched && prefetched <= last) {
+                    // keep at least half a window of reads in flight ahead of us
+                    uint count = last - prefetched + 1 < window ? last - prefetched + 1 : window;
+                    BlockID from = prefetched;
+                    prefetching.run([this, from, count]() { prefetch(from, count); });
+                    prefetched += window;
+                }
+                SlottedPage page(block, block_id, false);
+                visit(&page);
+            }
+        }
+    } catch (...) {
+        prefetching.cancel();
+        cursor->close();
+        delete[] buffer;
+        throw;
+    }
+    cursor->close();
+    delete[] buffer;
+}
+
+// A filtered scan switches to looking blocks up one at a time once fewer than one in SPARSE_SCAN are wanted.
+static const uint SPARSE_SCAN = 4;
+
+void HeapFile::scan(BlockVisitor visit, BlockFilter wanted) {
+    BlockIDs block_ids;
+    for (BlockID block_id = 1; block_id <= this->last; block_id++)
+        if (wanted(block_id))
+            block_ids.push_back(block_id);
+    if (block_ids.size() * SPARSE_SCAN >= this->last) {
+        scan([&](SlottedPage *page) {
+            if (wanted(page->get_block_id()))
+                visit(page);
+        });
+        return;
+    }
+    char *buffer = new char[DbBlock::BLOCK_SZ];
+    try {
+        for (auto const &block_id: block_ids) {
+            delete get(block_id, buffer);  // into a buffer of our own, as the visitor may use get's
+            Dbt block(buffer, DbBlock::BLOCK_SZ);
+            SlottedPage page(block, block_id, false);
+            visit(&page);
+        }
+    } catch (...) {
+        delete[] buffer;
+        throw;
+    }
+    delete[] buffer;
+}
+
+/**
+ * Flush Berkeley DB's cached blocks for this file out to disk.
+ */
+void HeapFile::sync(void) {
+    if (this->closed)
+        return;
+    if (stale_headers.count(this))
+        put_last();
+    this->db->sync(0);
+}
+
+// Write the headers that have fallen behind.
+void HeapFile::checkpoint() {
+    while (!stale_headers.empty())
+        (*stale_headers.begin())->put_last();  // which takes it out of the set
+}
+
+/**
+ * Berkeley DB decides where a block lives within its file, so there's no asking the kernel for the blocks'
+ * pages. Instead each block is read (into a buffer of our own, as for a ranged scan) and so left in Berkeley DB's
+ * cache. As this waits for the reads, it's meant to be run as a task alongside the reader it is for.
+ * @param block_id  first block of the run
+ * @param count     number of blocks in the run
+ */
+void HeapFile::prefetch(BlockID block_id, uint count) {
+    char buffer[DbBlock::BLOCK_SZ];
+    for (BlockID id = block_id; id < block_id + count && id <= this->last && !this->closed; id++) {
+        db_recno_t recno = id + 1;
+        Dbt key(&recno, sizeof(recno));
+        Dbt data(buffer, sizeof(buffer));
+        data.set_ulen(sizeof(buffer));
+        data.set_flags(DB_DBT_USERMEM);
+        this->db->get(nullptr, &key, &data, 0);
+    }
+}
+
+/**
+ * Grow the file by EXTENT empty blocks with a single bulk put.
+ */
+void HeapFile::preallocate() {
+    char block[DbBlock::BLOCK_SZ];
+    memset(block, 0, sizeof(block));
+    Dbt data(block, sizeof(block));
+    SlottedPage empty(data, 0, true);  // lays down the header of an empty page in block
+
+    u_int32_t buffer_size = (EXTENT + 1) * DbBlock::BLOCK_SZ;  // extra block is room for the bulk bookkeeping
+    char *buffer = new char[buffer_size];
+    Dbt blocks(buffer, buffer_size);
+    blocks.set_ulen(buffer_size);
+    blocks.set_flags(DB_DBT_USERMEM);
+    DbMultipleRecnoDataBuilder builder(blocks);
+    for (db_recno_t recno = this->allocated + 2; recno <= this->allocated + EXTENT + 1; recno++)
+        builder.append(recno, block, sizeof(block));
+    Dbt ignored;
+    this->db->put(nullptr, &blocks, &ignored, DB_MULTIPLE_KEY);
+    delete[] buffer;
+    this->allocated += EXTENT;
+}
+
+/**
+ * Ask BerkDb how many blocks there are in the file, in use or not (not counting the header).
  * @return number of blocks
  */
 uint32_t HeapFile::get_block_count() {
     DB_BTREE_STAT *stat;
-    this->db.stat(nullptr, &stat, DB_FAST_STAT);
+    this->db->stat(nullptr, &stat, DB_FAST_STAT);
     uint32_t bt_ndata = stat->bt_ndata;
     free(stat);
-    return bt_ndata;
+    return bt_ndata > 0 ? bt_ndata - 1 : 0;
+}
+
+/**
+ * Write the number of blocks in use to the header, record 1 of the RecNo file.
+ */
+void HeapFile::put_last() {
+    db_recno_t recno = 1;
+    Dbt key(&recno, sizeof(recno));
+    char header[3 * sizeof(uint32_t)];
+    write_header(header);
+    Dbt data(header, sizeof(header));  // padded out to a block by Berkeley DB
+    this->db->put(nullptr, &key, &data, 0);
+    stale_headers.erase(this);
+}
+
+/**
+ * Lay out the header: HEADER_MAGIC, FORMAT_VERSION and then the number of blocks in use.
+ * @param header  where to put it (three words)
+ */
+void HeapFile::write_header(char *header) const {
+    uint32_t words[] = {HEADER_MAGIC, FORMAT_VERSION, this->last};
+    memcpy(header, words, sizeof(words));
+}
+
+/**
+ * Check that a header is one of ours and of this version.
+ * @param header  the header as read from the file
+ * @return        the number of blocks in use
+ */
+uint32_t HeapFile::read_header(const char *header) const {
+    uint32_t words[3];
+    memcpy(words, header, sizeof(words));
+    if (words[0] != HEADER_MAGIC || words[1] != FORMAT_VERSION)
+        throw DbRelationError(this->dbfilename + " was written by another version of the database (format "
+                              + (words[0] == HEADER_MAGIC ? to_string(words[1]) : string("unknown")) + ", expected "
+                              + to_string(FORMAT_VERSION) + ") and has to be created again");
+    return words[2];
 }
 
 /**
@@ -123,9 +347,36 @@ uint32_t HeapFile::get_block_count() {
 void HeapFile::db_open(uint flags) {
     if (!this->closed)
         return;
-    this->db.set_re_len(DbBlock::BLOCK_SZ); // record length - will be ignored if file already exists
-    this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags, 0644);
+    this->db = new Db(_DB_ENV, 0);
+    try {
+        this->db->set_re_len(DbBlock::BLOCK_SZ); // record length - will be ignored if file already exists
+        this->db->open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags | DB_THREAD, 0644);
+    } catch (DbException &) {
+        this->db->close(0);  // even a handle that failed to open has to be closed
+        delete this->db;
+        this->db = nullptr;
+        throw;
+    }
 
-    this->last = flags ? 0 : get_block_count();
     this->closed = false;
+    if (flags) {
+        this->allocated = this->last = 0;
+        return;
+    }
+    this->allocated = get_block_count();
+
+    // the blocks past the last one in use are preallocated ones nobody has used yet (see put_last)
+    db_recno_t recno = 1;
+    Dbt key(&recno, sizeof(recno));
+    Dbt data(this->got_block, sizeof(this->got_block));
+    data.set_ulen(sizeof(this->got_block));
+    data.set_flags(DB_DBT_USERMEM);
+    memset(this->got_block, 0, sizeof(this->got_block));
+    this->db->get(nullptr, &key, &data, 0);
+    try {
+        this->last = read_header(this->got_block);
+    } catch (DbRelationError &) {
+        close();
+        throw;
+    }
 }
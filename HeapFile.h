@@ -7,9 +7,14 @@
  */
 #pragma once
 
+#include <functional>
+#include <set>
 #include "db_cxx.h"
 #include "SlottedPage.h"
 
+typedef std::function<void(SlottedPage *)> BlockVisitor;  // see HeapFile::scan
+typedef std::function<bool(BlockID)> BlockFilter;  // see HeapFile::scan
+
 
 /**
  * @class HeapFile - heap file implementation of DbFile
@@ -18,12 +23,21 @@
         database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
         for buffer management and file management.
         Uses SlottedPage for storing records within blocks.
+        The file is grown EXTENT empty blocks at a time, so there may be unused blocks past the last one; the
+        number of blocks in use is kept in a header, the RecNo file's first record, so block n is record n + 1.
+        The header starts with HEADER_MAGIC and FORMAT_VERSION, so a file laid out by some other version of the
+        code is refused when it is opened rather than misread. The header is written when the file grows, at a
+        checkpoint (see HeapFile::checkpoint), and when the file is synced or closed, rather than for every new
+        block.
+        The environment and our handle are opened with DB_THREAD, so every block Berkeley DB hands back is copied
+        into memory we supply. get and scan use buffers of the file's own; the versions that take a range or a
+        buffer use their own cursor or the caller's buffer, so several threads can read the file at once.
  */
 class HeapFile : public DbFile {
 public:
     HeapFile(std::string name);
 
-    virtual ~HeapFile() {}
+    virtual ~HeapFile();
 
     HeapFile(const HeapFile &other) = delete;
 
@@ -45,10 +59,94 @@ public:
 
     virtual SlottedPage *get(BlockID block_id);
 
+    /**
+     * Read a copy of a block into the caller's buffer. Unlike get, this may be called by several threads at once.
+     * @param block_id  the block
+     * @param buffer    BLOCK_SZ bytes to read it into
+     * @return          the page, in buffer (freed by caller)
+     */
+    virtual SlottedPage *get(BlockID block_id, char *buffer);
+
     virtual void put(DbBlock *block);
 
     virtual BlockIDs *block_ids() const;
 
+    /**
+     * Visit every block in the file, in order. Blocks are pulled through a Berkeley DB cursor in bulk
+     * (BULK_BLOCKS at a time) rather than with a lookup per block.
+     * The page passed to visit is only good for the duration of the call and the visitor must not
+     * add blocks to the file.
+     * @param visit  called with each block
+     */
+    virtual void scan(BlockVisitor visit);
+
+    /**
+     * Visit just the blocks that pass a filter, in order. If they are only a few of the file's blocks, each
+     * is looked up by itself (and copied, so the visitor may get other blocks meanwhile); otherwise the whole
+     * file is scanned in bulk and the rest passed over.
+     * @param visit   called with each wanted block
+     * @param wanted  whether a block is wanted
+     */
+    virtual void scan(BlockVisitor visit, BlockFilter wanted);
+
+    /**
+     * Visit the blocks from first through last, in order, with a cursor and buffer of the scan's own, so several
+     * threads may each scan a run of the file at once (as long as nobody is writing to it).
+     * @param first  first block to visit
+     * @param last   last block to visit
+     * @param visit  called with each block
+     */
+    virtual void scan(BlockID first, BlockID last, BlockVisitor visit);
+
+    /**
+     * Number of blocks the bulk-read buffer used by scan holds.
+     */
+    static const uint BULK_BLOCKS = 64;
+
+    /**
+     * Number of blocks added to the file each time it has to grow.
+     */
+    static const uint EXTENT = 64;
+
+    /**
+     * First word of the header of every heap file ("HEAP").
+     */
+    static const uint32_t HEADER_MAGIC = 0x48454150;
+
+    /**
+     * Layout of the file and of the rows in it, bumped whenever either changes (2: rows as a null bitmap,
+     * fixed-width slots and a TEXT offset table).
+     */
+    static const uint32_t FORMAT_VERSION = 2;
+
+    /**
+     * Flush any blocks that have been put out to disk.
+     */
+    virtual void sync(void);
+
+    /**
+     * Write the header of every open file that has gained blocks since its header was last written.
+     */
+    static void checkpoint();
+
+    /**
+     * Get the given run of blocks on their way into memory ahead of a reader that is about to need them (such
+     * as a scan or a walk along a B-tree's leaves). Like the ranged scan, this may be called from another thread
+     * while the file is being read, but not while it's being written.
+     * @param block_id  first block of the run
+     * @param count     number of blocks in the run
+     */
+    virtual void prefetch(BlockID block_id, uint count);
+
+    /**
+     * Default number of blocks a sequential scan asks to have in flight ahead of it.
+     */
+    static const uint PREFETCH_WINDOW = 32;
+
+    virtual uint get_prefetch_window() const { return prefetch_window; }
+
+    virtual void set_prefetch_window(uint blocks) { this->prefetch_window = blocks; }
+
     /**
      * Get the id of the current final block in the heap file.
      * @return block id of last block
@@ -58,11 +156,25 @@ public:
 protected:
     std::string dbfilename;
     uint32_t last;
+    uint32_t allocated;
     bool closed;
-    Db db;
+    uint prefetch_window;
+    Db *db;  // a fresh handle for each open, since Berkeley DB handles cannot be reopened
+    char new_block[DbBlock::BLOCK_SZ];
+    char got_block[DbBlock::BLOCK_SZ];  // where get puts the block it reads
+
+    static std::set<HeapFile *> stale_headers;  // files whose header is behind their last block in use
 
     virtual void db_open(uint flags = 0);
 
+    virtual void preallocate();
+
     virtual uint32_t get_block_count();
+
+    virtual void put_last();
+
+    virtual void write_header(char *header) const;
+
+    virtual uint32_t read_header(const char *header) const;
 };
 
@@ -10,16 +10,29 @@
 #include "storage_engine.h"
 #include "SlottedPage.h"
 #include "HeapFile.h"
+#include "MmapFile.h"
+#include "CsvCodec.h"
+#include "RowCodec.h"
+#include "Batch.h"
+#include "ZoneMap.h"
+#include "Scheduler.h"
 
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ * The blocks are kept either in a Berkeley DB RecNo file (storage engine "HEAP", the default)
+ * or in a memory-mapped file (storage engine "MMAP").
+ * Either way a ZoneMap of each block's column ranges (and Bloom filters of some columns' values) is kept
+ * alongside, so a scan with a where clause can skip the blocks that can't hold a match.
+ * Bigger tables are scanned in parallel, a morsel of MORSEL_BLOCKS blocks per task on the Scheduler.
  */
 
 class HeapTable : public DbRelation {
 public:
-    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes);
+    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+              Identifier storage_engine = "HEAP");
 
-    virtual ~HeapTable() {}
+    virtual ~HeapTable();
 
     HeapTable(const HeapTable &other) = delete;
 
@@ -41,6 +54,12 @@ public:
 
     virtual Handle insert(const ValueDict *row);
 
+    virtual Handles *insert(const ValueDicts *rows);
+
+    virtual Handles *copy_from(const std::string &path);
+
+    virtual u_long copy_to(const std::string &path);
+
     virtual void update(const Handle handle, const ValueDict *new_values);
 
     virtual void del(const Handle handle);
@@ -55,21 +74,101 @@ public:
 
     virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
 
+    virtual Tuple *project(Handle handle, const ColumnOrdinals *ordinals);
+
     using DbRelation::project;
 
+    virtual void scan(const ColumnOrdinals *ordinals, TupleVisitor visit);
+
+    using DbRelation::scan;
+
+    virtual void scan_batches(const ColumnOrdinals *ordinals, BatchVisitor visit, const Conjunction *where = nullptr);
+
+    virtual void scan_morsels(const ColumnOrdinals *ordinals, MorselVisitor visit, const Conjunction *where = nullptr);
+
+    virtual u_long estimate_rows();
+
+    /**
+     * Number of blocks in each morsel of a parallel scan (see scan_morsels).
+     */
+    static const uint MORSEL_BLOCKS = 16;
+
+    /**
+     * Work out every block's zones afresh from the rows in it now, which tightens the ones that widened as rows
+     * were rewritten or deleted. Also done when the table is opened and its zone file is missing.
+     */
+    virtual void rebuild_zones();
+
+    /**
+     * Choose which columns have a Bloom filter in each block (by default the TEXT ones), and rebuild the zones
+     * so they all do.
+     * @param column_names  the columns (none at all if empty)
+     */
+    virtual void set_bloom_columns(const ColumnNames *column_names);
+
+    /**
+     * Accessor for the storage engine the table's blocks are kept in.
+     * @returns  "HEAP" or "MMAP"
+     */
+    virtual Identifier get_storage_engine() const { return storage_engine; }
+
+    /**
+     * Set how many blocks a scan keeps asking for ahead of itself (0 turns prefetching off).
+     * @param blocks  size of the prefetch window
+     */
+    virtual void set_prefetch_window(uint blocks) { file->set_prefetch_window(blocks); }
+
 protected:
-    HeapFile file;
+    Identifier storage_engine;
+    HeapFile *file;
+    ZoneMap zones;
+    const RowCodec *codec;  // marshals our rows (shared with every table of the same shape)
+    Tuple null_row;  // a NULL for each column
+    mutable std::vector<const Value *> marshal_values;  // marshal's scratch space: the row's values in column order
+    mutable Tuple csv_values;  // scratch space for the CSV marshal and unmarshal
 
     virtual ValueDict *validate(const ValueDict *row) const;
 
     virtual Handle append(const ValueDict *row);
 
+    virtual Handle append(const Dbt *data, bool moved);
+
+    virtual Handle append(SlottedPage *&tail, const Dbt *data);
+
+    virtual bool put_in_place(Handle location, const Dbt *data);
+
+    virtual void erase(Handle location);
+
     virtual Dbt *marshal(const ValueDict *row) const;
 
+    virtual u_int32_t marshal(const ValueDict *row, char *bytes) const;
+
+    virtual u_int32_t marshal(const CsvReader &record, char *bytes) const;
+
     virtual ValueDict *unmarshal(Dbt *data) const;
 
-    virtual bool selected(Handle handle, const ValueDict *where);
+    virtual void unmarshal(const Dbt *data, Tuple &row, bool views) const;
+
+    virtual void unmarshal(const Dbt *data, CsvWriter &writer) const;
+
+    virtual void project(const Tuple &row, const ColumnOrdinals *ordinals, Tuple &projected) const;
+
+    virtual void fetch(Handle handle, Tuple &row);
+
+    virtual void read(SlottedPage *block, RecordID record_id, Tuple &row);
+
+    virtual bool selected(const Tuple &row, const Conjunction *where) const;
+
+    virtual void fill(SlottedPage *block, const ColumnOrdinals *ordinals, Batch &batch, char *buffer, bool has_text,
+                      const BatchVisitor &visit);
+
+    virtual void scan_morsel(const ColumnOrdinals *ordinals, uint morsel, BlockID first, BlockID last,
+                             const MorselVisitor &visit, const Conjunction *where);
+
+    virtual std::vector<ColumnAttribute::DataType> batch_types(const ColumnOrdinals *ordinals, bool &has_text);
 };
 
 bool test_heap_storage();
 
+bool test_heap_table(Identifier storage_engine);
+
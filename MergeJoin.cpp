@@ -0,0 +1,182 @@
+/**
+ * @file MergeJoin.cpp - implementation of MergeJoin and IndexedRows
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include "MergeJoin.h"
+
+using namespace std;
+
+IndexedRows::IndexedRows(DbRelation &table, DbIndex &index, const Conjunction &conditions)
+        : table(table), cursor(index.ordered()), conditions(conditions), all() {
+    for (uint i = 0; i < table.get_column_names().size(); i++)
+        this->all.push_back(i);
+}
+
+IndexedRows::~IndexedRows() {
+    delete this->cursor;
+}
+
+bool IndexedRows::next(Tuple &row) {
+    Tuple key;
+    Handle handle;
+    while (this->cursor->next(key, handle)) {
+        Tuple *fetched = this->table.project(handle, &this->all);
+        bool selected = true;
+        for (auto const &condition: this->conditions)
+            selected = selected && (*fetched)[condition.first] == condition.second;
+        if (selected)
+            row.swap(*fetched);
+        delete fetched;
+        if (selected)
+            return true;
+    }
+    return false;
+}
+
+MergeJoin::MergeJoin(const RowCodec::Shape &right_shape, const ColumnOrdinals &left_keys,
+                     const ColumnOrdinals &right_keys, size_t memory, MatchVisitor visit)
+        : right_shape(right_shape), left_keys(left_keys), right_keys(right_keys), memory(memory), visit(visit) {
+}
+
+void MergeJoin::join(OrderedRows &left, OrderedRows &right) {
+    Tuple left_row, right_row;
+    bool more_left = next_keyed(left, this->left_keys, left_row);
+    bool more_right = next_keyed(right, this->right_keys, right_row);
+    vector<Tuple> run;
+    while (more_left && more_right) {
+        int order = compare(left_row, right_row);
+        if (order < 0) {
+            more_left = next_keyed(left, this->left_keys, left_row);
+            continue;
+        }
+        if (order > 0) {
+            more_right = next_keyed(right, this->right_keys, right_row);
+            continue;
+        }
+
+        // gather the right rows with this key, spilling them if there are too many
+        run.clear();
+        SpillFile *spilled = nullptr;
+        size_t used = 0;
+        Tuple run_key = right_row;
+        try {
+            do {
+                if (spilled != nullptr) {
+                    spilled->write(right_row);
+                } else {
+                    used += row_memory(right_row);
+                    run.push_back(right_row);
+                    if (used > this->memory) {
+                        spilled = new SpillFile(this->right_shape);
+                        for (auto const &row: run)
+                            spilled->write(row);
+                        run.clear();
+                    }
+                }
+                more_right = next_keyed(right, this->right_keys, right_row);
+            } while (more_right && same_key(right_row, run_key));
+
+            // join each left row with this key with all of them
+            Tuple spilled_row;
+            do {
+                if (spilled != nullptr) {
+                    spilled->rewind();
+                    while (spilled->read(spilled_row))
+                        this->visit(left_row, spilled_row);
+                } else {
+                    for (auto const &row: run)
+                        this->visit(left_row, row);
+                }
+                more_left = next_keyed(left, this->left_keys, left_row);
+            } while (more_left && compare(left_row, run_key) == 0);
+        } catch (...) {
+            delete spilled;
+            throw;
+        }
+        delete spilled;
+    }
+}
+
+int MergeJoin::compare(const Tuple &left_row, const Tuple &right_row) const {
+    for (uint i = 0; i < this->left_keys.size(); i++) {
+        const Value &left = left_row[this->left_keys[i]], &right = right_row[this->right_keys[i]];
+        if (left < right)
+            return -1;
+        if (right < left)
+            return 1;
+    }
+    return 0;
+}
+
+bool MergeJoin::same_key(const Tuple &a, const Tuple &b) const {
+    for (auto const &key: this->right_keys)
+        if (!(a[key] == b[key]))
+            return false;
+    return true;
+}
+
+// Read the next row that has no NULL in its key columns.
+bool MergeJoin::next_keyed(OrderedRows &input, const ColumnOrdinals &keys, Tuple &row) {
+    while (input.next(row))
+        if (none_of(keys.begin(), keys.end(), [&row](uint key) { return row[key].is_null(); }))
+            return true;
+    return false;
+}
+
+/**
+ * Join sorted rows with runs of duplicate keys on both sides (and some NULL keys), with the rows sorted and the runs
+ * held in memory and with a budget so small everything is spilled, and check each finds every matching pair once.
+ * @return true if the tests all succeeded
+ */
+bool test_merge_join() {
+    RowCodec::Shape left_shape, right_shape;
+    left_shape.push_back(ColumnAttribute::INT);
+    left_shape.push_back(ColumnAttribute::TEXT);
+    right_shape.push_back(ColumnAttribute::TEXT);
+    right_shape.push_back(ColumnAttribute::INT);
+    ColumnOrdinals left_keys(1, 0), right_keys(1, 1);
+    size_t budgets[] = {numeric_limits<size_t>::max(), 1};
+    for (auto const &budget: budgets) {
+        ExternalSort left(left_shape, SortKeys(1, SortKey(0)), budget);
+        ExternalSort right(right_shape, SortKeys(1, SortKey(1)), budget);
+        Tuple row(2);
+        for (int i = 0; i < 1000; i++) {
+            row[0] = Value(i % 500);  // each key twice
+            row[1] = Value("left " + to_string(i % 500));
+            left.add(row);
+        }
+        row[0].set_null(ColumnAttribute::INT);
+        left.add(row);
+        for (int i = 0; i < 3000; i++) {
+            row[0] = Value("right " + to_string(i));
+            if (i % 7 == 0)
+                row[1].set_null(ColumnAttribute::INT);
+            else
+                row[1] = Value(i % 1000);  // keys 0..499 three times each (less the NULLs)
+            right.add(row);
+        }
+        u_long matches = 0, sum = 0;
+        bool ok = true;
+        MergeJoin join(right_shape, left_keys, right_keys, budget, [&](const Tuple &left_row, const Tuple &right_row) {
+            matches++;
+            sum += (u_long) left_row[0].n;
+            ok = ok && left_row[0] == right_row[1] && left_row[1].s() == "left " + to_string(left_row[0].n);
+        });
+        join.join(left, right);
+        u_long expected_matches = 0, expected_sum = 0;
+        for (int i = 0; i < 3000; i++)
+            if (i % 7 != 0 && i % 1000 < 500) {
+                expected_matches += 2;
+                expected_sum += 2 * (u_long) (i % 1000);
+            }
+        if (!ok || matches != expected_matches || sum != expected_sum) {
+            cout << "merge join failed with budget " << budget << endl;
+            return false;
+        }
+    }
+    cout << "merge join ok" << endl;
+    return true;
+}
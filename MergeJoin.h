@@ -0,0 +1,88 @@
+/**
+ * @file MergeJoin.h - equi-join of two streams of rows that come in order of their keys.
+ * IndexedRows
+ * MergeJoin
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include "storage_engine.h"
+#include "HashJoin.h"
+#include "SpillFile.h"
+#include "ExternalSort.h"
+
+/**
+ * @class IndexedRows - the rows of a table in the order of an ordered index on it
+ *
+ * The index's entries are walked with an IndexCursor and each row is fetched by its handle, so nothing is kept in
+ * memory but the index leaf being walked.
+ */
+class IndexedRows : public OrderedRows {
+public:
+    /**
+     * @param table       the table
+     * @param index       an ordered index on it (see DbIndex::is_ordered)
+     * @param conditions  only the rows that have all these values (by column ordinal) are handed out
+     */
+    IndexedRows(DbRelation &table, DbIndex &index, const Conjunction &conditions);
+
+    virtual ~IndexedRows();
+
+    IndexedRows(const IndexedRows &other) = delete;
+
+    IndexedRows &operator=(const IndexedRows &other) = delete;
+
+    virtual bool next(Tuple &row);
+
+protected:
+    DbRelation &table;
+    IndexCursor *cursor;
+    Conjunction conditions;
+    ColumnOrdinals all;
+};
+
+/**
+ * @class MergeJoin - merge join of two inputs ordered on their keys
+ *
+ * The inputs are read side by side, always moving on with the one that is behind, and where their keys meet the
+ * run of right rows with that key is gathered and joined with each of the left rows with it, so runs of duplicate
+ * keys on either side find every match. A run that comes to more than the memory budget is written out to a spill
+ * file and read back for each left row, so memory stays bounded however long the runs are. A row with a NULL in any
+ * key column matches nothing.
+ */
+class MergeJoin {
+public:
+    /**
+     * @param right_shape  data type of each of the right side's columns (for spilling a run)
+     * @param left_keys    positions of the key columns in the left rows, in the order the left rows are sorted by
+     * @param right_keys   positions of the key columns in the right rows (matching left_keys one for one)
+     * @param memory       bytes of a run of right rows to hold before spilling it
+     * @param visit        called with each pair of matching rows (the build side of the visitor is the left side)
+     */
+    MergeJoin(const RowCodec::Shape &right_shape, const ColumnOrdinals &left_keys, const ColumnOrdinals &right_keys,
+              size_t memory, MatchVisitor visit);
+
+    virtual ~MergeJoin() {}
+
+    /**
+     * Join the rows of two inputs.
+     * @param left   the left rows, in order of left_keys
+     * @param right  the right rows, in order of right_keys
+     */
+    virtual void join(OrderedRows &left, OrderedRows &right);
+
+protected:
+    RowCodec::Shape right_shape;
+    ColumnOrdinals left_keys, right_keys;
+    size_t memory;
+    MatchVisitor visit;
+
+    virtual int compare(const Tuple &left_row, const Tuple &right_row) const;
+
+    virtual bool same_key(const Tuple &a, const Tuple &b) const;  // for two right rows
+
+    static bool next_keyed(OrderedRows &input, const ColumnOrdinals &keys, Tuple &row);
+};
+
+bool test_merge_join();
@@ -0,0 +1,264 @@
+/**
+ * @file MmapFile.cpp
+ * @see Seattle University, CPSC5300
+ */
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "MmapFile.h"
+
+using namespace std;
+
+std::set<MmapFile *> MmapFile::open_files;
+
+/**
+ * Constructor
+ * @param name
+ */
+MmapFile::MmapFile(string name) : HeapFile(name), fd(-1), map(nullptr), map_size(0), dirty() {
+    this->dbfilename = this->name + ".mmap";
+}
+
+/**
+ * Destructor - make sure everything made it out to the file.
+ */
+MmapFile::~MmapFile() {
+    close();
+}
+
+/**
+ * Create physical file.
+ */
+void MmapFile::create(void) {
+    this->fd = ::open(path().c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (this->fd < 0)
+        throw DbException(("could not create " + path()).c_str(), errno);
+    map_file(EXTENT * DbBlock::BLOCK_SZ);
+    this->last = 0;
+    put_last();
+    SlottedPage *page = get_new(); // force one page to exist
+    delete page;
+}
+
+/**
+ * Delete the physical file.
+ */
+void MmapFile::drop(void) {
+    close();
+    if (::unlink(path().c_str()) < 0)
+        throw DbException(("could not remove " + path()).c_str(), errno);
+}
+
+/**
+ * Open physical file.
+ */
+void MmapFile::open(void) {
+    if (!this->closed)
+        return;
+    this->fd = ::open(path().c_str(), O_RDWR);
+    if (this->fd < 0)
+        throw DbException(("could not open " + path()).c_str(), errno);
+    struct stat st;
+    fstat(this->fd, &st);
+    if ((size_t) st.st_size < DbBlock::BLOCK_SZ) {
+        ::close(this->fd);
+        this->fd = -1;
+        throw DbRelationError(this->dbfilename + " has no header block");
+    }
+    map_file((size_t) st.st_size);
+    try {
+        this->last = read_header(address(0));
+    } catch (DbRelationError &) {
+        close();
+        throw;
+    }
+}
+
+/**
+ * Close the physical file (writing back any dirty blocks first).
+ */
+void MmapFile::close(void) {
+    if (this->closed)
+        return;
+    sync();
+    unmap_file();
+    ::close(this->fd);
+    this->fd = -1;
+}
+
+/**
+ * Allocate a new block at the end of the file, growing the file by another extent if needed.
+ * @return the new empty block (freed by caller)
+ */
+SlottedPage *MmapFile::get_new(void) {
+    if ((this->last + 2) * DbBlock::BLOCK_SZ > this->map_size) {
+        size_t new_size = this->map_size + EXTENT * DbBlock::BLOCK_SZ;
+        unmap_file();
+        if (ftruncate(this->fd, (off_t) new_size) < 0)
+            throw DbException(("could not grow " + path()).c_str(), errno);
+        map_file(new_size);
+    }
+    BlockID block_id = ++this->last;
+    put_last();
+    Dbt data(address(block_id), DbBlock::BLOCK_SZ);
+    this->dirty.insert(block_id);
+    return new SlottedPage(data, block_id, true);
+}
+
+/**
+ * Get a block from the file. The block's memory is the mapping itself.
+ * @param block_id
+ * @return          the given slotted page (freed by caller)
+ */
+SlottedPage *MmapFile::get(BlockID block_id) {
+    if (block_id == 0 || block_id > this->last)
+        throw DbRelationError("no block " + to_string(block_id) + " in " + this->dbfilename);
+    Dbt data(address(block_id), DbBlock::BLOCK_SZ);
+    return new SlottedPage(data, block_id, false);
+}
+
+/**
+ * Copy a block out of the mapping.
+ * @param block_id  the block
+ * @param buffer    BLOCK_SZ bytes to copy it into
+ * @return          the page, in buffer (freed by caller)
+ */
+SlottedPage *MmapFile::get(BlockID block_id, char *buffer) {
+    if (block_id == 0 || block_id > this->last)
+        throw DbRelationError("no block " + to_string(block_id) + " in " + this->dbfilename);
+    memcpy(buffer, address(block_id), DbBlock::BLOCK_SZ);
+    Dbt data(buffer, DbBlock::BLOCK_SZ);
+    return new SlottedPage(data, block_id, false);
+}
+
+/**
+ * Write a block back to the file. Blocks we handed out are already in place, so this usually just
+ * marks the block as dirty.
+ * @param block
+ */
+void MmapFile::put(DbBlock *block) {
+    BlockID block_id = block->get_block_id();
+    char *to = address(block_id);
+    if (block->get_data() != to)
+        memcpy(to, block->get_data(), DbBlock::BLOCK_SZ);
+    this->dirty.insert(block_id);
+}
+
+/**
+ * Write the dirty blocks back to disk, one msync per run of consecutive blocks.
+ */
+void MmapFile::sync(void) {
+    auto block_id = this->dirty.begin();
+    while (block_id != this->dirty.end()) {
+        BlockID first = *block_id, end = first + 1;
+        while (++block_id != this->dirty.end() && *block_id == end)
+            end++;
+        if (msync(address(first), (end - first) * DbBlock::BLOCK_SZ, MS_SYNC) < 0)
+            throw DbException(("could not sync " + path()).c_str(), errno);
+    }
+    this->dirty.clear();
+}
+
+/**
+ * Walk the mapping block by block, keeping the kernel a window of blocks ahead of us.
+ * @param visit  called with each block
+ */
+void MmapFile::scan(BlockVisitor visit) {
+    uint window = this->prefetch_window;
+    BlockID prefetched = 1;  // blocks before this one have been asked for already
+    for (BlockID block_id = 1; block_id <= this->last; block_id++) {
+        if (window > 0 && block_id + window / 2 >= prefetched && prefetched <= this->last) {
+            // keep at least half a window of reads in flight ahead of us
+            prefetch(prefetched, window);
+            prefetched += window;
+        }
+        Dbt data(address(block_id), DbBlock::BLOCK_SZ);
+        SlottedPage page(data, block_id, false);
+        visit(&page);
+    }
+}
+
+/**
+ * Walk a run of the mapping, having asked for all of it up front. Reading the mapping needs no buffers or
+ * cursors, so any number of these can go at once.
+ * @param first  first block to visit
+ * @param last   last block to visit
+ * @param visit  called with each block
+ */
+void MmapFile::scan(BlockID first, BlockID last, BlockVisitor visit) {
+    if (last > this->last)
+        last = this->last;
+    if (first > last)
+        return;
+    prefetch(first, last - first + 1);
+    for (BlockID block_id = first; block_id <= last; block_id++) {
+        Dbt data(address(block_id), DbBlock::BLOCK_SZ);
+        SlottedPage page(data, block_id, false);
+        visit(&page);
+    }
+}
+
+/**
+ * Ask the kernel to start reading the given run of blocks into the mapping now, so the scan finds
+ * them already resident instead of faulting them in one at a time.
+ * @param block_id  first block of the run
+ * @param count     number of blocks in the run
+ */
+void MmapFile::prefetch(BlockID block_id, uint count) {
+    if (block_id == 0 || block_id > this->last)
+        return;
+    if (block_id + count > this->last + 1)
+        count = this->last + 1 - block_id;
+    madvise(address(block_id), (size_t) count * DbBlock::BLOCK_SZ, MADV_WILLNEED);
+}
+
+// Write back the dirty blocks of all the open files.
+void MmapFile::checkpoint() {
+    for (auto const &file: open_files)
+        file->sync();
+}
+
+// Map the whole file (which is first extended to the given size if it is smaller).
+void MmapFile::map_file(size_t size) {
+    struct stat st;
+    fstat(this->fd, &st);
+    if ((size_t) st.st_size < size && ftruncate(this->fd, (off_t) size) < 0)
+        throw DbException(("could not size " + path()).c_str(), errno);
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if (addr == MAP_FAILED)
+        throw DbException(("could not map " + path()).c_str(), errno);
+    this->map = (char *) addr;
+    this->map_size = size;
+    this->closed = false;
+    open_files.insert(this);
+}
+
+// Drop the mapping (the kernel still writes back anything dirty in it).
+void MmapFile::unmap_file() {
+    munmap(this->map, this->map_size);
+    this->map = nullptr;
+    this->map_size = 0;
+    this->closed = true;
+    open_files.erase(this);
+}
+
+// Full path of the file within the database environment.
+string MmapFile::path() const {
+    const char *home;
+    _DB_ENV->get_home(&home);
+    return string(home) + "/" + this->dbfilename;
+}
+
+// Address of the given block within the mapping.
+char *MmapFile::address(BlockID block_id) const {
+    return this->map + (size_t) block_id * DbBlock::BLOCK_SZ;
+}
+
+// Record the header, with the number of blocks in use, in block 0.
+void MmapFile::put_last() {
+    write_header(address(0));
+    this->dirty.insert(0);
+}
@@ -0,0 +1,86 @@
+/**
+ * @file MmapFile.h - Implementation of storage_engine with a memory-mapped heap file.
+ * MmapFile: HeapFile
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <set>
+#include "HeapFile.h"
+
+
+/**
+ * @class MmapFile - memory-mapped alternative to the Berkeley DB backed HeapFile
+ *
+ * The table file is mapped into memory and each SlottedPage is handed a pointer straight into the mapping,
+        so getting and putting a block never copies it. Block n lives at byte offset n * BLOCK_SZ; block 0 is a
+        header holding the number of blocks in use. The file grows EXTENT blocks at a time.
+        Blocks that have been put are remembered as dirty and written back with msync at a checkpoint
+        (see MmapFile::checkpoint) or when the file is closed.
+        As with HeapFile, a block is only good until the next call that might grow the file, so callers
+        should not hang on to more than one block at a time.
+ */
+class MmapFile : public HeapFile {
+public:
+    MmapFile(std::string name);
+
+    virtual ~MmapFile();
+
+    MmapFile(const MmapFile &other) = delete;
+
+    MmapFile(MmapFile &&temp) = delete;
+
+    MmapFile &operator=(const MmapFile &other) = delete;
+
+    MmapFile &operator=(MmapFile &&temp) = delete;
+
+    virtual void create(void);
+
+    virtual void drop(void);
+
+    virtual void open(void);
+
+    virtual void close(void);
+
+    virtual SlottedPage *get_new(void);
+
+    virtual SlottedPage *get(BlockID block_id);
+
+    virtual SlottedPage *get(BlockID block_id, char *buffer);
+
+    virtual void put(DbBlock *block);
+
+    virtual void sync(void);
+
+    virtual void scan(BlockVisitor visit);
+
+    virtual void scan(BlockID first, BlockID last, BlockVisitor visit);
+
+    using HeapFile::scan;
+
+    virtual void prefetch(BlockID block_id, uint count);
+
+    /**
+     * Write back the dirty blocks of every open memory-mapped file.
+     */
+    static void checkpoint();
+
+protected:
+    int fd;
+    char *map;
+    size_t map_size;
+    std::set<BlockID> dirty;
+
+    static std::set<MmapFile *> open_files;
+
+    virtual void map_file(size_t size);
+
+    virtual void unmap_file();
+
+    virtual std::string path() const;
+
+    virtual char *address(BlockID block_id) const;
+
+    virtual void put_last();
+};
@@ -227,6 +227,24 @@ string ParseTreeToString::select(const SelectStatement *stmt) {
     ret += " FROM " + table_ref(stmt->fromTable);
     if (stmt->whereClause != NULL)
         ret += " WHERE " + expression(stmt->whereClause);
+    if (stmt->order != NULL) {
+        ret += " ORDER BY ";
+        doComma = false;
+        for (OrderDescription *order : *stmt->order) {
+            if (doComma)
+                ret += ", ";
+            ret += expression(order->expr);
+            if (order->type == kOrderDesc)
+                ret += " DESC";
+            doComma = true;
+        }
+    }
+    if (stmt->limit != NULL) {
+        if (stmt->limit->limit != kNoLimit)
+            ret += " LIMIT " + to_string(stmt->limit->limit);
+        if (stmt->limit->offset != kNoOffset)
+            ret += " OFFSET " + to_string(stmt->limit->offset);
+    }
     return ret;
 }
 
@@ -318,6 +336,28 @@ string ParseTreeToString::del(const DeleteStatement *stmt) {
     return ret;
 }
 
+string ParseTreeToString::update(const UpdateStatement *stmt) {
+    string ret("UPDATE ");
+    ret += table_ref(stmt->table) + " SET ";
+    bool doComma = false;
+    for (UpdateClause *clause : *stmt->updates) {
+        if (doComma)
+            ret += ", ";
+        ret += string(clause->column) + " = " + expression(clause->value);
+        doComma = true;
+    }
+    if (stmt->where != NULL)
+        ret += " WHERE " + expression(stmt->where);
+    return ret;
+}
+
+string ParseTreeToString::import(const ImportStatement *stmt) {
+    string ret("IMPORT FROM ");
+    ret += stmt->type == ImportStatement::kImportCSV ? "CSV" : "TBL";
+    ret += string(" FILE '") + stmt->filePath + "' INTO " + stmt->tableName;
+    return ret;
+}
+
 string ParseTreeToString::show(const ShowStatement *stmt) {
     string ret("SHOW ");
     switch (stmt->type) {
@@ -345,6 +385,10 @@ string ParseTreeToString::statement(const SQLStatement *stmt) {
             return insert((const InsertStatement *) stmt);
         case kStmtDelete:
             return del((const DeleteStatement *) stmt);
+        case kStmtUpdate:
+            return update((const UpdateStatement *) stmt);
+        case kStmtImport:
+            return import((const ImportStatement *) stmt);
         case kStmtCreate:
             return create((const CreateStatement *) stmt);
         case kStmtDrop:
@@ -353,8 +397,6 @@ string ParseTreeToString::statement(const SQLStatement *stmt) {
             return show((const ShowStatement *) stmt);
 
         case kStmtError:
-        case kStmtImport:
-        case kStmtUpdate:
         case kStmtPrepare:
         case kStmtExecute:
         case kStmtExport:
@@ -0,0 +1,314 @@
+/**
+ * @file PaxPage.cpp - implementation of PaxLayout and PaxPage
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <cstring>
+#include "PaxPage.h"
+
+using namespace std;
+
+static u_int16_t bitmap_bytes(u_int16_t rows) {
+    return (u_int16_t) ((rows + 7) / 8);
+}
+
+static u_int16_t aligned(u_int16_t offset) {
+    return (u_int16_t) ((offset + 3) & ~3);  // so an INT minipage can be read as an array of int32s
+}
+
+static u_int16_t value_width(ColumnAttribute::DataType data_type) {
+    switch (data_type) {
+        case ColumnAttribute::INT:
+            return sizeof(int32_t);
+        case ColumnAttribute::BOOLEAN:
+            return sizeof(uint8_t);
+        case ColumnAttribute::TEXT:
+            return 2 * sizeof(u_int16_t);
+        default:
+            throw DbRelationError("Only know how to store INT, TEXT, and BOOLEAN");
+    }
+}
+
+/**
+ * Work out how many rows fit on a page and where each minipage goes.
+ * @param column_attributes  the table's columns
+ */
+PaxLayout::PaxLayout(const ColumnAttributes &column_attributes) : capacity(0), live_offset(0), data_types(),
+                                                                  null_offsets(), value_offsets(), text_start(0),
+                                                                  codec(RowCodec::get(column_attributes)) {
+    uint text_columns = 0;
+    for (auto ca: column_attributes) {
+        this->data_types.push_back(ca.get_data_type());
+        if (ca.get_data_type() == ColumnAttribute::TEXT)
+            text_columns++;
+    }
+    // find the most rows whose fixed-size part, plus the text we expect them to have, fits in a block
+    u_int32_t low = 1, high = DbBlock::BLOCK_SZ;
+    while (low < high) {
+        u_int32_t rows = (low + high + 1) / 2;
+        if (lay_out((u_int16_t) rows) + rows * text_columns * TEXT_RESERVE <= DbBlock::BLOCK_SZ)
+            low = rows;
+        else
+            high = rows - 1;
+    }
+    this->capacity = (u_int16_t) low;
+    this->text_start = lay_out(this->capacity);
+    if (this->text_start > DbBlock::BLOCK_SZ)
+        throw DbRelationError("too many columns to fit a row in a block");
+}
+
+/**
+ * Place the live bitmap and each column's minipage for pages of the given number of rows.
+ * @param rows  rows per page
+ * @return      end of the fixed-size part of the page
+ */
+u_int16_t PaxLayout::lay_out(u_int16_t rows) {
+    this->null_offsets.clear();
+    this->value_offsets.clear();
+    u_int32_t offset = HEADER_SZ;
+    this->live_offset = (u_int16_t) offset;
+    offset += bitmap_bytes(rows);
+    for (auto const &data_type: this->data_types) {
+        this->null_offsets.push_back((u_int16_t) offset);
+        offset += bitmap_bytes(rows);
+        offset = aligned((u_int16_t) offset);
+        this->value_offsets.push_back((u_int16_t) offset);
+        offset += (u_int32_t) rows * value_width(data_type);
+        if (offset > UINT16_MAX)
+            return UINT16_MAX;
+    }
+    return (u_int16_t) offset;
+}
+
+/**
+ * @param block     the block's memory
+ * @param block_id  which block it is
+ * @param layout    where things go on the table's pages
+ * @param is_new    if true, set the block up as an empty page (as is done anyway for a block nothing has
+ *                  been added to, since the file lays down unused blocks as empty SlottedPages)
+ */
+PaxPage::PaxPage(Dbt &block, BlockID block_id, const PaxLayout &layout, bool is_new) : DbBlock(block, block_id,
+                                                                                                is_new),
+                                                                                        layout(layout), record() {
+    if (is_new || rows() == 0)
+        clear();
+}
+
+RecordID PaxPage::add(const Dbt *data) {
+    Tuple row;
+    this->layout.codec->decode((const char *) data->get_data(), row, true);
+    vector<const Value *> values;
+    for (auto const &value: row)
+        values.push_back(&value);
+    return add(values.data());
+}
+
+/**
+ * Add a row in the next free slot, compacting the text area first if deleted or replaced text is in the way.
+ * @param values  one per column, in order
+ * @return        the new row's RecordID
+ */
+RecordID PaxPage::add(const Value *const *values) {
+    u_int16_t row = rows();
+    if (row == this->layout.capacity)
+        throw DbBlockNoRoomError("no room for another row");
+    u_int32_t needed = text_needed(values);
+    if (needed > unused_bytes()) {
+        compact();
+        if (needed > unused_bytes())
+            throw DbBlockNoRoomError("not enough room for new row");
+    }
+    write(row, values);
+    set_bit(this->layout.live_offset, row, true);
+    put_n(0, (u_int16_t) (row + 1));
+    put_n(4, (u_int16_t) (size() + 1));
+    return (RecordID) (row + 1);
+}
+
+Dbt *PaxPage::get(RecordID record_id) const {
+    u_int16_t row = (u_int16_t) (record_id - 1);
+    if (record_id == 0 || row >= rows() || !is_live(row))
+        return nullptr;
+    Tuple values(this->layout.data_types.size());
+    vector<const Value *> pointers;
+    for (uint column = 0; column < values.size(); column++) {
+        get(row, column, values[column], true);
+        pointers.push_back(&values[column]);
+    }
+    this->record.resize(DbBlock::BLOCK_SZ);
+    u_int32_t size = this->layout.codec->encode(pointers.data(), this->record.data(), DbBlock::BLOCK_SZ);
+    return new Dbt(this->record.data(), size);
+}
+
+void PaxPage::put(RecordID record_id, const Dbt &data) {
+    Tuple row;
+    this->layout.codec->decode((const char *) data.get_data(), row, false);  // not views: compact moves text
+    vector<const Value *> values;
+    for (auto const &value: row)
+        values.push_back(&value);
+    put(record_id, values.data());
+}
+
+/**
+ * Replace a row's values. New text always goes in fresh space, so if there isn't enough the text area is
+ * compacted (without the row's old text) first.
+ */
+void PaxPage::put(RecordID record_id, const Value *const *values) {
+    u_int16_t row = (u_int16_t) (record_id - 1);
+    u_int32_t needed = text_needed(values);
+    if (needed > unused_bytes()) {
+        Tuple old(this->layout.data_types.size());
+        vector<const Value *> old_values;
+        for (uint column = 0; column < old.size(); column++) {
+            get(row, column, old[column], false);
+            old_values.push_back(&old[column]);
+        }
+        for (uint column = 0; column < old.size(); column++)
+            if (this->layout.data_types[column] == ColumnAttribute::TEXT)
+                memset(address((u_int16_t) (this->layout.value_offsets[column] + row * 4)), 0, 4);
+        compact();
+        if (needed > unused_bytes()) {
+            write(row, old_values.data());  // fits, since it did before
+            throw DbBlockNoRoomError("not enough room for new text");
+        }
+    }
+    write(row, values);
+}
+
+void PaxPage::del(RecordID record_id) {
+    u_int16_t row = (u_int16_t) (record_id - 1);
+    if (!is_live(row))
+        return;
+    set_bit(this->layout.live_offset, row, false);
+    put_n(4, (u_int16_t) (size() - 1));
+}
+
+RecordIDs *PaxPage::ids(void) const {
+    RecordIDs *ret = new RecordIDs();
+    for (u_int16_t row = 0; row < rows(); row++)
+        if (is_live(row))
+            ret->push_back((RecordID) (row + 1));
+    return ret;
+}
+
+void PaxPage::clear() {
+    memset(address(0), 0, this->layout.text_start);
+    put_n(2, (u_int16_t) DbBlock::BLOCK_SZ);
+}
+
+u_int16_t PaxPage::size() const {
+    return get_n(4);
+}
+
+u_int16_t PaxPage::unused_bytes() const {
+    return (u_int16_t) (get_n(2) - this->layout.text_start);
+}
+
+const char *PaxPage::text(u_int16_t row, uint column, u_int16_t &size) const {
+    u_int16_t slot = (u_int16_t) (this->layout.value_offsets[column] + row * 4);
+    size = get_n((u_int16_t) (slot + 2));
+    return (const char *) address(get_n(slot));
+}
+
+void PaxPage::get(u_int16_t row, uint column, Value &value, bool views) const {
+    ColumnAttribute::DataType data_type = this->layout.data_types[column];
+    if (is_null(row, column)) {
+        value.set_null(data_type);
+    } else if (data_type == ColumnAttribute::INT) {
+        int32_t n;
+        memcpy(&n, address((u_int16_t) (this->layout.value_offsets[column] + row * sizeof(int32_t))), sizeof(n));
+        value.set_number(data_type, n);
+    } else if (data_type == ColumnAttribute::BOOLEAN) {
+        value.set_number(data_type, boolean_values(column)[row]);
+    } else {
+        u_int16_t size;
+        const char *data = text(row, column, size);
+        if (views)
+            value.set_view(data, size);
+        else
+            value.set_text(data, size);
+    }
+}
+
+// Get 2-byte integer at given offset in block.
+u_int16_t PaxPage::get_n(u_int16_t offset) const {
+    u_int16_t n;
+    memcpy(&n, address(offset), sizeof(n));
+    return n;
+}
+
+// Put a 2-byte integer at given offset in block.
+void PaxPage::put_n(u_int16_t offset, u_int16_t n) {
+    memcpy(address(offset), &n, sizeof(n));
+}
+
+// Make a void* pointer for a given offset into the data block.
+void *PaxPage::address(u_int16_t offset) const {
+    return (void *) ((char *) this->block.get_data() + offset);
+}
+
+bool PaxPage::bit(u_int16_t offset, u_int16_t row) const {
+    return (((const uint8_t *) address(offset))[row >> 3] >> (row & 7)) & 1;
+}
+
+void PaxPage::set_bit(u_int16_t offset, u_int16_t row, bool on) {
+    uint8_t *byte = (uint8_t *) address(offset) + (row >> 3);
+    if (on)
+        *byte |= (uint8_t) (1 << (row & 7));
+    else
+        *byte &= (uint8_t) ~(1 << (row & 7));
+}
+
+// How much of the text area a row with these values would take.
+u_int32_t PaxPage::text_needed(const Value *const *values) const {
+    u_int32_t needed = 0;
+    for (uint column = 0; column < this->layout.data_types.size(); column++)
+        if (this->layout.data_types[column] == ColumnAttribute::TEXT && !values[column]->is_null())
+            needed += values[column]->text_size();
+    return needed;
+}
+
+// Write a row's values into its slot (there must be room in the text area for its text).
+void PaxPage::write(u_int16_t row, const Value *const *values) {
+    u_int16_t text_end = get_n(2);
+    for (uint column = 0; column < this->layout.data_types.size(); column++) {
+        const Value &value = *values[column];
+        set_bit(this->layout.null_offsets[column], row, value.is_null());
+        u_int16_t offset = this->layout.value_offsets[column];
+        switch (this->layout.data_types[column]) {
+            case ColumnAttribute::INT:
+                memcpy(address((u_int16_t) (offset + row * sizeof(int32_t))), &value.n, sizeof(int32_t));
+                break;
+            case ColumnAttribute::BOOLEAN:
+                *(uint8_t *) address((u_int16_t) (offset + row)) = (uint8_t) value.n;
+                break;
+            default: {
+                u_int16_t size = (u_int16_t) (value.is_null() ? 0 : value.text_size());
+                text_end = (u_int16_t) (text_end - size);
+                memcpy(address(text_end), value.text_data(), size);
+                put_n((u_int16_t) (offset + row * 4), text_end);
+                put_n((u_int16_t) (offset + row * 4 + 2), size);
+            }
+        }
+    }
+    put_n(2, text_end);
+}
+
+// Squeeze the text of the live rows back up against the end of the block, dropping any that's been let go.
+void PaxPage::compact() {
+    char copy[DbBlock::BLOCK_SZ];
+    memcpy(copy, address(0), DbBlock::BLOCK_SZ);
+    u_int16_t text_end = (u_int16_t) DbBlock::BLOCK_SZ;
+    for (u_int16_t row = 0; row < rows(); row++) {
+        for (uint column = 0; column < this->layout.data_types.size(); column++) {
+            if (this->layout.data_types[column] != ColumnAttribute::TEXT)
+                continue;
+            u_int16_t slot = (u_int16_t) (this->layout.value_offsets[column] + row * 4);
+            u_int16_t size = is_live(row) ? get_n((u_int16_t) (slot + 2)) : (u_int16_t) 0;
+            text_end = (u_int16_t) (text_end - size);
+            memcpy(address(text_end), copy + get_n(slot), size);
+            put_n(slot, text_end);
+            put_n((u_int16_t) (slot + 2), size);
+        }
+    }
+    put_n(2, text_end);
+}
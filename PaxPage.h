@@ -0,0 +1,165 @@
+/**
+ * @file PaxPage.h - column-major (PAX) page layout for the COLUMNAR storage engine.
+ * PaxLayout
+ * PaxPage: DbBlock
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include "storage_engine.h"
+#include "RowCodec.h"
+
+/**
+ * @class PaxLayout - where everything goes in the pages of a table with a given set of columns
+ *
+ * Worked out once per table. Each page has room for the same number of rows (capacity), chosen so that the
+ * fixed-size part of the page for that many rows leaves TEXT_RESERVE bytes per row per TEXT column for text.
+ */
+class PaxLayout {
+public:
+    static const u_int16_t HEADER_SZ = 8;
+    static const u_int16_t TEXT_RESERVE = 24;  // guess at the average TEXT value's size, for sizing pages
+
+    PaxLayout(const ColumnAttributes &column_attributes);
+
+    u_int16_t capacity;  // rows per page
+    u_int16_t live_offset;  // live-row bitmap
+    std::vector<ColumnAttribute::DataType> data_types;
+    std::vector<u_int16_t> null_offsets;  // each column's null bitmap
+    std::vector<u_int16_t> value_offsets;  // each column's minipage
+    u_int16_t text_start;  // end of the fixed-size part of the page (text grows down from the end to here)
+    const RowCodec *codec;  // the row format used by PaxPage's DbBlock interface
+
+protected:
+    u_int16_t lay_out(u_int16_t rows);
+};
+
+/**
+ * @class PaxPage - a block holding a run of rows column by column
+ *
+ *      Rows are numbered in the order they were added, and a row's RecordID is its number plus one, so
+        handles stay put: deleting a row only clears its live bit, and its slot isn't reused.
+        The block is laid out (see PaxLayout) as:
+            Bytes 0x00 - 0x01: number of rows added (like SlottedPage, 0 means an empty block)
+            Bytes 0x02 - 0x03: offset of the start of the text area (it grows down from the end of the block)
+            Bytes 0x04 - 0x05: number of live rows
+            live bitmap: one bit per row slot, set if the row hasn't been deleted
+            for each column, a minipage: a null bitmap, then the values of every row slot in turn:
+                INT: int32, BOOLEAN: one byte, TEXT: two-byte offset and two-byte length into the text area
+            text area
+        so a scan can work its way down one column's values without touching any of the others.
+
+        The DbBlock interface takes and gives whole records in the layout's RowCodec format; the column
+        accessors are there for scans.
+ */
+class PaxPage : public DbBlock {
+public:
+    PaxPage(Dbt &block, BlockID block_id, const PaxLayout &layout, bool is_new = false);
+
+    virtual ~PaxPage() {}
+
+    PaxPage(const PaxPage &other) = delete;
+
+    PaxPage &operator=(const PaxPage &other) = delete;
+
+    virtual RecordID add(const Dbt *data);
+
+    /**
+     * Add a row.
+     * @param values  one per column, in order (any of them may be NULL)
+     * @return        the new row's RecordID
+     * @throws        DbBlockNoRoomError if the page is full
+     */
+    virtual RecordID add(const Value *const *values);
+
+    /**
+     * Get a row as a record in the layout's RowCodec format.
+     * @return  the record (the Dbt is freed by the caller, its data is good until the next get)
+     */
+    virtual Dbt *get(RecordID record_id) const;
+
+    virtual void put(RecordID record_id, const Dbt &data);
+
+    /**
+     * Replace a row's values.
+     * @param record_id  row to change
+     * @param values     one per column, in order
+     * @throws           DbBlockNoRoomError if new text won't fit (the row is left as it was)
+     */
+    virtual void put(RecordID record_id, const Value *const *values);
+
+    virtual void del(RecordID record_id);
+
+    virtual RecordIDs *ids(void) const;
+
+    virtual void clear();
+
+    virtual u_int16_t size() const;
+
+    virtual u_int16_t unused_bytes() const;
+
+    /**
+     * Number of row slots used (live or deleted). Slot i is RecordID i + 1.
+     */
+    u_int16_t rows() const { return get_n(0); }
+
+    bool is_live(u_int16_t row) const { return bit(this->layout.live_offset, row); }
+
+    bool is_null(u_int16_t row, uint column) const { return bit(this->layout.null_offsets[column], row); }
+
+    /**
+     * The minipage of an INT column: one int32 per row slot.
+     */
+    const int32_t *int_values(uint column) const {
+        return (const int32_t *) address(this->layout.value_offsets[column]);
+    }
+
+    /**
+     * The minipage of a BOOLEAN column: one byte per row slot.
+     */
+    const uint8_t *boolean_values(uint column) const {
+        return (const uint8_t *) address(this->layout.value_offsets[column]);
+    }
+
+    /**
+     * A bitmap (one bit per row slot) from the page: the live rows or a column's NULLs.
+     */
+    const uint8_t *live_bits() const { return (const uint8_t *) address(this->layout.live_offset); }
+
+    const uint8_t *null_bits(uint column) const { return (const uint8_t *) address(this->layout.null_offsets[column]); }
+
+    /**
+     * The text of a TEXT column for a row slot.
+     * @param row   row slot
+     * @param size  set to its length
+     * @return      its characters (in the block)
+     */
+    const char *text(u_int16_t row, uint column, u_int16_t &size) const;
+
+    /**
+     * Unmarshal one column of a row.
+     * @param views  if true, longer text is a view of the block rather than a copy
+     */
+    void get(u_int16_t row, uint column, Value &value, bool views) const;
+
+protected:
+    const PaxLayout &layout;
+    mutable std::vector<char> record;  // what get hands back
+
+    u_int16_t get_n(u_int16_t offset) const;
+
+    void put_n(u_int16_t offset, u_int16_t n);
+
+    void *address(u_int16_t offset) const;
+
+    bool bit(u_int16_t offset, u_int16_t row) const;
+
+    void set_bit(u_int16_t offset, u_int16_t row, bool on);
+
+    u_int32_t text_needed(const Value *const *values) const;
+
+    void write(u_int16_t row, const Value *const *values);
+
+    void compact();
+};
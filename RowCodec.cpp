@@ -0,0 +1,171 @@
+/**
+ * @file RowCodec.cpp - implementation of RowCodec, FixedRowCodec and IntRowCodec
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <map>
+#include <mutex>
+#include "RowCodec.h"
+
+using namespace std;
+
+/**
+ * Look up (or build) the codec for a shape. Shapes are few, so codecs are kept for good.
+ * @param shape  data type of each field, in order
+ * @return       the codec
+ */
+const RowCodec *RowCodec::get(const Shape &shape) {
+    static map<Shape, RowCodec *> codecs;
+    static mutex codecs_mutex;
+    lock_guard<mutex> lock(codecs_mutex);
+    auto found = codecs.find(shape);
+    if (found != codecs.end())
+        return found->second;
+    bool all_fixed = true, all_int = true;
+    for (auto const &data_type: shape) {
+        all_fixed = all_fixed && data_type != ColumnAttribute::TEXT;
+        all_int = all_int && data_type == ColumnAttribute::INT;
+    }
+    RowCodec *codec;
+    if (all_int)
+        codec = new IntRowCodec(shape);
+    else if (all_fixed)
+        codec = new FixedRowCodec(shape);
+    else
+        codec = new RowCodec(shape);
+    codecs[shape] = codec;
+    return codec;
+}
+
+const RowCodec *RowCodec::get(const ColumnAttributes &column_attributes) {
+    Shape shape;
+    for (auto ca: column_attributes)
+        shape.push_back(ca.get_data_type());
+    return get(shape);
+}
+
+/**
+ * Work out the program: the decoder and encoder for each field and where its slot is (fixed-width fields
+ * first, after the null bitmap, then the offset table).
+ * @param shape  data type of each field, in order
+ */
+RowCodec::RowCodec(const Shape &shape) : steps(), bitmap_size(0), fixed_size(0), table_end(0), has_text(false) {
+    this->bitmap_size = (u_int32_t) (shape.size() + 7) / 8;
+    u_int32_t offset = this->bitmap_size;
+    for (uint pass = 0; pass < 2; pass++) {  // fixed-width slots on the first pass, TEXT entries on the second
+        for (auto const &data_type: shape) {
+            if ((data_type == ColumnAttribute::TEXT) != (pass == 1))
+                continue;
+            Step step;
+            step.data_type = data_type;
+            step.slot = offset;
+            switch (data_type) {
+                case ColumnAttribute::INT:
+                    step.decode = FieldCodec<ColumnAttribute::INT>::decode;
+                    step.encode = FieldCodec<ColumnAttribute::INT>::encode;
+                    offset += FieldCodec<ColumnAttribute::INT>::WIDTH;
+                    break;
+                case ColumnAttribute::BOOLEAN:
+                    step.decode = FieldCodec<ColumnAttribute::BOOLEAN>::decode;
+                    step.encode = FieldCodec<ColumnAttribute::BOOLEAN>::encode;
+                    offset += FieldCodec<ColumnAttribute::BOOLEAN>::WIDTH;
+                    break;
+                case ColumnAttribute::TEXT:
+                    step.decode = FieldCodec<ColumnAttribute::TEXT>::decode;
+                    step.encode = FieldCodec<ColumnAttribute::TEXT>::encode;
+                    offset += FieldCodec<ColumnAttribute::TEXT>::WIDTH;
+                    this->has_text = true;
+                    break;
+                default:
+                    throw DbRelationError("Only know how to marshal INT, TEXT, and BOOLEAN");
+            }
+            this->steps.push_back(step);
+        }
+    }
+    // the steps are in slot order, so put them back in field order
+    std::vector<Step> in_order(shape.size());
+    uint fixed = 0, text = 0;
+    for (auto const &data_type: shape)
+        if (data_type != ColumnAttribute::TEXT)
+            text++;
+    for (uint i = 0; i < shape.size(); i++)
+        in_order[i] = this->steps[shape[i] == ColumnAttribute::TEXT ? text++ : fixed++];
+    this->steps = in_order;
+    if (this->has_text) {
+        this->table_end = offset;
+        offset += sizeof(uint16_t);
+    }
+    this->fixed_size = offset;
+}
+
+// Is any field of the record NULL?
+bool RowCodec::any_null(const char *bytes) const {
+    for (u_int32_t i = 0; i < this->bitmap_size; i++)
+        if (bytes[i] != 0)
+            return true;
+    return false;
+}
+
+u_int32_t RowCodec::encode(const Value *const *values, char *bytes, u_int32_t limit) const {
+    if (this->fixed_size > limit)
+        return 0;
+    memset(bytes, 0, this->bitmap_size);
+    u_int32_t end = this->fixed_size;
+    for (uint i = 0; i < this->steps.size(); i++) {
+        // a NULL holds 0 or empty text, so it encodes as a zeroed slot or no payload
+        if (values[i]->is_null())
+            bytes[i >> 3] |= (char) (1 << (i & 7));
+        if (!this->steps[i].encode(*values[i], bytes, this->steps[i].slot, end, limit))
+            return 0;
+    }
+    if (this->has_text) {
+        if (end > UINT16_MAX)
+            return 0;
+        uint16_t end16 = (uint16_t) end;
+        memcpy(bytes + this->table_end, &end16, sizeof(end16));
+    }
+    return end;
+}
+
+void RowCodec::decode(const char *bytes, Tuple &row, bool views) const {
+    row.resize(this->steps.size());
+    for (uint i = 0; i < this->steps.size(); i++)
+        decode_field(bytes, i, row[i], views);
+}
+
+// With no TEXT there's no payload, so there's nothing to check past the size of the fixed part.
+u_int32_t FixedRowCodec::encode(const Value *const *values, char *bytes, u_int32_t limit) const {
+    if (this->fixed_size > limit)
+        return 0;
+    memset(bytes, 0, this->bitmap_size);
+    u_int32_t end = this->fixed_size;
+    for (uint i = 0; i < this->steps.size(); i++) {
+        if (values[i]->is_null())
+            bytes[i >> 3] |= (char) (1 << (i & 7));
+        this->steps[i].encode(*values[i], bytes, this->steps[i].slot, end, limit);
+    }
+    return this->fixed_size;
+}
+
+void FixedRowCodec::decode(const char *bytes, Tuple &row, bool views) const {
+    if (any_null(bytes)) {
+        RowCodec::decode(bytes, row, views);
+        return;
+    }
+    row.resize(this->steps.size());
+    for (uint i = 0; i < this->steps.size(); i++)
+        this->steps[i].decode(bytes, this->steps[i].slot, row[i], views);
+}
+
+void IntRowCodec::decode(const char *bytes, Tuple &row, bool views) const {
+    if (any_null(bytes)) {
+        RowCodec::decode(bytes, row, views);
+        return;
+    }
+    row.resize(this->steps.size());
+    const char *fields = bytes + this->bitmap_size;
+    for (uint i = 0; i < this->steps.size(); i++) {
+        int32_t n;
+        memcpy(&n, fields + i * sizeof(int32_t), sizeof(n));
+        row[i].set_number(ColumnAttribute::INT, n);
+    }
+}
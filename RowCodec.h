@@ -0,0 +1,222 @@
+/**
+ * @file RowCodec.h - marshaling of rows (and index keys) worked out once per schema shape.
+ * FieldCodec
+ * RowCodec
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <cstring>
+#include "storage_engine.h"
+
+/**
+ * @class FieldCodec - how one column of a given data type is laid out in a record
+ *
+ * INT is four bytes and BOOLEAN one byte, each in its own slot at a fixed offset in the record. TEXT goes in
+ * the payload area at the end, and its slot is its entry in the offset table: the two-byte offset (from the
+ * start of the record) where its characters start, with the next entry saying where they end.
+ */
+template<ColumnAttribute::DataType T>
+struct FieldCodec;
+
+template<>
+struct FieldCodec<ColumnAttribute::INT> {
+    static const u_int32_t WIDTH = sizeof(int32_t);
+
+    static void decode(const char *record, u_int32_t slot, Value &value, bool views) {
+        int32_t n;
+        memcpy(&n, record + slot, sizeof(n));
+        value.set_number(ColumnAttribute::INT, n);
+    }
+
+    static bool encode(const Value &value, char *record, u_int32_t slot, u_int32_t &end, u_int32_t limit) {
+        memcpy(record + slot, &value.n, sizeof(value.n));
+        return true;
+    }
+};
+
+template<>
+struct FieldCodec<ColumnAttribute::BOOLEAN> {
+    static const u_int32_t WIDTH = sizeof(uint8_t);
+
+    static void decode(const char *record, u_int32_t slot, Value &value, bool views) {
+        value.set_number(ColumnAttribute::BOOLEAN, *(const uint8_t *) (record + slot));
+    }
+
+    static bool encode(const Value &value, char *record, u_int32_t slot, u_int32_t &end, u_int32_t limit) {
+        *(uint8_t *) (record + slot) = (uint8_t) value.n;
+        return true;
+    }
+};
+
+template<>
+struct FieldCodec<ColumnAttribute::TEXT> {
+    static const u_int32_t WIDTH = sizeof(uint16_t);  // its offset table entry
+
+    static void decode(const char *record, u_int32_t slot, Value &value, bool views) {
+        uint16_t bounds[2];
+        memcpy(bounds, record + slot, sizeof(bounds));
+        if (views)
+            value.set_view(record + bounds[0], (uint32_t) (bounds[1] - bounds[0]));  // assume ascii for now
+        else
+            value.set_text(record + bounds[0], (uint32_t) (bounds[1] - bounds[0]));
+    }
+
+    static bool encode(const Value &value, char *record, u_int32_t slot, u_int32_t &end, u_int32_t limit) {
+        u_int32_t size = value.text_size();
+        if (size > limit - end)
+            return false;
+        uint16_t start = (uint16_t) end;
+        memcpy(record + slot, &start, sizeof(start));
+        memcpy(record + end, value.text_data(), size);  // assume ascii for now
+        end += size;
+        return true;
+    }
+};
+
+/**
+ * @class RowCodec - marshals and unmarshals records of one particular sequence of data types
+ *
+ * A record is laid out as
+ *     null bitmap        one bit per field (bit i%8 of byte i/8), set if the field is NULL
+ *     fixed-width slots  INT and BOOLEAN fields, in field order, each at the same offset in every record
+ *     offset table       one two-byte entry per TEXT field for where its characters start, then one for
+ *                        where the last one ends
+ *     payloads           the TEXT fields' characters, in field order
+ * so any one field can be read without looking at the others (see decode_field), and filtering on INT
+ * columns never reads the TEXT area. A NULL TEXT field takes no payload; a NULL fixed-width one is zeroed.
+ *
+ * The per-type work is looked up once, when the codec is built, into a program of one step per field,
+ * so marshaling a row does no switching on data types. Records with no TEXT fields have the same size
+ * every time, so their codec checks the size once, and all-INT records get a loop of their own.
+ * Codecs are shared by every table and index of the same shape: get one with RowCodec::get.
+ */
+class RowCodec {
+public:
+    typedef std::vector<ColumnAttribute::DataType> Shape;
+
+    /**
+     * The codec for the given sequence of data types (built the first time it's asked for, then kept).
+     * @param shape  data type of each field, in order
+     * @return       the codec (owned by RowCodec)
+     */
+    static const RowCodec *get(const Shape &shape);
+
+    /**
+     * The codec for the given columns' data types.
+     */
+    static const RowCodec *get(const ColumnAttributes &column_attributes);
+
+    virtual ~RowCodec() {}
+
+    RowCodec(const RowCodec &other) = delete;
+
+    RowCodec &operator=(const RowCodec &other) = delete;
+
+    /**
+     * Number of fields in each record.
+     */
+    virtual uint size() const { return (uint) this->steps.size(); }
+
+    /**
+     * Marshal values into a buffer.
+     * @param values  one value per field, in order (any of them may be NULL)
+     * @param bytes   where to put the record
+     * @param limit   size of bytes
+     * @return        bytes used, or 0 if the record doesn't fit in limit
+     */
+    virtual u_int32_t encode(const Value *const *values, char *bytes, u_int32_t limit) const;
+
+    /**
+     * Unmarshal a record.
+     * @param bytes  the record
+     * @param row    where to put the values (resized to one per field; its storage is reused)
+     * @param views  if true, longer text values are views of bytes rather than copies
+     */
+    virtual void decode(const char *bytes, Tuple &row, bool views) const;
+
+    /**
+     * Unmarshal just one field of a record.
+     * @param bytes  the record
+     * @param i      which field
+     * @param value  where to put it
+     * @param views  if true, longer text is a view of bytes rather than a copy
+     */
+    void decode_field(const char *bytes, uint i, Value &value, bool views) const {
+        const Step &step = this->steps[i];
+        if (bytes[i >> 3] & (1 << (i & 7)))
+            value.set_null(step.data_type);
+        else
+            step.decode(bytes, step.slot, value, views);
+    }
+
+    /**
+     * Is one field of a record NULL?
+     */
+    bool is_null(const char *bytes, uint i) const {
+        return (bytes[i >> 3] & (1 << (i & 7))) != 0;
+    }
+
+    /**
+     * Where a (non-NULL) TEXT field's characters are in a record, without making a Value of them.
+     * @param bytes  the record
+     * @param i      which field (must be TEXT)
+     * @param size   set to its length
+     * @return       its characters (in bytes)
+     */
+    const char *text_field(const char *bytes, uint i, u_int32_t &size) const {
+        uint16_t bounds[2];
+        memcpy(bounds, bytes + this->steps[i].slot, sizeof(bounds));
+        size = (u_int32_t) (bounds[1] - bounds[0]);
+        return bytes + bounds[0];
+    }
+
+protected:
+    typedef void (*Decoder)(const char *record, u_int32_t slot, Value &value, bool views);
+    typedef bool (*Encoder)(const Value &value, char *record, u_int32_t slot, u_int32_t &end, u_int32_t limit);
+
+    struct Step {
+        Decoder decode;
+        Encoder encode;
+        u_int32_t slot;  // offset in the record of the field (or of its offset table entry)
+        ColumnAttribute::DataType data_type;
+    };
+    std::vector<Step> steps;
+    u_int32_t bitmap_size;  // bytes of null bitmap
+    u_int32_t fixed_size;   // bytes up to the payloads (or of the whole record if there's no TEXT)
+    u_int32_t table_end;    // offset of the offset table's last entry (if there's any TEXT)
+    bool has_text;
+
+    RowCodec(const Shape &shape);
+
+    bool any_null(const char *bytes) const;
+};
+
+/**
+ * @class FixedRowCodec - codec for records with only fixed-width fields (INT and BOOLEAN)
+ */
+class FixedRowCodec : public RowCodec {
+public:
+    virtual u_int32_t encode(const Value *const *values, char *bytes, u_int32_t limit) const;
+
+    virtual void decode(const char *bytes, Tuple &row, bool views) const;
+
+protected:
+    FixedRowCodec(const Shape &shape) : RowCodec(shape) {}
+
+    friend class RowCodec;
+};
+
+/**
+ * @class IntRowCodec - codec for records of only INTs
+ */
+class IntRowCodec : public FixedRowCodec {
+public:
+    virtual void decode(const char *bytes, Tuple &row, bool views) const;
+
+protected:
+    IntRowCodec(const Shape &shape) : FixedRowCodec(shape) {}
+
+    friend class RowCodec;
+};
@@ -4,9 +4,14 @@
  * @author Keerthana Thonupunuri
  * @see "Seattle University, CPSC5300, Spring 2022"
  */
+#include <algorithm>
+#include <set>
 #include "SQLExec.h"
 #include "ParseTreeToString.h"
 #include "EvalPlan.h"
+#include "HashJoin.h"
+#include "MergeJoin.h"
+#include "ExternalSort.h"
 
 using namespace std;
 using namespace hsql;
@@ -14,6 +19,7 @@ using namespace hsql;
 // define static data
 Tables *SQLExec::tables = nullptr;
 Indices *SQLExec::indices = nullptr;
+Arena SQLExec::statement_arena;
 
 // make query result be printable
 ostream &operator<<(ostream &out, const QueryResult &qres)
@@ -29,16 +35,20 @@ ostream &operator<<(ostream &out, const QueryResult &qres)
         out << endl;
         for (auto const &row : *qres.rows)
         {
-            for (auto const &column_name : *qres.column_names)
+            for (auto const &value : *row)
             {
-                Value value = row->at(column_name);
+                if (value.is_null())
+                {
+                    out << "NULL ";
+                    continue;
+                }
                 switch (value.data_type)
                 {
                 case ColumnAttribute::INT:
                     out << value.n;
                     break;
                 case ColumnAttribute::TEXT:
-                    out << "\"" << value.s << "\"";
+                    out << "\"" << value.s() << "\"";
                     break;
                 case ColumnAttribute::BOOLEAN:
                     out << (value.n == 1 ? "true" : "false");
@@ -59,10 +69,13 @@ QueryResult::~QueryResult()
 {
     delete column_names;
     delete column_attributes;
+    if (rows != nullptr)
+        for (auto const &row : *rows)
+            delete row;
     delete rows;
 }
 
-QueryResult *SQLExec::execute(const SQLStatement *statement)
+QueryResult *SQLExec::execute(const SQLStatement *statement, Identifier storage_engine, uint insert_rows)
 {
     // initialize _tables table, if not yet present
     if (SQLExec::tables == nullptr)
@@ -76,23 +89,43 @@ QueryResult *SQLExec::execute(const SQLStatement *statement)
 
     try
     {
+        // the handles, plans, etc. a statement makes along the way all go back in one reset when it's done
+        ArenaScope scope(SQLExec::statement_arena);
+        QueryResult *result;
         switch (statement->type())
         {
         case kStmtCreate:
-            return create((const CreateStatement *)statement);
+            result = create((const CreateStatement *)statement, storage_engine);
+            break;
         case kStmtDrop:
-            return drop((const DropStatement *)statement);
+            result = drop((const DropStatement *)statement);
+            break;
         case kStmtShow:
-            return show((const ShowStatement *)statement);
+            result = show((const ShowStatement *)statement);
+            break;
         case kStmtInsert:
-            return insert((const InsertStatement *) statement);
+            result = insert((const InsertStatement *) statement, insert_rows);
+            break;
+        case kStmtImport:
+            result = import((const ImportStatement *) statement);
+            break;
         case kStmtDelete:
-            return del((const DeleteStatement *) statement);
+            result = del((const DeleteStatement *) statement);
+            break;
+        case kStmtUpdate:
+            result = update((const UpdateStatement *) statement);
+            break;
         case kStmtSelect:
-            return select((const SelectStatement *) statement);
+            result = select((const SelectStatement *) statement);
+            break;
         default:
             return new QueryResult("not implemented");
         }
+        // every statement is its own transaction, so this is where it commits
+        HeapFile::checkpoint();
+        MmapFile::checkpoint();
+        ZoneMap::checkpoint();
+        return result;
     }
     catch (DbRelationError &e)
     {
@@ -108,7 +141,22 @@ ColumnAttribute get_column_type(string column, ColumnNames columns, ColumnAttrib
     throw SQLExecError("unkown column " + column);
 }
 
-QueryResult *SQLExec::insert(const InsertStatement *statement) {
+Value get_value(const Expr *expr, ColumnAttribute column_type) {
+    switch(column_type.get_data_type()) {
+        case ColumnAttribute::INT:
+            if (expr->type != kExprLiteralInt)
+                throw SQLExecError("an INT column needs an integer value");
+            return Value(expr->ival);
+        case ColumnAttribute::TEXT:
+            if (expr->type != kExprLiteralString)
+                throw SQLExecError("a TEXT column needs a string value");
+            return Value(expr->name);
+        default:
+            throw SQLExecError("don't know how to handle data type in INSERT");
+    }
+}
+
+QueryResult *SQLExec::insert(const InsertStatement *statement, uint rows) {
     Identifier table_name = statement->tableName;
     DbRelation &table = SQLExec::tables->get_table(table_name);
     ColumnNames insert_columns;
@@ -120,38 +168,47 @@ QueryResult *SQLExec::insert(const InsertStatement *statement) {
         insert_columns = table.get_column_names();
     }
     std::vector<Expr*> insert_values = *statement->values;
+    if (insert_values.size() != rows * insert_columns.size())
+        throw SQLExecError("each row needs a value for each of the " + to_string(insert_columns.size()) + " columns");
 
-    ValueDict row;
+    // look up each column's type once, not once per row
     ColumnNames columns = table.get_column_names();
     ColumnAttributes column_types = table.get_column_attributes();
-    for(uint i = 0; i < insert_values.size(); i++) {
-        Identifier column = insert_columns[i];
-        ColumnAttribute column_type = get_column_type(column, columns, column_types);
-
-        switch(column_type.get_data_type()) {
-            case ColumnAttribute::INT:
-                row[column] = Value(insert_values[i]->ival);
-                break;
-            case ColumnAttribute::TEXT:
-                row[column] = Value(insert_values[i]->name);
-                break;
-            default:
-                throw SQLExecError("don't know how to handle data type in INSERT");
+    ColumnAttributes insert_types;
+    for (auto const &column: insert_columns)
+        insert_types.push_back(get_column_type(column, columns, column_types));
+
+    ValueDicts batch;
+    Handles *insert_handles;
+    try {
+        for (uint r = 0; r < rows; r++) {
+            batch.push_back(new ValueDict());
+            for (uint i = 0; i < insert_columns.size(); i++)
+                (*batch.back())[insert_columns[i]] = get_value(insert_values[r * insert_columns.size() + i],
+                                                               insert_types[i]);
         }
+        insert_handles = table.insert(&batch);
+    } catch (...) {
+        for (auto const &row: batch)
+            delete row;
+        throw;
     }
-    Handle insert_handle = table.insert(&row);
+    for (auto const &row: batch)
+        delete row;
 
     IndexNames index_names = SQLExec::indices->get_index_names(table_name);
     for(const auto index_name : index_names) {
         DbIndex &index = SQLExec::indices->get_index(table_name, index_name);
-        index.insert(insert_handle);
+        index.insert(insert_handles);
     }
+    delete insert_handles;
     string suffix = "";
     if(index_names.size() > 0) {
         suffix = " and " + to_string(index_names.size()) + " indices";
     }
 
-    return new QueryResult("successfully inserted 1 row into " + table_name + suffix);
+    return new QueryResult("successfully inserted " + to_string(rows) + (rows == 1 ? " row" : " rows") + " into "
+                           + table_name + suffix);
 }
 
 ValueDict* SQLExec::get_where_conjunction(const Expr *expr) {
@@ -179,6 +236,39 @@ ValueDict* SQLExec::get_where_conjunction(const Expr *expr) {
     return where;
 }
 
+QueryResult *SQLExec::import(const ImportStatement *statement) {
+    if (statement->type != ImportStatement::kImportCSV)
+        throw SQLExecError("only know how to import CSV files");
+    Identifier table_name = statement->tableName;
+    DbRelation &table = SQLExec::tables->get_table(table_name);
+    Handles *handles = table.copy_from(statement->filePath);
+
+    IndexNames index_names = SQLExec::indices->get_index_names(table_name);
+    for (auto const &index_name: index_names) {
+        DbIndex &index = SQLExec::indices->get_index(table_name, index_name);
+        index.insert(handles);
+    }
+    u_long rows = handles->size();
+    delete handles;
+    string suffix = "";
+    if (index_names.size() > 0)
+        suffix = " and " + to_string(index_names.size()) + " indices";
+    return new QueryResult("successfully copied " + to_string(rows) + " rows from " + statement->filePath
+                           + " into " + table_name + suffix);
+}
+
+QueryResult *SQLExec::copy_to(Identifier table_name, string path) {
+    if (SQLExec::tables == nullptr)
+        SQLExec::tables = new Tables();
+    try {
+        DbRelation &table = SQLExec::tables->get_table(table_name);
+        u_long rows = table.copy_to(path);
+        return new QueryResult("successfully copied " + to_string(rows) + " rows from " + table_name + " to " + path);
+    } catch (DbRelationError &e) {
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    }
+}
+
 QueryResult *SQLExec::del(const DeleteStatement *statement) {
     Identifier tableName = statement->tableName;
     DbRelation &table = SQLExec::tables->get_table(tableName);
@@ -206,8 +296,166 @@ QueryResult *SQLExec::del(const DeleteStatement *statement) {
     return new QueryResult("successfully deleted " + to_string(rows) + " rows from " + tableName + " " + to_string(indices) + " indices");
 }
 
+/**
+ * Execute: UPDATE <table_name> SET <column> = <value>, ... [WHERE <conjunction>]
+ * Rows keep their handles (see HeapTable::update), so an index is only touched for the rows
+ * whose key columns actually change.
+ * @return the number of rows updated
+ */
+QueryResult *SQLExec::update(const UpdateStatement *statement) {
+    Identifier table_name = statement->table->name;
+    DbRelation &table = SQLExec::tables->get_table(table_name);
+    ColumnNames columns = table.get_column_names();
+    ColumnAttributes column_types = table.get_column_attributes();
+    ValueDict new_values;
+    for (auto const &clause: *statement->updates) {
+        Identifier column = clause->column;
+        new_values[column] = get_value(clause->value, get_column_type(column, columns, column_types));
+    }
+
+    EvalPlan *plan = new EvalPlan(table);
+    if (statement->where != nullptr)
+        plan = new EvalPlan(get_where_conjunction(statement->where), plan);
+    EvalPlan *optimized = plan->optimize();
+    delete plan;
+    EvalPipeline pipeline = optimized->pipeline();
+    delete optimized;
+    Handles *handles = pipeline.second;
+
+    // only the indices keyed on a column being set might need maintenance, so remember (by position) which
+    // of their key columns are being set and to what, and, for a unique index, what all of its key columns are
+    std::vector<DbIndex *> key_indices;
+    std::vector<Conjunction *> key_changes;
+    std::vector<ColumnNames> unique_keys;
+    ColumnNames all_columns;
+    ColumnOrdinals *all_ordinals = nullptr;
+    uint rows = 0, index_updates = 0;
+    try {
+        for (auto const &index_name: SQLExec::indices->get_index_names(table_name)) {
+            ColumnNames index_columns;
+            bool is_hash, is_unique;
+            SQLExec::indices->get_columns(table_name, index_name, index_columns, is_hash, is_unique);
+            ValueDict key_values;
+            for (auto const &column: index_columns) {
+                auto new_value = new_values.find(column);
+                if (new_value != new_values.end())
+                    key_values[column] = new_value->second;
+            }
+            if (!key_values.empty()) {
+                key_indices.push_back(&SQLExec::indices->get_index(table_name, index_name));
+                key_changes.push_back(table.get_conjunction(&key_values));
+                unique_keys.push_back(is_unique ? index_columns : ColumnNames());
+            }
+        }
+        all_ordinals = table.get_column_ordinals(&all_columns);
+
+        // work out which index entries every row's update changes before changing anything, so that a new key
+        // already in a unique index, or given to two of the rows, refuses the whole update rather than leaving
+        // it half done
+        std::vector<std::vector<DbIndex *>> changed(handles->size());
+        std::vector<std::set<Handle>> moved(key_indices.size());  // rows leaving their key in each index
+        std::vector<std::vector<Tuple>> new_keys(key_indices.size());
+        for (uint row = 0; row < handles->size() && !key_indices.empty(); row++) {
+            Tuple *old_row = table.project(handles->at(row), all_ordinals);
+            for (uint i = 0; i < key_indices.size(); i++) {
+                for (auto const &change: *key_changes[i]) {
+                    if (old_row->at(change.first) != change.second) {
+                        changed[row].push_back(key_indices[i]);
+                        break;
+                    }
+                }
+                if (unique_keys[i].empty() || changed[row].empty() || changed[row].back() != key_indices[i])
+                    continue;
+                moved[i].insert(handles->at(row));
+                Tuple key;
+                for (auto const &column: unique_keys[i]) {
+                    auto new_value = new_values.find(column);
+                    uint ordinal = std::find(all_columns.begin(), all_columns.end(), column) - all_columns.begin();
+                    key.push_back(new_value != new_values.end() ? new_value->second : old_row->at(ordinal));
+                }
+                new_keys[i].push_back(key);
+            }
+            delete old_row;
+        }
+        for (uint i = 0; i < key_indices.size(); i++) {
+            std::set<Tuple> seen;
+            for (auto const &key: new_keys[i]) {
+                bool taken = !seen.insert(key).second;
+                ValueDict key_dict;
+                for (uint k = 0; k < key.size() && !taken; k++)
+                    key_dict[unique_keys[i][k]] = key[k];
+                Handles *holders = taken ? nullptr : key_indices[i]->lookup(&key_dict);
+                for (uint h = 0; holders != nullptr && h < holders->size() && !taken; h++)
+                    taken = moved[i].find(holders->at(h)) == moved[i].end();
+                delete holders;
+                if (taken)
+                    throw SQLExecError("update would duplicate a key in a unique index on " + table_name);
+            }
+        }
+        table.check_update(handles, &new_values);
+
+        for (uint row = 0; row < handles->size(); row++) {
+            Handle handle = handles->at(row);
+            for (auto const &index: changed[row])
+                index->del(handle);
+            try {
+                table.update(handle, &new_values);
+            } catch (...) {
+                for (auto const &index: changed[row])
+                    index->insert(handle);  // the row still has its old values
+                throw;
+            }
+            for (auto const &index: changed[row])
+                index->insert(handle);
+            index_updates += changed[row].size();
+            rows++;
+        }
+    } catch (...) {
+        for (auto const &changes: key_changes)
+            delete changes;
+        delete all_ordinals;
+        delete handles;
+        throw;
+    }
+    for (auto const &changes: key_changes)
+        delete changes;
+    delete all_ordinals;
+    delete handles;
+    return new QueryResult("successfully updated " + to_string(rows) + " rows in " + table_name + " and " +
+                           to_string(index_updates) + " index entries");
+}
+
+// Put a Sort for the statement's ORDER BY (if it has one) on top of a plan.
+static EvalPlan *order_by(const SelectStatement *statement, EvalPlan *plan) {
+    if (statement->order == nullptr || statement->order->empty())
+        return plan;
+    OrderBy *order = new OrderBy();
+    for (auto const &description: *statement->order) {
+        const Expr *expr = description->expr;
+        if (expr->type != kExprColumnRef) {
+            delete order;
+            delete plan;
+            throw SQLExecError("only columns can be ordered by");
+        }
+        Identifier column = expr->table != nullptr ? string(expr->table) + "." + expr->name : string(expr->name);
+        order->push_back(make_pair(column, description->type == kOrderDesc));
+    }
+    return new EvalPlan(order, plan);
+}
+
+// Put a Limit over the plan if the statement has a LIMIT or an OFFSET.
+static EvalPlan *limit(const SelectStatement *statement, EvalPlan *plan) {
+    if (statement->limit == nullptr || (statement->limit->limit < 0 && statement->limit->offset <= 0))
+        return plan;
+    u_long rows = statement->limit->limit < 0 ? EvalPlan::NO_LIMIT : (u_long) statement->limit->limit;
+    u_long offset = statement->limit->offset < 0 ? 0 : (u_long) statement->limit->offset;
+    return new EvalPlan(rows, offset, plan);
+}
+
 QueryResult *SQLExec::select(const SelectStatement *statement)
 {
+    if (statement->fromTable->type != kTableName)
+        return select_join(statement);
     Identifier table_name = statement->fromTable->name;
     DbRelation& table = SQLExec::tables->get_table(table_name);
 
@@ -228,7 +476,7 @@ QueryResult *SQLExec::select(const SelectStatement *statement)
             return new QueryResult("Invalid expr");
     }
 
-    EvalPlan* plan = new EvalPlan(table);
+    EvalPlan* plan = new EvalPlan(table, statement->fromTable->alias != nullptr ? statement->fromTable->alias : "");
     ValueDict* where = new ValueDict;
 
     if (statement->whereClause != NULL)
@@ -236,16 +484,188 @@ QueryResult *SQLExec::select(const SelectStatement *statement)
         where = get_where_conjunction(statement->whereClause);
         plan = new EvalPlan(where, plan);
     }
+    plan = order_by(statement, plan);
+    plan = limit(statement, plan);
 
     plan = new EvalPlan(col_names, plan);
     EvalPlan* optimize = plan->optimize();
-    ValueDicts* rows = optimize->evaluate();
+    Tuples* rows = optimize->evaluate();
     delete where;
 
     ColumnAttributes* col_attr = table.get_column_attributes(*col_names);
     return new QueryResult(col_names, col_attr, rows, "successfully returned" + to_string(rows->size()) + " rows");
 }
 
+// Gather the tables of a FROM clause in order, and the ON clauses of its joins.
+static void join_tables(const TableRef *table_ref, vector<const TableRef *> &table_refs,
+                        vector<const Expr *> &conditions) {
+    switch (table_ref->type) {
+        case kTableName:
+            table_refs.push_back(table_ref);
+            break;
+        case kTableJoin:
+            if (table_ref->join->type != kJoinInner && table_ref->join->type != kJoinCross)
+                throw SQLExecError("only inner joins are supported");
+            join_tables(table_ref->join->left, table_refs, conditions);
+            join_tables(table_ref->join->right, table_refs, conditions);
+            if (table_ref->join->condition != nullptr)
+                conditions.push_back(table_ref->join->condition);
+            break;
+        case kTableCrossProduct:
+            for (auto const &listed: *table_ref->list)
+                join_tables(listed, table_refs, conditions);
+            break;
+        default:
+            throw SQLExecError("subqueries are not supported");
+    }
+}
+
+// Break an AND of equalities into the equalities.
+static void equalities(const Expr *expr, vector<const Expr *> &out) {
+    if (expr->type == kExprOperator && expr->opType == Expr::AND) {
+        equalities(expr->expr, out);
+        equalities(expr->expr2, out);
+    } else if (expr->type == kExprOperator && expr->opChar == '=') {
+        out.push_back(expr);
+    } else {
+        throw SQLExecError("only ANDs of equalities are supported in a join");
+    }
+}
+
+// Which of the tables a column reference is to: the one it's qualified with, or else the only one with the column.
+static uint column_table(const Expr *column, const vector<Identifier> &aliases, const vector<DbRelation *> &tables) {
+    int found = -1;
+    for (uint i = 0; i < tables.size(); i++) {
+        if (column->table != nullptr && aliases[i] != column->table)
+            continue;
+        const ColumnNames &names = tables[i]->get_column_names();
+        if (find(names.begin(), names.end(), Identifier(column->name)) == names.end())
+            continue;
+        if (found >= 0)
+            throw SQLExecError(string("column ") + column->name + " is ambiguous");
+        found = (int) i;
+    }
+    if (found < 0)
+        throw SQLExecError(string("unknown column ") + (column->table != nullptr ? string(column->table) + "." : "")
+                           + column->name);
+    return (uint) found;
+}
+
+/**
+ * SELECT from more than one table, as t1 JOIN t2 ON ... or t1, t2 WHERE .... The ON and WHERE clauses have to
+ * be ANDs of equalities. A column = a literal is checked as its table is scanned, and a column = a column of
+ * another table is a join condition. The tables are joined left to right, each on the conditions between it and
+ * the ones before it (the planner picks how, and may probe a B-tree index on the table; see EvalPlan::optimize).
+ * @param statement  the SELECT
+ * @return           the joined rows, with columns named table.column (or alias.column) for a *
+ */
+QueryResult *SQLExec::select_join(const SelectStatement *statement) {
+    vector<const TableRef *> table_refs;
+    vector<const Expr *> conditions;
+    join_tables(statement->fromTable, table_refs, conditions);
+    if (statement->whereClause != nullptr)
+        conditions.push_back(statement->whereClause);
+    vector<const Expr *> equals;
+    for (auto const &condition: conditions)
+        equalities(condition, equals);
+
+    vector<Identifier> aliases;
+    vector<DbRelation *> tables;
+    vector<ValueDict> wheres(table_refs.size());
+    for (auto const &table_ref: table_refs) {
+        aliases.push_back(table_ref->alias != nullptr ? table_ref->alias : table_ref->name);
+        tables.push_back(&SQLExec::tables->get_table(table_ref->name));
+    }
+    vector<pair<uint, uint>> joined_tables;  // for each join condition, its two tables, the later one second
+    vector<pair<Identifier, Identifier>> joined_columns;  // and its columns, as alias.column
+    for (auto const &equal: equals) {
+        const Expr *left = equal->expr, *right = equal->expr2;
+        if (left->type != kExprColumnRef)
+            swap(left, right);
+        if (left->type != kExprColumnRef)
+            throw SQLExecError("an equality in a join has to have a column in it");
+        uint left_table = column_table(left, aliases, tables);
+        if (right->type == kExprLiteralInt) {
+            wheres[left_table][left->name] = Value(int32_t(right->ival));
+        } else if (right->type == kExprLiteralString) {
+            wheres[left_table][left->name] = Value(right->name);
+        } else if (right->type == kExprColumnRef) {
+            uint right_table = column_table(right, aliases, tables);
+            if (left_table == right_table)
+                throw SQLExecError("can't compare two columns of one table");
+            Identifier left_column = aliases[left_table] + "." + left->name;
+            Identifier right_column = aliases[right_table] + "." + right->name;
+            if (left_table > right_table) {
+                swap(left_table, right_table);
+                swap(left_column, right_column);
+            }
+            joined_tables.push_back(make_pair(left_table, right_table));
+            joined_columns.push_back(make_pair(left_column, right_column));
+        } else {
+            throw SQLExecError("only columns and literals can be compared in a join");
+        }
+    }
+
+    EvalPlan *plan = nullptr;
+    for (uint i = 0; i < tables.size(); i++) {
+        EvalPlan *scan = new EvalPlan(*tables[i], aliases[i]);
+        for (auto const &index_name: SQLExec::indices->get_index_names(table_refs[i]->name)) {
+            ColumnNames index_columns;
+            bool is_hash, is_unique;
+            SQLExec::indices->get_columns(table_refs[i]->name, index_name, index_columns, is_hash, is_unique);
+            if (!is_hash)  // only B-trees can be looked up in so far
+                scan->add_index(SQLExec::indices->get_index(table_refs[i]->name, index_name));
+        }
+        if (!wheres[i].empty())
+            scan = new EvalPlan(new ValueDict(wheres[i]), scan);
+        if (plan == nullptr) {
+            plan = scan;
+            continue;
+        }
+        ColumnNames *left_keys = new ColumnNames(), *right_keys = new ColumnNames();
+        for (uint j = 0; j < joined_tables.size(); j++) {
+            if (joined_tables[j].second == i) {
+                left_keys->push_back(joined_columns[j].first);
+                right_keys->push_back(joined_columns[j].second);
+            }
+        }
+        if (left_keys->empty()) {
+            delete left_keys;
+            delete right_keys;
+            delete scan;
+            delete plan;
+            throw SQLExecError("no join condition for " + aliases[i] + " (cross products are not supported)");
+        }
+        plan = new EvalPlan(plan, scan, left_keys, right_keys);
+    }
+
+    ColumnNames *column_names = new ColumnNames();
+    ColumnAttributes *column_attributes = new ColumnAttributes();
+    for (auto const &expr: *statement->selectList) {
+        if (expr->type == kExprStar) {
+            plan->get_columns(*column_names, *column_attributes);
+            column_attributes->clear();
+        } else if (expr->type == kExprColumnRef) {
+            column_names->push_back(expr->table != nullptr ? string(expr->table) + "." + expr->name : expr->name);
+        } else {
+            delete column_names;
+            delete column_attributes;
+            return new QueryResult("Invalid expr");
+        }
+    }
+    plan = order_by(statement, plan);
+    plan = limit(statement, plan);
+    plan = new EvalPlan(new ColumnNames(*column_names), plan);
+    EvalPlan *optimized = plan->optimize();
+    delete plan;
+    Tuples *rows = optimized->evaluate();
+    ColumnNames names;
+    optimized->get_columns(names, *column_attributes);
+    delete optimized;
+    return new QueryResult(column_names, column_attributes, rows,
+                           "successfully returned " + to_string(rows->size()) + " rows");
+}
+
 void SQLExec::column_definition(const ColumnDefinition *col, Identifier &column_name, ColumnAttribute &column_attribute)
 {
     column_name = col->name;
@@ -264,12 +684,12 @@ void SQLExec::column_definition(const ColumnDefinition *col, Identifier &column_
     }
 }
 
-QueryResult *SQLExec::create(const CreateStatement *statement)
+QueryResult *SQLExec::create(const CreateStatement *statement, Identifier storage_engine)
 {
     switch (statement->type)
     {
         case CreateStatement::kTable:
-            return create_table(statement);
+            return create_table(statement, storage_engine);
         case CreateStatement::kIndex:
             return create_index(statement);
         default:
@@ -284,13 +704,14 @@ QueryResult *SQLExec::create(const CreateStatement *statement)
  * 
  */
 
-QueryResult *SQLExec::create_table(const CreateStatement *statement)
+QueryResult *SQLExec::create_table(const CreateStatement *statement, Identifier storage_engine)
 {
     // get table and columns from the sql statement
     Identifier table_name = statement->tableName;
     // add table name to Tables
     ValueDict row;
     row["table_name"] = Value(table_name);
+    row["storage_engine"] = Value(storage_engine);
     Handle tableHandle = SQLExec::tables->insert(&row);
     // add columns to Column
     Handles columnHandles;
@@ -417,17 +838,19 @@ QueryResult *SQLExec::show_tables()
 {
     ColumnNames *column_names = new ColumnNames;
     ColumnAttributes *column_attributes = new ColumnAttributes;
-    ValueDicts *rows = new ValueDicts();
+    Tuples *rows = new Tuples();
     // tables will only have one column name, which is table_name
     // // attributes will always be TEXT
     SQLExec::tables->get_columns("_tables", *column_names, *column_attributes);
+    ColumnOrdinals *ordinals = SQLExec::tables->get_column_ordinals(column_names);
+    uint table_name_at = (uint) (find(column_names->begin(), column_names->end(), "table_name") - column_names->begin());
     // use select to get all entries from that table
     Handles *selectResult = SQLExec::tables->select();
     // use project to get all entries from column "table_name"
     for(const Handle handle : *selectResult) {
-        ValueDict *row = SQLExec::tables->project(handle, column_names);
+        Tuple *row = SQLExec::tables->project(handle, ordinals);
         // "_tables" and "_columns" is in the list too, filter out
-        Identifier column_name = row->at("table_name").s;
+        Identifier column_name = row->at(table_name_at).s();
         if (column_name != Tables::TABLE_NAME && column_name != Columns::TABLE_NAME && column_name != Indices::TABLE_NAME){
             rows->push_back(row);
         }
@@ -436,6 +859,7 @@ QueryResult *SQLExec::show_tables()
         }
     }
     delete selectResult;
+    delete ordinals;
     // message should contain the number of records returned.
     string message = "successfully returned " + to_string(rows->size()) + " rows";
     return new QueryResult(column_names, column_attributes, rows, message);
@@ -459,10 +883,10 @@ QueryResult *SQLExec::show_columns(const ShowStatement *statement)
     // The middle ColumnAttribute is Class type. The third one is DataType
     column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
 
-    // First ValueDicts to store the data
-    ValueDicts *rows = new ValueDicts();
+    // First Tuples to store the data
+    Tuples *rows = new Tuples();
 
-    // Second ValueDicts to locate the table
+    // Second ValueDict to locate the table
     ValueDict where;
     where["table_name"] = Value(statement->tableName);
 
@@ -471,13 +895,15 @@ QueryResult *SQLExec::show_columns(const ShowStatement *statement)
     int count = handles->size();
 
     // Check not in schema_tables.SCHEMA_TABLES
+    DbRelation &table = SQLExec::tables->get_table(Columns::TABLE_NAME);
+    ColumnOrdinals *ordinals = table.get_column_ordinals(column_names);
     for (auto const &handle : *handles)
     {
-        DbRelation &table = SQLExec::tables->get_table(Columns::TABLE_NAME);
-        ValueDict *row = table.project(handle, column_names);
+        Tuple *row = table.project(handle, ordinals);
         rows->push_back(row);
     }
 
+    delete ordinals;
     delete handles;
     return new QueryResult(column_names, column_attributes, rows, " successfully returned " + to_string(count) + " rows");
 }
@@ -516,12 +942,14 @@ QueryResult *SQLExec::show_index(const ShowStatement *statement) {
     Handles *handles = SQLExec::indices->select(&where);
     u_long n = handles->size();
 
-    ValueDicts *rows = new ValueDicts;
+    Tuples *rows = new Tuples;
+    ColumnOrdinals *ordinals = SQLExec::indices->get_column_ordinals(column_names);
     for (auto const &handle : *handles)
     {
-        ValueDict *row = SQLExec::indices->project(handle, column_names);
+        Tuple *row = SQLExec::indices->project(handle, ordinals);
         rows->push_back(row);
     }
+    delete ordinals;
     delete handles;
     return new QueryResult(column_names, column_attributes, rows,
                            "successfully returned " + to_string(n) + " rows");
@@ -635,6 +1063,7 @@ QueryResult *parser_helper(string query) {
         } catch (SQLExecError &e) {
                 delete parse;
                 cout << "Error: " << e.what() << endl;
+                return nullptr;
             }
         }
     }
@@ -653,7 +1082,7 @@ bool test_table_functionality() {
     string drop_tables = "drop table foo";
     // verify show tables when no tables return 0 rows
     QueryResult *qr_show_no_tables = parser_helper(show_tables);
-    ValueDicts *show_no_tables_rows = qr_show_no_tables->get_rows();
+    Tuples *show_no_tables_rows = qr_show_no_tables->get_rows();
     if (show_no_tables_rows->size() != 0) {
         delete qr_show_no_tables;
         return false;
@@ -663,7 +1092,7 @@ bool test_table_functionality() {
     // verify create table works, show tables will return 1 row
     QueryResult *qr_create_table = parser_helper(create_table);
     QueryResult *qr_show_tables = parser_helper(show_tables);
-    ValueDicts *show_tables_rows = qr_show_tables->get_rows();
+    Tuples *show_tables_rows = qr_show_tables->get_rows();
     if (show_tables_rows->size() != 1) {
         delete qr_create_table;
         delete qr_show_tables;
@@ -674,17 +1103,26 @@ bool test_table_functionality() {
     cout << "create table ok" << endl;
     // verify show columns works, returns 5 rows for foo
     QueryResult *qr_show_columns = parser_helper(show_columns);
-    ValueDicts *show_columns_rows = qr_show_columns->get_rows();
+    Tuples *show_columns_rows = qr_show_columns->get_rows();
     if (show_columns_rows->size() != 5) {
         delete qr_show_columns;
         return false;
     }
     delete qr_show_columns;
     cout << "show columns ok" << endl;
+    // verify a value of the wrong kind for its column is refused, not inserted
+    bool refused = parser_helper("insert into foo values ('1', 'one', 1, 1, 1)") == nullptr;
+    refused = refused && parser_helper("insert into foo (id, data) values (1, 1)") == nullptr;
+    QueryResult *qr_rows = parser_helper("select * from foo");
+    refused = refused && qr_rows != nullptr && qr_rows->get_rows()->size() == 0;
+    delete qr_rows;
+    if (!refused)
+        return false;
+    cout << "insert type check ok" << endl;
     // verify drop table works, show tables will return 0 rows
     QueryResult *qr_drop_table = parser_helper(drop_tables);
     QueryResult *qr_show_tables_drop = parser_helper(show_tables);
-    ValueDicts *show_tables_drop_rows = qr_show_tables_drop->get_rows();
+    Tuples *show_tables_drop_rows = qr_show_tables_drop->get_rows();
     if (show_tables_drop_rows->size() != 0) {
         delete qr_drop_table;
         delete qr_show_tables_drop;
@@ -711,7 +1149,7 @@ bool test_index_functionality() {
     QueryResult *qr_create_table = parser_helper(create_table);
     // verify show indices when no indices return 0 rows
     QueryResult *qr_show_no_indice = parser_helper(show_index);
-    ValueDicts *show_no_indice_rows = qr_show_no_indice->get_rows();
+    Tuples *show_no_indice_rows = qr_show_no_indice->get_rows();
     if (show_no_indice_rows->size() != 0) {
          delete qr_show_no_indice;
         delete qr_create_table;
@@ -723,7 +1161,7 @@ bool test_index_functionality() {
     // verify create indix works, show index will return 1 row
     QueryResult *qr_create_index = parser_helper(create_index);
     QueryResult *qr_show_index = parser_helper(show_index);
-    ValueDicts *show_index_rows = qr_show_index->get_rows();
+    Tuples *show_index_rows = qr_show_index->get_rows();
     if (show_index_rows->size() != 2) {
         delete qr_create_index;
         delete qr_show_index;
@@ -735,7 +1173,7 @@ bool test_index_functionality() {
     // verify drop index works, show index will return 0 rows
     QueryResult *qr_drop_index = parser_helper(drop_index);
     QueryResult *qr_show_index_drop = parser_helper(show_index);
-    ValueDicts *show_index_drop_rows = qr_show_index_drop->get_rows();
+    Tuples *show_index_drop_rows = qr_show_index_drop->get_rows();
     if (show_index_drop_rows->size() != 0) {
         delete qr_drop_index;
         delete qr_show_index_drop;
@@ -744,6 +1182,31 @@ bool test_index_functionality() {
     delete qr_drop_index;
     delete qr_show_index_drop;
     cout << "drop index ok" << endl;
+    // an update that would give a unique index the same key twice is refused before any row or index entry is
+    // changed, though a key that another row of the same update is leaving may be taken
+    for (int i = 1; i <= 3; i++)
+        delete parser_helper("insert into test values (" + to_string(i) + ", " + to_string(i) + ", " + to_string(i)
+                             + ")");
+    delete parser_helper("create index fu on test (x)");
+    bool refused = parser_helper("update test set x = 2 where z = 1") == nullptr;
+    refused = refused && parser_helper("update test set x = 9") == nullptr;
+    QueryResult *qr_moved = parser_helper("update test set x = 4 where z = 3");
+    bool moved = qr_moved != nullptr;
+    delete qr_moved;
+    refused = refused && parser_helper("update test set x = 1 where z = 2") == nullptr;
+    qr_moved = parser_helper("update test set x = 3 where z = 2");
+    moved = moved && qr_moved != nullptr;
+    delete qr_moved;
+    QueryResult *qr_rows = parser_helper("select x from test");
+    bool unchanged = qr_rows != nullptr && qr_rows->get_rows()->size() == 3;
+    for (uint i = 0; unchanged && i < 3; i++)
+        unchanged = qr_rows->get_rows()->at(i)->at(0).n == (i == 0 ? 1 : (int32_t) i + 2);
+    delete qr_rows;
+    if (!refused || !moved || !unchanged) {
+        cout << "unique update failed" << endl;
+        return false;
+    }
+    cout << "unique update ok" << endl;
     // delete table for testing
     QueryResult *qr_drop_table = parser_helper(drop_tables);
     delete qr_drop_table;
@@ -751,6 +1214,149 @@ bool test_index_functionality() {
     return true;
 }
 
+/**
+ * Testing function for joins: a join with a condition on one side, one written as a cross product with a WHERE
+ * clause, and the same again with a memory budget small enough that the join has to spill.
+ * @return true if the tests all succeeded
+ */
+bool test_join_functionality() {
+    delete parser_helper("create table jc (id int, name text)");
+    delete parser_helper("create table jo (oid int, cid int, item text)");
+    for (int i = 1; i <= 50; i++)
+        delete parser_helper("insert into jc values (" + to_string(i) + ", 'cust" + to_string(i) + "')");
+    for (int i = 1; i <= 600; i++)
+        delete parser_helper("insert into jo values (" + to_string(i) + ", " + to_string(i % 60) + ", 'item"
+                             + to_string(i) + "')");
+    bool ok = true;
+    QueryResult *result = parser_helper("select name, item from jc join jo on jc.id = jo.cid where oid = 77");
+    ok = result != nullptr && result->get_rows()->size() == 1 && result->get_rows()->at(0)->at(0).s() == "cust17"
+         && result->get_rows()->at(0)->at(1).s() == "item77";
+    delete result;
+    size_t budget = EvalPlan::join_memory;
+    for (int pass = 0; pass < 2 && ok; pass++) {
+        EvalPlan::join_memory = pass == 0 ? budget : 1000;
+        result = parser_helper("select * from jc, jo where id = cid");
+        ok = result != nullptr && result->get_rows()->size() == 500 && result->get_column_names()->size() == 5;
+        for (uint i = 0; ok && i < result->get_rows()->size(); i++) {
+            const Tuple &row = *result->get_rows()->at(i);
+            ok = row[0] == row[3] && row[1].s() == "cust" + to_string(row[0].n);
+        }
+        delete result;
+    }
+    EvalPlan::join_memory = budget;
+    result = parser_helper("select * from jc, jo");  // a cross product is refused before any join is planned
+    ok = ok && result == nullptr;
+    // few enough jc rows to look each up in an index on jo.oid (the join on cid too is checked on the rows found)
+    delete parser_helper("create index jo_oid on jo (oid)");
+    result = parser_helper("select name, item from jc join jo on jc.id = jo.oid and jc.id = jo.cid where jc.id = 7");
+    ok = ok && result != nullptr && result->get_rows()->size() == 1 && result->get_rows()->at(0)->at(0).s() == "cust7"
+         && result->get_rows()->at(0)->at(1).s() == "item7";
+    delete result;
+    result = parser_helper("select item from jc join jo on jc.id = jo.oid where jc.id = 7 and item = 'item8'");
+    ok = ok && result != nullptr && result->get_rows()->empty();
+    delete result;
+    // both indexed on the join columns, so merged in index order
+    delete parser_helper("create index jc_id on jc (id)");
+    result = parser_helper("select * from jc join jo on jc.id = jo.oid");
+    ok = ok && result != nullptr && result->get_rows()->size() == 50;
+    for (uint i = 0; ok && i < result->get_rows()->size(); i++) {
+        const Tuple &row = *result->get_rows()->at(i);
+        ok = row[0] == row[2] && row[0] == Value((int) i + 1) && row[4].s() == "item" + to_string(row[0].n);
+    }
+    delete result;
+    delete parser_helper("drop table jc");
+    delete parser_helper("drop table jo");
+    if (ok)
+        cout << "join ok" << endl;
+    return ok;
+}
+
+/**
+ * Test ORDER BY: on one column and on two, ascending and descending, with a join, and with a sort memory budget
+ * small enough to spill sorted runs; and LIMIT and OFFSET, with an ORDER BY and without.
+ * @return true if the tests all succeeded
+ */
+bool test_order_functionality() {
+    delete parser_helper("create table so (id int, grp int, name text)");
+    for (int i = 0; i < 300; i++)
+        delete parser_helper("insert into so values (" + to_string((i * 37) % 300) + ", " + to_string(i % 7)
+                             + ", 'n" + to_string(i % 11) + "')");
+    delete parser_helper("create table sg (gid int, label text)");
+    for (int i = 0; i < 7; i++)
+        delete parser_helper("insert into sg values (" + to_string(i) + ", 'g" + to_string(i) + "')");
+    bool ok = true;
+    size_t budget = EvalPlan::sort_memory;
+    for (int pass = 0; pass < 2 && ok; pass++) {
+        EvalPlan::sort_memory = pass == 0 ? budget : 2000;
+        QueryResult *result = parser_helper("select id from so order by id desc");
+        ok = result != nullptr && result->get_rows()->size() == 300;
+        for (uint i = 0; ok && i < 300; i++)
+            ok = result->get_rows()->at(i)->at(0) == Value(299 - (int) i);
+        delete result;
+        result = parser_helper("select grp, name, id from so order by grp, name desc");
+        ok = ok && result != nullptr && result->get_rows()->size() == 300;
+        for (uint i = 1; ok && i < 300; i++) {
+            const Tuple &before = *result->get_rows()->at(i - 1), &row = *result->get_rows()->at(i);
+            ok = before[0] < row[0] || (before[0] == row[0] && !(before[1] < row[1]));
+        }
+        delete result;
+        result = parser_helper("select label, id from so join sg on so.grp = sg.gid order by label, so.id");
+        ok = ok && result != nullptr && result->get_rows()->size() == 300
+             && result->get_rows()->at(0)->at(0).s() == "g0" && result->get_rows()->at(299)->at(0).s() == "g6";
+        for (uint i = 1; ok && i < 300; i++) {
+            const Tuple &before = *result->get_rows()->at(i - 1), &row = *result->get_rows()->at(i);
+            ok = before[0] < row[0] || (before[0] == row[0] && before[1] < row[1]);
+        }
+        delete result;
+        result = parser_helper("select id from so order by id desc limit 10 offset 5");
+        ok = ok && result != nullptr && result->get_rows()->size() == 10;
+        for (uint i = 0; ok && i < 10; i++)
+            ok = result->get_rows()->at(i)->at(0) == Value(294 - (int) i);
+        delete result;
+        result = parser_helper("select label, id from so join sg on so.grp = sg.gid "
+                               "order by label desc, so.id limit 3");
+        ok = ok && result != nullptr && result->get_rows()->size() == 3 && result->get_rows()->at(2)->at(0).s() == "g6";
+        for (uint i = 1; ok && i < 3; i++)
+            ok = result->get_rows()->at(i - 1)->at(1) < result->get_rows()->at(i)->at(1);
+        delete result;
+    }
+    EvalPlan::sort_memory = budget;
+    const char *limits[] = {"select id from so limit 7", "select id from so limit 0", "select grp from so limit 500",
+                            "select id from so where grp = 3 limit 5 offset 40",
+                            "select id from so order by id limit 0"};
+    size_t sizes[] = {7, 0, 300, 3, 0};
+    for (uint i = 0; ok && i < 5; i++) {
+        QueryResult *result = parser_helper(limits[i]);
+        ok = result != nullptr && result->get_rows()->size() == sizes[i];
+        delete result;
+    }
+
+    // a LIMIT over a table scanned in many morsels at once hands back just its rows, however the morsels race
+    delete parser_helper("create table sl (id int, name text)");
+    ValueDicts rows;
+    for (int i = 0; i < 20000; i++) {
+        ValueDict *row = new ValueDict();
+        (*row)["id"] = Value(i);
+        (*row)["name"] = Value("row " + to_string(i));
+        rows.push_back(row);
+    }
+    delete Tables::get_table("sl").insert(&rows);
+    for (auto const &row: rows)
+        delete row;
+    for (int i = 0; ok && i < 50; i++) {
+        QueryResult *result = parser_helper(i % 2 == 0 ? "select id from sl limit 5"
+                                                       : "select id from sl limit 3 offset 2");
+        ok = result != nullptr && result->get_rows()->size() == (i % 2 == 0 ? 5U : 3U);
+        delete result;
+    }
+    delete parser_helper("drop table sl");
+    delete parser_helper("drop table so");
+    delete parser_helper("drop table sg");
+    if (ok)
+        cout << "order by ok" << endl;
+    return ok;
+}
+
 /**
  * Testing function for SQL Exec.
  * @return true if the tests all succeeded
@@ -764,5 +1370,16 @@ bool test_sql_exec() {
         return assertion_failure("_indices tests failed");
     cout << "_indices tests ok" << endl;
 
+    if (!test_hash_join())
+        return assertion_failure("hash join tests failed");
+    if (!test_merge_join())
+        return assertion_failure("merge join tests failed");
+    if (!test_join_functionality())
+        return assertion_failure("join tests failed");
+    if (!test_external_sort())
+        return assertion_failure("external sort tests failed");
+    if (!test_order_functionality())
+        return assertion_failure("order by tests failed");
+
     return true;
 }
\ No newline at end of file
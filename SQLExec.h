@@ -29,7 +29,7 @@ public:
     QueryResult(std::string message) : column_names(nullptr), column_attributes(nullptr), rows(nullptr),
                                        message(message) {}
 
-    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, ValueDicts *rows, std::string message)
+    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, Tuples *rows, std::string message)
             : column_names(column_names), column_attributes(column_attributes), rows(rows), message(message) {}
 
     virtual ~QueryResult();
@@ -38,7 +38,7 @@ public:
 
     ColumnAttributes *get_column_attributes() const { return column_attributes; }
 
-    ValueDicts *get_rows() const { return rows; }
+    Tuples *get_rows() const { return rows; }  // each row's values are in the order of column_names
 
     const std::string &get_message() const { return message; }
 
@@ -47,7 +47,7 @@ public:
 protected:
     ColumnNames *column_names;
     ColumnAttributes *column_attributes;
-    ValueDicts *rows;
+    Tuples *rows;
     std::string message;
 };
 
@@ -59,20 +59,35 @@ class SQLExec {
 public:
     /**
      * Execute the given SQL statement.
-     * @param statement   the Hyrise AST of the SQL statement to execute
+     * @param statement       the Hyrise AST of the SQL statement to execute
+     * @param storage_engine  where a CREATE TABLE keeps its rows ("HEAP" or "MMAP"); the Hyrise
+     *                        parser has no syntax for it, so the shell pulls it off the statement
+     * @param insert_rows     number of rows an INSERT's value list holds, one after the other; the Hyrise
+     *                        parser only takes one row, so the shell flattens VALUES (...), (...) into one list
+     * @returns               the query result (freed by caller)
+     */
+    static QueryResult *execute(const hsql::SQLStatement *statement, Identifier storage_engine = "HEAP",
+                                uint insert_rows = 1);
+
+    /**
+     * Execute COPY <table_name> TO '<path>', which the Hyrise parser has no statement for.
+     * (COPY <table_name> FROM '<path>' is the parser's IMPORT FROM CSV FILE '<path>' INTO <table_name>.)
+     * @param table_name  table to export
+     * @param path        CSV file to (over)write
      * @returns           the query result (freed by caller)
      */
-    static QueryResult *execute(const hsql::SQLStatement *statement);
+    static QueryResult *copy_to(Identifier table_name, std::string path);
 
 protected:
     // the one place in the system that holds the _tables and _indices tables
     static Tables *tables;
     static Indices *indices;
+    static Arena statement_arena;  // holds handles, plans, etc. while a statement runs
 
     // recursive decent into the AST
-    static QueryResult *create(const hsql::CreateStatement *statement);
+    static QueryResult *create(const hsql::CreateStatement *statement, Identifier storage_engine);
 
-    static QueryResult *create_table(const hsql::CreateStatement *statement);
+    static QueryResult *create_table(const hsql::CreateStatement *statement, Identifier storage_engine);
 
     static QueryResult *create_index(const hsql::CreateStatement *statement);
 
@@ -90,12 +105,18 @@ protected:
 
     static QueryResult *drop_index(const hsql::DropStatement *statement);
 
-    static QueryResult *insert(const hsql::InsertStatement *statement);
+    static QueryResult *insert(const hsql::InsertStatement *statement, uint rows);
+
+    static QueryResult *import(const hsql::ImportStatement *statement);
 
     static QueryResult *del(const hsql::DeleteStatement *statement);
 
+    static QueryResult *update(const hsql::UpdateStatement *statement);
+
     static QueryResult *select(const hsql::SelectStatement *statement);
 
+    static QueryResult *select_join(const hsql::SelectStatement *statement);
+
     static ValueDict* get_where_conjunction(const hsql::Expr *expr);
     /**
      * Pull out column name and attributes from AST's column definition clause
@@ -113,4 +134,8 @@ bool test_table_functionality();
 
 bool test_index_functionality();
 
+bool test_join_functionality();
+
+bool test_order_functionality();
+
 bool test_sql_exec();
@@ -0,0 +1,220 @@
+/**
+ * @file Scheduler.cpp - implementation of Scheduler and TaskGroup
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <iostream>
+#include <stdexcept>
+#include "Scheduler.h"
+
+using namespace std;
+
+unique_ptr<Scheduler> Scheduler::the_scheduler;
+once_flag Scheduler::started;
+thread_local const Scheduler *Scheduler::worker_of = nullptr;
+thread_local uint Scheduler::worker_index = 0;
+
+Scheduler::Scheduler(uint workers) : workers(), threads(), next(0), waiting(0), idle_mutex(), idle(),
+                                     stopping(false) {
+    if (workers == 0)
+        workers = 1;
+    for (uint i = 0; i < workers; i++)
+        this->workers.push_back(new Worker());
+    for (uint i = 0; i < workers; i++)
+        this->threads.push_back(thread(&Scheduler::work, this, i));
+}
+
+Scheduler::~Scheduler() {
+    {
+        lock_guard<mutex> lock(this->idle_mutex);
+        this->stopping = true;
+    }
+    this->idle.notify_all();
+    for (auto &thread: this->threads)
+        thread.join();
+    for (auto const &worker: this->workers)
+        delete worker;
+}
+
+void Scheduler::submit(Task task) {
+    uint index = worker_of == this ? worker_index : this->next++ % get_workers();
+    this->waiting++;  // before it's there to be taken, so the count never dips below zero
+    {
+        lock_guard<mutex> lock(this->workers[index]->mutex);
+        this->workers[index]->tasks.push_back(move(task));
+    }
+    {
+        lock_guard<mutex> lock(this->idle_mutex);  // a worker about to sleep has either seen the count or will be woken
+    }
+    this->idle.notify_one();
+}
+
+bool Scheduler::run_one() {
+    Task task;
+    bool found = worker_of == this ? take(worker_index, true, task) : take(this->next % get_workers(), false, task);
+    if (found)
+        task();
+    return found;
+}
+
+void Scheduler::start(uint workers) {
+    call_once(started, [workers]() {
+        uint cores = thread::hardware_concurrency();
+        the_scheduler.reset(new Scheduler(workers > 0 ? workers : cores > 0 ? cores : 1));
+    });
+}
+
+Scheduler &Scheduler::instance() {
+    start();
+    return *the_scheduler;
+}
+
+// A worker's loop: run tasks while there are any, then sleep until more come.
+void Scheduler::work(uint index) {
+    worker_of = this;
+    worker_index = index;
+    Task task;
+    while (true) {
+        if (take(index, true, task)) {
+            task();
+            continue;
+        }
+        unique_lock<mutex> lock(this->idle_mutex);
+        if (this->stopping && this->waiting == 0)
+            return;
+        this->idle.wait(lock, [&] { return this->stopping || this->waiting > 0; });
+    }
+}
+
+/*
+ * Look for a task in each worker's deque in turn, starting with the given one. If it's our own we take the newest
+ * task off the back (likely to be working on the same data as the task that submitted it); from anyone else's we
+ * steal the oldest off the front.
+ */
+bool Scheduler::take(uint start, bool own, Task &task) {
+    uint n = get_workers();
+    for (uint i = 0; i < n; i++) {
+        Worker &worker = *this->workers[(start + i) % n];
+        lock_guard<mutex> lock(worker.mutex);
+        if (worker.tasks.empty())
+            continue;
+        if (i == 0 && own) {
+            task = move(worker.tasks.back());
+            worker.tasks.pop_back();
+        } else {
+            task = move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        this->waiting--;
+        return true;
+    }
+    return false;
+}
+
+TaskGroup::TaskGroup(Scheduler &scheduler) : scheduler(scheduler), running(0), cancelled(false), mutex(),
+                                              finished(), error() {
+}
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+void TaskGroup::run(Task task) {
+    this->running++;
+    this->scheduler.submit([this, task]() {
+        try {
+            if (!this->cancelled)
+                task();
+        } catch (...) {
+            lock_guard<std::mutex> lock(this->mutex);
+            if (!this->error)
+                this->error = current_exception();
+            this->cancelled = true;
+        }
+        lock_guard<std::mutex> lock(this->mutex);
+        if (--this->running == 0)
+            this->finished.notify_all();
+    });
+}
+
+void TaskGroup::wait() {
+    while (this->running > 0 && this->scheduler.run_one())
+        ;
+    // the rest are all being run; the last check is under the lock, so once we have it the last task to finish is
+    // done with the group (and the caller can destroy it)
+    exception_ptr error;
+    {
+        unique_lock<std::mutex> lock(this->mutex);
+        this->finished.wait(lock, [&] { return this->running == 0; });
+        error = this->error;
+        this->error = nullptr;
+    }
+    if (error)
+        rethrow_exception(error);
+}
+
+/**
+ * Run lots of little tasks on a few workers, some of them submitting more tasks from inside the pool, and check
+ * they all ran, that a task's exception comes back out of wait, that a cancelled group's tasks are skipped, that
+ * a future's result (worked out by tasks of its own) comes back, and that a group can go as soon as it's waited for.
+ * @return true if the tests all succeeded
+ */
+bool test_scheduler() {
+    Scheduler scheduler(4);
+    atomic<u_long> sum(0);
+    {
+        TaskGroup group(scheduler);
+        for (uint i = 1; i <= 100; i++) {
+            group.run([&, i]() {
+                for (uint j = 0; j < 10; j++)
+                    group.run([&, i]() { sum += i; });
+            });
+        }
+        group.wait();
+    }
+    bool ok = sum == 10 * 5050;
+
+    TaskGroup failing(scheduler);
+    for (uint i = 0; i < 10; i++)
+        failing.run([i]() {
+            if (i == 7)
+                throw runtime_error("seven");
+        });
+    try {
+        failing.wait();
+        ok = false;
+    } catch (runtime_error &e) {
+        ok = ok && string(e.what()) == "seven";
+    }
+
+    atomic<uint> ran(0);
+    TaskGroup cancelled(scheduler);
+    cancelled.cancel();
+    for (uint i = 0; i < 10; i++)
+        cancelled.run([&]() { ran++; });
+    cancelled.wait();
+    ok = ok && ran == 0 && cancelled.is_cancelled();
+
+    Future<u_long> total(scheduler, [&]() {
+        atomic<u_long> sum(0);
+        TaskGroup group(scheduler);
+        for (uint i = 1; i <= 100; i++)
+            group.run([&, i]() { sum += i; });
+        group.wait();
+        return (u_long) sum;
+    });
+    ok = ok && total.get() == 5050;
+
+    // a group can be destroyed as soon as wait returns, while its last task's worker may only just have finished it
+    for (uint i = 0; i < 2000; i++) {
+        TaskGroup *group = new TaskGroup(scheduler);
+        group->run([]() {});
+        group->wait();
+        delete group;
+    }
+    if (ok)
+        cout << "scheduler ok" << endl;
+    return ok;
+}
@@ -0,0 +1,195 @@
+/**
+ * @file Scheduler.h - a pool of worker threads that share out tasks by stealing them from each other.
+ * Scheduler
+ * TaskGroup
+ * Future
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+typedef std::function<void()> Task;
+
+/**
+ * @class Scheduler - work-stealing thread pool
+ *
+ * Each worker has a deque of its own. A task submitted from one of the workers goes on the back of that
+ * worker's deque, and one submitted from any other thread is dealt out to the workers in turn. A worker takes
+ * its newest task from the back of its own deque, and when that is empty steals the oldest one from the front
+ * of another worker's, so a worker that finishes early takes over the work left by the others.
+ * Tasks are usually run as a TaskGroup, which can be waited on.
+ */
+class Scheduler {
+public:
+    /**
+     * Start the workers.
+     * @param workers  how many (at least one)
+     */
+    Scheduler(uint workers);
+
+    /**
+     * Stop the workers once they are done with the tasks they have.
+     */
+    virtual ~Scheduler();
+
+    Scheduler(const Scheduler &other) = delete;
+
+    Scheduler &operator=(const Scheduler &other) = delete;
+
+    /**
+     * Hand a task to the workers.
+     * @param task  what to run (must not throw; see TaskGroup for tasks that might)
+     */
+    virtual void submit(Task task);
+
+    /**
+     * Run one waiting task, if there is one, on the calling thread (so a thread waiting for tasks to finish
+     * can help with them).
+     * @return  false if no task was waiting
+     */
+    virtual bool run_one();
+
+    virtual uint get_workers() const { return (uint) this->workers.size(); }
+
+    /**
+     * Start the scheduler shared by everything (done once, when the database environment is opened; later calls
+     * do nothing).
+     * @param workers  how many (0 for one per core)
+     */
+    static void start(uint workers = 0);
+
+    /**
+     * The scheduler shared by everything (started with a worker per core if nobody has started it yet).
+     */
+    static Scheduler &instance();
+
+protected:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    std::vector<Worker *> workers;
+    std::vector<std::thread> threads;
+    std::atomic<uint> next;  // where the next task from outside the pool is dealt
+    std::atomic<uint> waiting;  // tasks in the deques
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+    bool stopping;
+
+    static std::unique_ptr<Scheduler> the_scheduler;
+    static std::once_flag started;
+    static thread_local const Scheduler *worker_of;  // the scheduler this thread is a worker for, if any
+    static thread_local uint worker_index;  // and which of its workers
+
+    virtual void work(uint index);
+
+    virtual bool take(uint start, bool own, Task &task);
+};
+
+/**
+ * @class TaskGroup - a set of tasks run on a Scheduler that can be waited for together
+ *
+ * A group can be cancelled: its tasks that haven't started yet are then skipped, and the ones already running
+ * can check is_cancelled to stop early. If any of the tasks throws, the group is cancelled and the first
+ * exception is passed on by wait.
+ */
+class TaskGroup {
+public:
+    TaskGroup(Scheduler &scheduler);
+
+    /**
+     * Waits for the tasks (but swallows any exception they threw).
+     */
+    virtual ~TaskGroup();
+
+    TaskGroup(const TaskGroup &other) = delete;
+
+    TaskGroup &operator=(const TaskGroup &other) = delete;
+
+    /**
+     * Start a task in the group.
+     * @param task  what to run
+     */
+    virtual void run(Task task);
+
+    /**
+     * Wait for all the tasks so far to finish, helping with the scheduler's tasks meanwhile.
+     * @throws  whatever the first task to fail threw
+     */
+    virtual void wait();
+
+    /**
+     * Skip the group's tasks that haven't started yet (and any started from now on).
+     */
+    virtual void cancel() { this->cancelled = true; }
+
+    virtual bool is_cancelled() const { return this->cancelled; }
+
+protected:
+    Scheduler &scheduler;
+    std::atomic<uint> running;
+    std::atomic<bool> cancelled;
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::exception_ptr error;
+};
+
+/**
+ * @class Future - the result of a function run as a task on a Scheduler
+ *
+ * Copies of a future share the one result.
+ */
+template<typename T>
+class Future {
+public:
+    /**
+     * Start the function.
+     * @param scheduler  where to run it
+     * @param function   what to run
+     */
+    Future(Scheduler &scheduler, std::function<T()> function) : group(new TaskGroup(scheduler)), result(new T()),
+                                                                done(new bool(false)) {
+        std::shared_ptr<T> result = this->result;
+        std::shared_ptr<bool> done = this->done;
+        this->group->run([function, result, done]() {
+            *result = function();
+            *done = true;
+        });
+    }
+
+    /**
+     * Wait for the function to finish (helping with the scheduler's tasks meanwhile).
+     * @return   what it returned
+     * @throws   whatever it threw, or runtime_error if it was cancelled before it could finish
+     */
+    T &get() {
+        this->group->wait();
+        if (!*this->done)
+            throw std::runtime_error("task was cancelled");
+        return *this->result;
+    }
+
+    /**
+     * Don't run the function if it hasn't started yet.
+     */
+    void cancel() { this->group->cancel(); }
+
+protected:
+    std::shared_ptr<TaskGroup> group;
+    std::shared_ptr<T> result;
+    std::shared_ptr<bool> done;
+};
+
+bool test_scheduler();
@@ -0,0 +1,197 @@
+/**
+ * @file SimdKernels.cpp - implementation of SimdKernels
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "SimdKernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static void int32_equal_scalar(const int32_t *values, u_int32_t n, int32_t constant, uint8_t *mask) {
+    for (u_int32_t i = 0; i < n; i += 8) {
+        uint8_t byte = 0;
+        for (u_int32_t j = 0; j < 8 && i + j < n; j++)
+            byte |= (uint8_t) ((values[i + j] == constant) << j);
+        mask[i / 8] = byte;
+    }
+}
+
+static void byte_equal_scalar(const uint8_t *values, u_int32_t n, uint8_t constant, uint8_t *mask) {
+    for (u_int32_t i = 0; i < n; i += 8) {
+        uint8_t byte = 0;
+        for (u_int32_t j = 0; j < 8 && i + j < n; j++)
+            byte |= (uint8_t) ((values[i + j] == constant) << j);
+        mask[i / 8] = byte;
+    }
+}
+
+#ifdef SIMD_X86
+
+// four int32s at a time: the compare sets all of each equal lane, and movemask_ps gathers their sign bits
+__attribute__((target("sse4.2")))
+static void int32_equal_sse42(const int32_t *values, u_int32_t n, int32_t constant, uint8_t *mask) {
+    __m128i c = _mm_set1_epi32(constant);
+    u_int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i low = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (values + i)), c);
+        __m128i high = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (values + i + 4)), c);
+        mask[i / 8] = (uint8_t) (_mm_movemask_ps(_mm_castsi128_ps(low))
+                                 | (_mm_movemask_ps(_mm_castsi128_ps(high)) << 4));
+    }
+    if (i < n)
+        int32_equal_scalar(values + i, n - i, constant, mask + i / 8);
+}
+
+__attribute__((target("sse4.2")))
+static void byte_equal_sse42(const uint8_t *values, u_int32_t n, uint8_t constant, uint8_t *mask) {
+    __m128i c = _mm_set1_epi8((char) constant);
+    u_int32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        int bits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (values + i)), c));
+        mask[i / 8] = (uint8_t) bits;
+        mask[i / 8 + 1] = (uint8_t) (bits >> 8);
+    }
+    if (i < n)
+        byte_equal_scalar(values + i, n - i, constant, mask + i / 8);
+}
+
+__attribute__((target("avx2")))
+static void int32_equal_avx2(const int32_t *values, u_int32_t n, int32_t constant, uint8_t *mask) {
+    __m256i c = _mm256_set1_epi32(constant);
+    u_int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *) (values + i)), c);
+        mask[i / 8] = (uint8_t) _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+    }
+    if (i < n)
+        int32_equal_scalar(values + i, n - i, constant, mask + i / 8);
+}
+
+__attribute__((target("avx2")))
+static void byte_equal_avx2(const uint8_t *values, u_int32_t n, uint8_t constant, uint8_t *mask) {
+    __m256i c = _mm256_set1_epi8((char) constant);
+    u_int32_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        u_int32_t bits = (u_int32_t) _mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (values + i)), c));
+        memcpy(mask + i / 8, &bits, sizeof(bits));  // little-endian, so byte k holds values i + 8k on
+    }
+    if (i < n)
+        byte_equal_scalar(values + i, n - i, constant, mask + i / 8);
+}
+
+#endif
+
+SimdKernels::Isa SimdKernels::detect() {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return SSE42;
+#endif
+    return SCALAR;
+}
+
+SimdKernels::Kernels SimdKernels::pick(Isa isa) {
+    Kernels k;
+    k.isa = SCALAR;
+    k.int32_equal = int32_equal_scalar;
+    k.byte_equal = byte_equal_scalar;
+#ifdef SIMD_X86
+    if (isa == AVX2) {
+        k.isa = AVX2;
+        k.int32_equal = int32_equal_avx2;
+        k.byte_equal = byte_equal_avx2;
+    } else if (isa == SSE42) {
+        k.isa = SSE42;
+        k.int32_equal = int32_equal_sse42;
+        k.byte_equal = byte_equal_sse42;
+    }
+#endif
+    return k;
+}
+
+// Chosen once, the first time a kernel is called (C++11 makes that safe across threads).
+SimdKernels::Kernels &SimdKernels::kernels() {
+    static Kernels the_kernels = pick(detect());
+    return the_kernels;
+}
+
+// Not to be called while any other thread might be running a kernel.
+bool SimdKernels::use(Isa isa) {
+    if (isa > detect())
+        return false;
+    kernels() = pick(isa);
+    return true;
+}
+
+void SimdKernels::text_equal(const char *const *texts, const u_int32_t *sizes, u_int32_t n, const char *data,
+                             u_int32_t size, uint8_t *mask) {
+    int32_equal((const int32_t *) sizes, n, (int32_t) size, mask);
+    if (size == 0)
+        return;  // the length says it all
+    u_int32_t prefix_size = size < sizeof(uint64_t) ? size : (u_int32_t) sizeof(uint64_t);
+    uint64_t prefix = 0;
+    memcpy(&prefix, data, prefix_size);
+    for (u_int32_t i = 0; i < n; i += 8) {
+        uint8_t byte = mask[i / 8];
+        while (byte != 0) {
+            u_int32_t j = (u_int32_t) __builtin_ctz(byte);
+            byte &= (uint8_t) (byte - 1);
+            const char *text = texts[i + j];
+            uint64_t word = 0;
+            memcpy(&word, text, prefix_size);
+            if (word != prefix || memcmp(text + prefix_size, data + prefix_size, size - prefix_size) != 0)
+                mask[i / 8] &= (uint8_t) ~(1 << j);
+        }
+    }
+}
+
+/**
+ * Check each set of kernels the CPU can run against the plain ones, including the odd values at the end.
+ * @return true if they all agree
+ */
+bool test_simd_kernels() {
+    const u_int32_t n = 1000 + 13;
+    vector<int32_t> ints(n);
+    vector<uint8_t> bytes(n);
+    vector<const char *> texts(n);
+    vector<u_int32_t> sizes(n);
+    const char *words[] = {"", "ok", "together", "togethers", "togetherness"};
+    for (u_int32_t i = 0; i < n; i++) {
+        ints[i] = (int32_t) (i % 7) - 3;
+        bytes[i] = (uint8_t) (i % 3 == 0);
+        texts[i] = words[i % 5];
+        sizes[i] = (u_int32_t) strlen(texts[i]);
+    }
+    SimdKernels::Isa best = SimdKernels::detect();
+    vector<uint8_t> expected((n + 7) / 8), got((n + 7) / 8);
+    bool ok = true;
+    for (int isa = SimdKernels::SCALAR; isa <= best; isa++) {
+        SimdKernels::use((SimdKernels::Isa) isa);
+        int32_equal_scalar(ints.data(), n, -3, expected.data());
+        SimdKernels::int32_equal(ints.data(), n, -3, got.data());
+        ok = ok && got == expected && (expected[0] & 1) && !(expected[0] & 2);
+        byte_equal_scalar(bytes.data(), n, 1, expected.data());
+        SimdKernels::byte_equal(bytes.data(), n, 1, got.data());
+        ok = ok && got == expected;
+        SimdKernels::text_equal(texts.data(), sizes.data(), n, "togethers", 9, got.data());
+        for (u_int32_t i = 0; i < n; i++)
+            ok = ok && ((got[i / 8] >> (i % 8)) & 1) == (i % 5 == 3);
+        SimdKernels::text_equal(texts.data(), sizes.data(), n, "", 0, got.data());
+        ok = ok && (got[0] & 1) && !(got[0] & 2);
+    }
+    SimdKernels::use(best);
+    const char *names[] = {"scalar", "sse4.2", "avx2"};
+    if (ok)
+        cout << "simd kernels ok (" << names[best] << ")" << endl;
+    return ok;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file SimdKernels.h - equality tests of a whole column of values at once, producing bitmasks.
+ * SimdKernels
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <cstdint>
+#include <sys/types.h>
+
+/**
+ * @class SimdKernels - the filter kernels for where-clause conditions (which are all col = value)
+ *
+ * Each kernel compares n values against a constant and writes a bitmask of the ones that are equal: bit i%8 of
+ * byte i/8 for value i (the same layout as the bitmaps on a PaxPage), with any bits past n in the last byte
+ * cleared, so (n + 7) / 8 bytes in all.
+ * There is an AVX2 version, an SSE4.2 one and a plain one of each kernel. Which set is used is decided the first
+ * time any of them is called, by asking the CPU what it supports (unless it is forced with use).
+ */
+class SimdKernels {
+public:
+    enum Isa {
+        SCALAR, SSE42, AVX2
+    };
+
+    /**
+     * Which int32 values equal the constant (also used for the lengths of TEXT values).
+     */
+    static void int32_equal(const int32_t *values, u_int32_t n, int32_t constant, uint8_t *mask) {
+        kernels().int32_equal(values, n, constant, mask);
+    }
+
+    /**
+     * Which bytes equal the constant (BOOLEAN values, or NULL flags).
+     */
+    static void byte_equal(const uint8_t *values, u_int32_t n, uint8_t constant, uint8_t *mask) {
+        kernels().byte_equal(values, n, constant, mask);
+    }
+
+    /**
+     * Which TEXT values equal the given text: first the lengths are compared all at once, then for the ones of
+     * the right length the first eight bytes (or fewer for shorter text) are compared as a single word before
+     * the rest are memcmp'd.
+     * @param texts  each value's characters
+     * @param sizes  each value's length
+     */
+    static void text_equal(const char *const *texts, const u_int32_t *sizes, u_int32_t n, const char *data,
+                           u_int32_t size, uint8_t *mask);
+
+    /**
+     * The set of kernels in use.
+     */
+    static Isa isa() { return kernels().isa; }
+
+    /**
+     * Use a particular set of kernels (if the CPU can run them).
+     * @return  true if it can
+     */
+    static bool use(Isa isa);
+
+    /**
+     * The best set of kernels the CPU can run.
+     */
+    static Isa detect();
+
+protected:
+    typedef void (*Int32Equal)(const int32_t *values, u_int32_t n, int32_t constant, uint8_t *mask);
+    typedef void (*ByteEqual)(const uint8_t *values, u_int32_t n, uint8_t constant, uint8_t *mask);
+
+    struct Kernels {
+        Isa isa;
+        Int32Equal int32_equal;
+        ByteEqual byte_equal;
+    };
+
+    static Kernels &kernels();
+
+    static Kernels pick(Isa isa);
+};
+
+bool test_simd_kernels();
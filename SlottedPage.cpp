@@ -64,6 +64,7 @@ Dbt *SlottedPage::get(RecordID record_id) const {
  */
 void SlottedPage::put(RecordID record_id, const Dbt &data) {
     u16 size, loc;
+    u16 flags = get_flags(record_id) & MOVED;  // new data is never a stub, but a moved record stays moved
     get_header(size, loc, record_id);
     u16 new_size = (u16) data.get_size();
     if (new_size > size) {
@@ -78,6 +79,7 @@ void SlottedPage::put(RecordID record_id, const Dbt &data) {
     }
     get_header(size, loc, record_id);
     put_header(record_id, new_size, loc);
+    put_flags(record_id, flags);
 }
 
 /**
@@ -135,14 +137,71 @@ u16 SlottedPage::size() const {
 }
 
 
+/**
+ * Check if the given record is a forwarding stub left behind by HeapTable::update.
+ * @param record_id  record to check
+ * @return           true if the record's data lives elsewhere
+ */
+bool SlottedPage::is_forward(RecordID record_id) const {
+    return (get_flags(record_id) & FORWARD) != 0;
+}
+
+/**
+ * Get the location a forwarding stub points to.
+ * @param record_id  the stub
+ * @return           handle of where the record's data actually lives
+ */
+Handle SlottedPage::get_forward(RecordID record_id) const {
+    u16 size, loc;
+    get_header(size, loc, record_id);
+    BlockID block_id;
+    RecordID moved_id;
+    memcpy(&block_id, this->address(loc), sizeof(block_id));  // records aren't aligned
+    memcpy(&moved_id, this->address((u16) (loc + sizeof(BlockID))), sizeof(moved_id));
+    return Handle(block_id, moved_id);
+}
+
+/**
+ * Replace the given record with a stub pointing to where its data now lives.
+ * @param record_id  record to replace
+ * @param location   where the record's data has been moved to
+ * @throws DbBlockNoRoomError if the record was smaller than a stub and there isn't room to grow it
+ */
+void SlottedPage::forward(RecordID record_id, Handle location) {
+    char bytes[FORWARD_SZ];
+    memcpy(bytes, &location.first, sizeof(BlockID));
+    memcpy(bytes + sizeof(BlockID), &location.second, sizeof(RecordID));
+    put(record_id, Dbt(bytes, sizeof(bytes)));
+    put_flags(record_id, FORWARD);
+}
+
+/**
+ * Check if the given record was moved here from another block (and so is only reachable via its stub).
+ * @param record_id  record to check
+ * @return           true if the record should be skipped by scans
+ */
+bool SlottedPage::is_moved(RecordID record_id) const {
+    return (get_flags(record_id) & MOVED) != 0;
+}
+
+/**
+ * Mark the given record as moved here from another block.
+ * @param record_id  record to mark
+ */
+void SlottedPage::mark_moved(RecordID record_id) {
+    put_flags(record_id, MOVED);
+}
+
 /**
  * Get the size and offset for given id. For id of zero, it is the block header.
- * @param size  set to the size from given header
+ * @param size  set to the size from given header (without any flags)
  * @param loc   set to the byte offset from given header
  * @param id    the id of the header to fetch
  */
 void SlottedPage::get_header(u_int16_t &size, u_int16_t &loc, RecordID id) const {
     size = get_n((u16) 4 * id);
+    if (id != 0)
+        size &= ~FLAGS;
     loc = get_n((u16) (4 * id + 2));
 }
 
@@ -161,6 +220,24 @@ void SlottedPage::put_header(RecordID id, u16 size, u16 loc) {
     put_n((u16) (4 * id + 2), loc);
 }
 
+/**
+ * Get the FORWARD/MOVED flags stored in the top bits of a record's size.
+ * @param id  the id of the header to check
+ * @return    the flags
+ */
+u16 SlottedPage::get_flags(RecordID id) const {
+    return get_n((u16) 4 * id) & FLAGS;
+}
+
+/**
+ * Replace the FORWARD/MOVED flags stored in the top bits of a record's size.
+ * @param id     the id of the header to change
+ * @param flags  the new flags
+ */
+void SlottedPage::put_flags(RecordID id, u16 flags) {
+    put_n((u16) 4 * id, (u16) ((get_n((u16) 4 * id) & ~FLAGS) | flags));
+}
+
 /**
  * Calculate if we have room to store a record with given size. The size should include the 4 bytes
  * for the header, too, if this is an add.
@@ -215,7 +292,7 @@ void SlottedPage::slide(u_int16_t start, u_int16_t end) {
         get_header(size, loc, record_id);
         if (loc <= start) {
             loc += shift;
-            put_header(record_id, size, loc);
+            put_n((u16) (4 * record_id + 2), loc);  // only the location moves, size and flags stay put
         }
     }
     delete record_ids;
@@ -352,6 +429,29 @@ bool test_slotted_page() {
     if (get_dbt != nullptr)
         return assertion_failure("get of deleted record was not null");
 
+    // test forwarding stubs and moved records (flags have to survive the slides)
+    id = slot.add(&rec1_dbt);
+    slot.mark_moved(id);
+    slot.forward(2, Handle(7, 3));
+    if (!slot.is_forward(2) || slot.is_moved(2) || !slot.is_moved(id) || slot.is_forward(id))
+        return assertion_failure("forward/moved flags");
+    if (slot.get_forward(2) != Handle(7, 3))
+        return assertion_failure("get_forward", slot.get_forward(2).first, slot.get_forward(2).second);
+    rec1_dbt = Dbt(rec1_rev, sizeof(rec1_rev));
+    slot.put(id, rec1_dbt);
+    if (!slot.is_moved(id) || slot.get_forward(2) != Handle(7, 3))
+        return assertion_failure("flags after expanding put of moved record");
+    slot.put(2, rec2_dbt);
+    if (slot.is_forward(2))
+        return assertion_failure("put over a stub left it forwarded");
+    get_dbt = slot.get(2);
+    expected = string(rec2, sizeof(rec2));
+    actual = string((char *) get_dbt->get_data(), get_dbt->get_size());
+    delete get_dbt;
+    if (expected != actual)
+        return assertion_failure("get 2 back after put over stub " + actual);
+    slot.del(id);
+
     // try adding something too big
     rec2_dbt = Dbt(nullptr, DbBlock::BLOCK_SZ - 10); // too big, but only because we have a record in there
     try {
@@ -24,6 +24,10 @@
             Bytes 0x04 - 0x05: size of record 1
             Bytes 0x06 - 0x07: offset to record 1
             etc.
+
+        The top two bits of a record's size are flags used by HeapTable::update to keep handles stable:
+            FORWARD: the record is a stub holding the Handle of where the record's data has moved to
+            MOVED:   the record was moved here from another block and is only reachable through its stub
  *
  */
 class SlottedPage : public DbBlock {
@@ -49,8 +53,27 @@ public:
 
     virtual u_int16_t unused_bytes() const;
 
+    virtual bool is_forward(RecordID record_id) const;
+
+    virtual Handle get_forward(RecordID record_id) const;
+
+    virtual void forward(RecordID record_id, Handle location);
+
+    virtual bool is_moved(RecordID record_id) const;
+
+    virtual void mark_moved(RecordID record_id);
+
+    /**
+     * Size of a forwarding stub; any record at least this big can be replaced by a stub in place.
+     */
+    static const uint FORWARD_SZ = sizeof(BlockID) + sizeof(RecordID);
+
 
 protected:
+    static const uint16_t FORWARD = 0x8000;
+    static const uint16_t MOVED = 0x4000;
+    static const uint16_t FLAGS = FORWARD | MOVED;
+
     uint16_t num_records;
     uint16_t end_free;
 
@@ -58,6 +81,10 @@ protected:
 
     void put_header(RecordID id = 0, uint16_t size = 0, uint16_t loc = 0);
 
+    uint16_t get_flags(RecordID id) const;
+
+    void put_flags(RecordID id, uint16_t flags);
+
     bool has_room(uint16_t size) const;
 
     virtual void slide(uint16_t start, uint16_t end);
@@ -0,0 +1,54 @@
+/**
+ * @file SpillFile.cpp - implementation of SpillFile
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <cerrno>
+#include <cstring>
+#include "SpillFile.h"
+
+using namespace std;
+
+SpillFile::SpillFile(const RowCodec::Shape &shape) : codec(RowCodec::get(shape)), file(tmpfile()), rows(0),
+                                                     values(), buffer(MAX_ROW_SZ) {
+    if (this->file == nullptr)
+        throw DbRelationError(string("could not make a spill file: ") + strerror(errno));
+}
+
+SpillFile::~SpillFile() {
+    fclose(this->file);
+}
+
+void SpillFile::write(const Tuple &row) {
+    this->values.resize(row.size());
+    for (uint i = 0; i < row.size(); i++)
+        this->values[i] = &row[i];
+    u_int32_t size = this->codec->encode(this->values.data(), this->buffer.data(), MAX_ROW_SZ);
+    if (size == 0)
+        throw DbRelationError("row too big to spill");
+    if (fwrite(&size, sizeof(size), 1, this->file) != 1 || fwrite(this->buffer.data(), size, 1, this->file) != 1)
+        throw DbRelationError(string("could not write spill file: ") + strerror(errno));
+    this->rows++;
+}
+
+void SpillFile::rewind() {
+    fflush(this->file);
+    fseek(this->file, 0, SEEK_SET);
+}
+
+bool SpillFile::read(Tuple &row) {
+    u_int32_t size;
+    if (fread(&size, sizeof(size), 1, this->file) != 1)
+        return false;
+    if (size > MAX_ROW_SZ || fread(this->buffer.data(), size, 1, this->file) != 1)
+        throw DbRelationError("spill file is corrupt");
+    this->codec->decode(this->buffer.data(), row, false);
+    return true;
+}
+
+size_t row_memory(const Tuple &row) {
+    size_t bytes = sizeof(Tuple) + row.size() * sizeof(Value);
+    for (auto const &value: row)
+        if (value.data_type == ColumnAttribute::TEXT && !value.is_null() && value.text_size() > Value::INLINE_SZ)
+            bytes += value.text_size();
+    return bytes;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file SpillFile.h - temporary files of rows for operators that run out of memory.
+ * SpillFile
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <cstdio>
+#include "storage_engine.h"
+#include "RowCodec.h"
+
+/**
+ * @class SpillFile - rows written out to a temporary file and read back in the same order
+ *
+ * Rows are marshaled with the RowCodec of their columns' data types, each after its size. The file is made with
+ * tmpfile, so it is gone once it's closed (or the program ends).
+ */
+class SpillFile {
+public:
+    /**
+     * Start an empty file.
+     * @param shape  the data type of each column of the rows
+     */
+    SpillFile(const RowCodec::Shape &shape);
+
+    virtual ~SpillFile();
+
+    SpillFile(const SpillFile &other) = delete;
+
+    SpillFile &operator=(const SpillFile &other) = delete;
+
+    /**
+     * Add a row at the end.
+     * @param row  the row
+     * @throws DbRelationError if the row is too big to marshal, or the file can't be written
+     */
+    virtual void write(const Tuple &row);
+
+    /**
+     * Go back to the first row, to read the rows from there.
+     */
+    virtual void rewind();
+
+    /**
+     * Read the next row.
+     * @param row  where to put it
+     * @return     false if there are no more
+     */
+    virtual bool read(Tuple &row);
+
+    /**
+     * Number of rows written.
+     */
+    virtual u_long size() const { return this->rows; }
+
+protected:
+    static const u_int32_t MAX_ROW_SZ = 65535;  // RowCodec's offsets are 16 bits
+
+    const RowCodec *codec;
+    FILE *file;
+    u_long rows;
+    std::vector<const Value *> values;
+    std::vector<char> buffer;
+};
+
+/**
+ * Bytes a row takes up in memory, for the operators' memory budgets (a rough count).
+ * @param row  the row
+ */
+size_t row_memory(const Tuple &row);
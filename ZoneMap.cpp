@@ -0,0 +1,356 @@
+/**
+ * @file ZoneMap.cpp - implementation of ZoneMap
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+#include "ZoneMap.h"
+
+using namespace std;
+
+std::set<ZoneMap *> ZoneMap::open_maps;
+
+// The k-th bit a value with the given hash sets in a Bloom filter (the two halves of the hash make the rest).
+static inline uint32_t bloom_bit(uint64_t h, uint k) {
+    return (uint32_t) (((h & 0xffffffff) + k * (h >> 32)) % (ZoneMap::BLOOM_SZ * 8));
+}
+
+/**
+ * Constructor
+ * @param name               the table's name
+ * @param column_attributes  the table's columns
+ */
+ZoneMap::ZoneMap(string name, const ColumnAttributes &column_attributes)
+        : name(name), shape(), codec(RowCodec::get(column_attributes)), fd(-1), bloom_columns(), bloom_slots(),
+          zones(), blooms(), dirty() {
+    ColumnOrdinals texts;
+    for (auto ca: column_attributes) {
+        if (ca.get_data_type() == ColumnAttribute::TEXT)
+            texts.push_back((uint) this->shape.size());
+        this->shape.push_back(ca.get_data_type());
+    }
+    set_bloom_columns(texts);
+}
+
+ZoneMap::~ZoneMap() {
+    close();
+}
+
+void ZoneMap::create() {
+    close();
+    this->fd = ::open(path().c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (this->fd < 0)
+        throw DbException(("could not create " + path()).c_str(), errno);
+    vector<uint32_t> header = {MAGIC, (uint32_t) this->shape.size(), (uint32_t) this->bloom_columns.size()};
+    header.insert(header.end(), this->bloom_columns.begin(), this->bloom_columns.end());
+    ssize_t size = (ssize_t) (header.size() * sizeof(uint32_t));
+    if (::pwrite(this->fd, header.data(), (size_t) size, 0) != size)
+        throw DbException(("could not write " + path()).c_str(), errno);
+    open_maps.insert(this);
+    clear(1);
+}
+
+bool ZoneMap::open() {
+    if (is_open())
+        return true;
+    int fd = ::open(path().c_str(), O_RDWR);
+    if (fd < 0)
+        return false;
+    vector<char> bytes((size_t) ::lseek(fd, 0, SEEK_END));
+    uint32_t header[3];
+    if (bytes.size() < HEADER_SZ || ::pread(fd, bytes.data(), bytes.size(), 0) != (ssize_t) bytes.size()) {
+        ::close(fd);
+        return false;
+    }
+    memcpy(header, bytes.data(), HEADER_SZ);
+    size_t start = HEADER_SZ + header[2] * sizeof(uint32_t);
+    if (header[0] != MAGIC || header[1] != this->shape.size() || header[2] > this->shape.size()
+        || bytes.size() < start) {
+        ::close(fd);
+        return false;
+    }
+    ColumnOrdinals bloom_columns(header[2]);
+    memcpy(bloom_columns.data(), bytes.data() + HEADER_SZ, header[2] * sizeof(uint32_t));
+    set_bloom_columns(bloom_columns);
+
+    size_t zones_size = this->shape.size() * sizeof(Zone);
+    size_t block_size = zones_size + bloom_size();
+    size_t blocks = block_size == 0 ? 0 : (bytes.size() - start) / block_size;
+    this->zones.resize(blocks * this->shape.size());
+    this->blooms.resize(blocks * bloom_size());
+    for (BlockID block_id = 1; block_id <= blocks; block_id++) {
+        const char *block = bytes.data() + start + (block_id - 1) * block_size;
+        memcpy(block_zones(block_id), block, zones_size);
+        if (bloom_size() > 0)
+            memcpy(block_blooms(block_id), block + zones_size, bloom_size());
+    }
+    this->fd = fd;
+    open_maps.insert(this);
+    return true;
+}
+
+void ZoneMap::close() {
+    if (!is_open())
+        return;
+    sync();
+    ::close(this->fd);
+    this->fd = -1;
+    this->zones.clear();
+    open_maps.erase(this);
+}
+
+void ZoneMap::drop() {
+    close();
+    if (::unlink(path().c_str()) < 0 && errno != ENOENT)
+        throw DbException(("could not remove " + path()).c_str(), errno);
+}
+
+void ZoneMap::set_bloom_columns(const ColumnOrdinals &ordinals) {
+    close();  // what's in memory is laid out for the old filters
+    this->bloom_columns = ordinals;
+    this->bloom_slots.assign(this->shape.size(), -1);
+    for (uint i = 0; i < ordinals.size(); i++)
+        this->bloom_slots[ordinals[i]] = (int) i;
+}
+
+void ZoneMap::clear(BlockID block_id) {
+    Zone *zones = block_zones(block_id);
+    memset(zones, 0, this->shape.size() * sizeof(Zone));
+    if (bloom_size() > 0)  // without any filters, blooms is empty and has no memory to clear
+        memset(block_blooms(block_id), 0, bloom_size());
+    this->dirty.insert(block_id);
+}
+
+void ZoneMap::widen(BlockID block_id, const char *record) {
+    Zone *zones = block_zones(block_id);
+    uint8_t *blooms = block_blooms(block_id);
+    Value value;
+    for (uint i = 0; i < this->shape.size(); i++) {
+        Zone &zone = zones[i];
+        if (this->codec->is_null(record, i)) {
+            zone.flags |= HAS_NULLS;
+            continue;
+        }
+        if (this->bloom_slots[i] >= 0) {
+            this->codec->decode_field(record, i, value, true);
+            uint8_t *bloom = blooms + this->bloom_slots[i] * BLOOM_SZ;
+            uint64_t h = hash(value);
+            for (uint k = 0; k < BLOOM_HASHES; k++) {
+                uint32_t bit = bloom_bit(h, k);
+                bloom[bit >> 3] |= (uint8_t) (1 << (bit & 7));
+            }
+        }
+        if (this->shape[i] == ColumnAttribute::TEXT) {
+            u_int32_t size;
+            const char *text = this->codec->text_field(record, i, size);
+            u_int32_t kept = size < TEXT_SZ ? size : TEXT_SZ;
+            if (!(zone.flags & HAS_VALUES) || compare(text, size, zone.min_text, zone.min_size) < 0) {
+                memcpy(zone.min_text, text, kept);
+                zone.min_size = (uint8_t) kept;
+            }
+            bool below_max = (zone.flags & MAX_CUT) ? compare(text, kept, zone.max_text, zone.max_size) <= 0
+                                                    : compare(text, size, zone.max_text, zone.max_size) <= 0;
+            if (!(zone.flags & HAS_VALUES) || !below_max) {
+                memcpy(zone.max_text, text, kept);
+                zone.max_size = (uint8_t) kept;
+                zone.flags = (uint8_t) (size > TEXT_SZ ? zone.flags | MAX_CUT : zone.flags & ~MAX_CUT);
+            }
+        } else {
+            this->codec->decode_field(record, i, value, true);
+            if (!(zone.flags & HAS_VALUES) || value.n < zone.min)
+                zone.min = value.n;
+            if (!(zone.flags & HAS_VALUES) || value.n > zone.max)
+                zone.max = value.n;
+        }
+        zone.flags |= HAS_VALUES;
+    }
+    this->dirty.insert(block_id);
+}
+
+bool ZoneMap::may_match(BlockID block_id, const Conjunction &where) const {
+    size_t columns = this->shape.size();
+    if (!is_open() || (size_t) block_id * columns > this->zones.size())
+        return true;
+    const Zone *zones = this->zones.data() + (block_id - 1) * columns;
+    const uint8_t *blooms = this->blooms.data() + (block_id - 1) * bloom_size();
+    for (auto const &condition: where) {
+        if (condition.second.data_type != this->shape[condition.first])
+            return false;  // never equal (see Value::operator==)
+        if (!may_hold(zones[condition.first], condition.second))
+            return false;
+        int slot = this->bloom_slots[condition.first];
+        if (slot >= 0 && !condition.second.is_null()) {
+            const uint8_t *bloom = blooms + slot * BLOOM_SZ;
+            uint64_t h = hash(condition.second);
+            for (uint k = 0; k < BLOOM_HASHES; k++) {
+                uint32_t bit = bloom_bit(h, k);
+                if (!(bloom[bit >> 3] & (1 << (bit & 7))))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+void ZoneMap::sync() {
+    if (!is_open())
+        return;
+    size_t zones_size = this->shape.size() * sizeof(Zone);
+    size_t block_size = zones_size + bloom_size();
+    size_t start = HEADER_SZ + this->bloom_columns.size() * sizeof(uint32_t);
+    vector<char> block(block_size);
+    for (auto const &block_id: this->dirty) {
+        memcpy(block.data(), block_zones(block_id), zones_size);
+        if (bloom_size() > 0)
+            memcpy(block.data() + zones_size, block_blooms(block_id), bloom_size());
+        off_t offset = (off_t) (start + (block_id - 1) * block_size);
+        if (::pwrite(this->fd, block.data(), block_size, offset) != (ssize_t) block_size)
+            throw DbException(("could not write " + path()).c_str(), errno);
+    }
+    this->dirty.clear();
+}
+
+void ZoneMap::checkpoint() {
+    for (auto const &map: open_maps)
+        map->sync();
+}
+
+// Path of the zone file in the database directory.
+string ZoneMap::path() const {
+    const char *home;
+    _DB_ENV->get_home(&home);
+    return string(home) + "/" + this->name + ".zones";
+}
+
+// The given block's zones (a run of one per column), adding empty ones (and filters) for it and any blocks
+// before it.
+ZoneMap::Zone *ZoneMap::block_zones(BlockID block_id) {
+    size_t columns = this->shape.size();
+    if ((size_t) block_id * columns > this->zones.size()) {
+        Zone empty;
+        memset(&empty, 0, sizeof(empty));
+        this->zones.resize((size_t) block_id * columns, empty);
+        this->blooms.resize((size_t) block_id * bloom_size(), 0);
+    }
+    return this->zones.data() + (block_id - 1) * columns;
+}
+
+// FNV-1a of a value's characters (or of its number for INT and BOOLEAN).
+uint64_t ZoneMap::hash(const Value &value) {
+    const char *bytes = (const char *) &value.n;
+    u_int32_t size = sizeof(value.n);
+    if (value.data_type == ColumnAttribute::TEXT) {
+        bytes = value.text_data();
+        size = value.text_size();
+    }
+    uint64_t h = 14695981039346656037ULL;
+    for (u_int32_t i = 0; i < size; i++) {
+        h ^= (uint8_t) bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Order text by its bytes, and a prefix before anything it starts.
+int ZoneMap::compare(const char *a, u_int32_t a_size, const char *b, u_int32_t b_size) {
+    int cmp = memcmp(a, b, a_size < b_size ? a_size : b_size);
+    if (cmp != 0)
+        return cmp;
+    return a_size < b_size ? -1 : a_size > b_size ? 1 : 0;
+}
+
+// Could a column with the given zone hold the given value?
+bool ZoneMap::may_hold(const Zone &zone, const Value &value) {
+    if (value.is_null())
+        return (zone.flags & HAS_NULLS) != 0;
+    if (!(zone.flags & HAS_VALUES))
+        return false;
+    if (value.data_type != ColumnAttribute::TEXT)
+        return zone.min <= value.n && value.n <= zone.max;
+    const char *text = value.text_data();
+    u_int32_t size = value.text_size();
+    if (compare(text, size, zone.min_text, zone.min_size) < 0)
+        return false;
+    if (zone.flags & MAX_CUT)
+        return compare(text, size < TEXT_SZ ? size : TEXT_SZ, zone.max_text, zone.max_size) <= 0;
+    return compare(text, size, zone.max_text, zone.max_size) <= 0;
+}
+
+/**
+ * Widen a map's zones with a few records and check which blocks it would skip: first on ranges alone, including
+ * for long text, then with Bloom filters on both columns as well.
+ * @return true if it skips just the ones it should
+ */
+bool test_zone_map() {
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    const RowCodec *codec = RowCodec::get(column_attributes);
+    ZoneMap zones("_test_zone_map", column_attributes);
+    bool ok = zones.get_bloom_columns() == ColumnOrdinals(1, 1);  // TEXT columns have filters unless told otherwise
+    auto fill = [&]() {
+        zones.create();
+        char record[DbBlock::BLOCK_SZ];
+        Value a(12), b("together with a long tail");
+        const Value *values[] = {&a, &b};
+        codec->encode(values, record, sizeof(record));
+        zones.widen(1, record);
+        a = Value(-5);
+        b = Value("apple");
+        codec->encode(values, record, sizeof(record));
+        zones.widen(1, record);
+        a = Value(40);
+        b = Value::null(ColumnAttribute::TEXT);
+        codec->encode(values, record, sizeof(record));
+        zones.widen(3, record);
+    };
+    zones.set_bloom_columns(ColumnOrdinals());
+    fill();
+
+    Conjunction where;
+    where.push_back(make_pair(0, Value(0)));
+    ok = ok && zones.may_match(1, where) && !zones.may_match(2, where) && !zones.may_match(3, where);
+    where[0].second = Value(40);
+    ok = ok && !zones.may_match(1, where) && zones.may_match(3, where) && zones.may_match(4, where);
+    where[0] = make_pair(1, Value("together with a long tail, longer"));  // past the cut-off maximum
+    ok = ok && zones.may_match(1, where) && !zones.may_match(3, where);
+    where[0].second = Value("toward");
+    ok = ok && !zones.may_match(1, where);
+    where[0].second = Value("aardvark");
+    ok = ok && !zones.may_match(1, where);
+    where[0].second = Value::null(ColumnAttribute::TEXT);
+    ok = ok && !zones.may_match(1, where) && zones.may_match(3, where);
+    where[0] = make_pair(0, Value("12"));
+    ok = ok && !zones.may_match(1, where);
+
+    // within range, but the filters know it isn't there (these particular values don't collide)
+    ColumnOrdinals both;
+    both.push_back(0);
+    both.push_back(1);
+    zones.set_bloom_columns(both);
+    fill();
+    where[0] = make_pair(0, Value(0));
+    ok = ok && !zones.may_match(1, where);
+    where[0].second = Value(-5);
+    ok = ok && zones.may_match(1, where);
+    where[0] = make_pair(1, Value("banana"));
+    ok = ok && !zones.may_match(1, where);
+    where[0].second = Value("apple");
+    ok = ok && zones.may_match(1, where);
+
+    // what has filters comes back from the file along with the zones
+    zones.close();
+    zones.set_bloom_columns(ColumnOrdinals());
+    ok = ok && zones.open() && zones.get_bloom_columns() == both;
+    where[0] = make_pair(0, Value(12));
+    ok = ok && zones.may_match(1, where) && !zones.may_match(3, where);
+    where[0].second = Value(11);
+    ok = ok && !zones.may_match(1, where);
+    zones.drop();
+    if (ok)
+        cout << "zone map ok" << endl;
+    return ok;
+}
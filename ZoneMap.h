@@ -0,0 +1,159 @@
+/**
+ * @file ZoneMap.h - per-block value ranges and Bloom filters of a table's columns, kept in a side file.
+ * ZoneMap
+ *
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <set>
+#include "storage_engine.h"
+#include "RowCodec.h"
+
+/**
+ * @class ZoneMap - the range of values each column has in each block of a HeapTable
+ *
+ * For every block there is a zone per column saying whether it holds any values and any NULLs, and the least
+ * and greatest of its values. INT and BOOLEAN bounds are exact. TEXT bounds keep just their first TEXT_SZ
+ * characters: a cut-off minimum is still no greater than the real one, and a cut-off maximum stands for
+ * anything that starts with it.
+ * Some columns (the TEXT ones, unless set_bloom_columns says otherwise) also have a Bloom filter in each block
+ * of the values in it, since a range says little about whether one particular string is there.
+ * A scan asks may_match before it looks at a block, and skips the block if no row in it could satisfy the where
+ * clause.
+ *
+ * Zones and filters only ever take values in as rows are added or rewritten, and deletes leave them alone, so
+ * they stay correct but may get loose. They are made tight again by a rebuild (see HeapTable::rebuild_zones).
+ * Blocks past the end of the map are never skipped.
+ *
+ * Everything is kept in the file <table_name>.zones in the database directory: a header (which says which
+ * columns have filters), then for each block in order its zones and then its filters. Blocks that have changed
+ * are written back at a checkpoint (see ZoneMap::checkpoint) or when the map is closed.
+ */
+class ZoneMap {
+public:
+    ZoneMap(std::string name, const ColumnAttributes &column_attributes);
+
+    virtual ~ZoneMap();
+
+    ZoneMap(const ZoneMap &other) = delete;
+
+    ZoneMap &operator=(const ZoneMap &other) = delete;
+
+    /**
+     * Start a new zone file (replacing any old one) for a table whose first block is empty.
+     */
+    virtual void create();
+
+    /**
+     * Read in the zone file (which also says which columns have Bloom filters).
+     * @return  false if there isn't one, or it isn't for this table's columns (then the map is empty)
+     */
+    virtual bool open();
+
+    /**
+     * Write back any changed zones and let go of the file.
+     */
+    virtual void close();
+
+    /**
+     * Remove the zone file.
+     */
+    virtual void drop();
+
+    virtual bool is_open() const { return this->fd >= 0; }
+
+    /**
+     * Choose which columns have Bloom filters. The map is closed, and the new ones are used from the next create
+     * (see HeapTable::set_bloom_columns).
+     * @param ordinals  the columns
+     */
+    virtual void set_bloom_columns(const ColumnOrdinals &ordinals);
+
+    virtual const ColumnOrdinals &get_bloom_columns() const { return this->bloom_columns; }
+
+    /**
+     * Forget what was in a block (it is about to be refilled from scratch).
+     * @param block_id  the block
+     */
+    virtual void clear(BlockID block_id);
+
+    /**
+     * Widen a block's zones, and add to its filters, to take in a record stored in (or reached through) the block.
+     * @param block_id  the block
+     * @param record    the record, in the table's RowCodec format
+     */
+    virtual void widen(BlockID block_id, const char *record);
+
+    /**
+     * Could any row of the block satisfy every condition of the where clause?
+     * @param block_id  the block
+     * @param where     column ordinal = value conditions
+     * @return          false if the block can be skipped
+     */
+    virtual bool may_match(BlockID block_id, const Conjunction &where) const;
+
+    /**
+     * Write back the changed zones.
+     */
+    virtual void sync();
+
+    /**
+     * Write back the changed zones of every open zone map.
+     */
+    static void checkpoint();
+
+    /**
+     * Number of characters of TEXT bounds kept.
+     */
+    static const uint TEXT_SZ = 16;
+
+    /**
+     * Bytes in each block's Bloom filter for a column, and the number of bits each value sets in it.
+     */
+    static const uint BLOOM_SZ = 128;
+    static const uint BLOOM_HASHES = 4;
+
+protected:
+    static const uint32_t MAGIC = 0x5a4f4e45;  // "ZONE"
+    static const uint HEADER_SZ = 3 * sizeof(uint32_t);  // magic, columns, filters (then the filters' columns)
+    static const uint8_t HAS_VALUES = 1;
+    static const uint8_t HAS_NULLS = 2;
+    static const uint8_t MAX_CUT = 4;  // the TEXT maximum has been cut off at TEXT_SZ
+
+    struct Zone {
+        uint8_t flags;
+        uint8_t min_size, max_size;  // TEXT: characters of min_text and max_text
+        uint8_t unused;
+        int32_t min, max;  // INT and BOOLEAN
+        char min_text[TEXT_SZ], max_text[TEXT_SZ];
+    };
+
+    std::string name;
+    RowCodec::Shape shape;  // each column's data type
+    const RowCodec *codec;
+    int fd;
+    ColumnOrdinals bloom_columns;
+    std::vector<int> bloom_slots;  // for each column, which of each block's filters is its, or -1
+    std::vector<Zone> zones;  // each block's zones, one per column, starting with block 1
+    std::vector<uint8_t> blooms;  // each block's filters, one per bloom column, starting with block 1
+    std::set<BlockID> dirty;
+
+    static std::set<ZoneMap *> open_maps;
+
+    virtual std::string path() const;
+
+    virtual Zone *block_zones(BlockID block_id);
+
+    virtual uint8_t *block_blooms(BlockID block_id) { return this->blooms.data() + (block_id - 1) * bloom_size(); }
+
+    size_t bloom_size() const { return this->bloom_columns.size() * BLOOM_SZ; }
+
+    static uint64_t hash(const Value &value);
+
+    static int compare(const char *a, u_int32_t a_size, const char *b, u_int32_t b_size);
+
+    static bool may_hold(const Zone &zone, const Value &value);
+};
+
+bool test_zone_map();
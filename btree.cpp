@@ -3,7 +3,12 @@
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Spring 2022"
  */
+#include <algorithm>
+#include <map>
+#include <mutex>
 #include "btree.h"
+#include "Batch.h"
+#include "ExternalSort.h"
 
 BTreeIndex::BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique) : DbIndex(relation,
                                                                                                               name,
@@ -14,18 +19,24 @@ BTreeIndex::BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_co
                                                                                                       root(nullptr),
                                                                                                       file(relation.get_table_name() +
                                                                                                            "-" + name),
-                                                                                                      key_profile() {
+                                                                                                      key_profile(),
+                                                                                                      key_ordinals(nullptr) {
     if (!unique)
         throw DbRelationError("BTree index must have unique key");
     build_key_profile();
+    key_ordinals = relation.get_column_ordinals(&key_columns);
 }
 
 BTreeIndex::~BTreeIndex() {
     delete stat;
     delete root;
+    delete key_ordinals;
 }
 
 // Create the index.
+// The key columns are pulled out of the table in parallel morsels, each with its row's handle, and put in key order
+// with an ExternalSort (which sorts in parallel, and spills sorted runs if there are more keys than fit in memory),
+// so the keys go into the tree in order.
 void BTreeIndex::create() {
     std::cout << "f1" << std::endl;
     file.create();
@@ -35,14 +46,46 @@ void BTreeIndex::create() {
     closed = false;
     std::cout << "f3" << std::endl;
 
-    Handles *table_rows = relation.select();
-    std::cout << "f4" << std::endl;
-
-    for (auto const &row: *table_rows)
-        insert(row);
-    std::cout << "f5" << std::endl;
+    uint key_size = (uint) key_ordinals->size();
+    RowCodec::Shape shape = key_profile;
+    shape.push_back(ColumnAttribute::INT);  // block ID
+    shape.push_back(ColumnAttribute::INT);  // record ID
+    SortKeys sort_keys;
+    ColumnOrdinals positions;
+    for (uint i = 0; i < key_size; i++) {
+        sort_keys.push_back(SortKey(i));
+        positions.push_back(i);
+    }
+    ExternalSort sorter(shape, sort_keys);
+    std::mutex sorter_mutex;
+    relation.scan_morsels(key_ordinals, [&](uint morsel, Batch &batch) {
+        Tuples keys;
+        std::vector<Handle> handles;
+        batch.project(positions, keys);
+        batch.selected_handles(handles);
+        try {
+            std::lock_guard<std::mutex> lock(sorter_mutex);
+            for (uint i = 0; i < keys.size(); i++) {
+                keys[i]->push_back(Value((int32_t) handles[i].first));
+                keys[i]->push_back(Value((int32_t) handles[i].second));
+                sorter.add(*keys[i]);
+            }
+        } catch (...) {
+            for (auto const &key: keys)
+                delete key;
+            throw;
+        }
+        for (auto const &key: keys)
+            delete key;
+    });
 
-    delete table_rows;
+    KeyValue entry;
+    while (sorter.next(entry)) {
+        Handle handle((BlockID) entry[key_size].n, (RecordID) entry[key_size + 1].n);
+        entry.resize(key_size);
+        insert(handle, &entry);
+    }
+    std::cout << "f4" << std::endl;
 }
 
 // Drop the index.
@@ -59,7 +102,7 @@ void BTreeIndex::open() {
             root = new BTreeLeaf(file, stat->get_root_id(), key_profile, false);
         else
             root = new BTreeInterior(file, stat->get_root_id(), key_profile, false);
-        closed = true;
+        closed = false;
     }
 }
 
@@ -78,7 +121,10 @@ void BTreeIndex::close() {
 // Find all the rows whose columns are equal to key. Assumes key is a dictionary whose keys are the column
 // names in the index. Returns a list of row handles.
 Handles *BTreeIndex::lookup(ValueDict *key_dict) const {
-    return _lookup(this->root, stat->get_height(), this->tkey(key_dict));
+    KeyValue *key = this->tkey(key_dict);
+    Handles *handles = _lookup(this->root, stat->get_height(), key);
+    delete key;
+    return handles;
 }
 
 template<typename Base, typename T>
@@ -86,9 +132,15 @@ inline bool instanceof(const T *ptr) {
    return dynamic_cast<const Base*>(ptr) != nullptr;
 }
 
+// The nodes below the root are read in just for the lookup, so each is dropped once the search below it is done
+// (lookups are made once per row by index joins).
 Handles* BTreeIndex::_lookup(BTreeNode* node, uint height, const KeyValue* key) const {
-    if (!dynamic_cast<BTreeLeaf*>(node))
-        return this->_lookup(dynamic_cast<const BTreeInterior*>(node)->find(key, height), height - 1, key);
+    if (!dynamic_cast<BTreeLeaf*>(node)) {
+        BTreeNode *child = dynamic_cast<const BTreeInterior*>(node)->find(key, height);
+        Handles *res = this->_lookup(child, height - 1, key);
+        delete child;
+        return res;
+    }
 
     Handles* res = new Handles();
     try { res->push_back(dynamic_cast<const BTreeLeaf*>(node)->find_eq(key)); }
@@ -96,16 +148,90 @@ Handles* BTreeIndex::_lookup(BTreeNode* node, uint height, const KeyValue* key)
     return res;
 }
 
+// Find all the rows whose keys are from min_key to max_key (inclusive), walking the leaves from min_key's on.
+// Either key may be nullptr, to start at the first key or go on to the last.
 Handles *BTreeIndex::range(ValueDict *min_key, ValueDict *max_key) const {
-    throw DbRelationError("Don't know how to do a range query on Btree index yet");
-    // FIXME
+    KeyValue *max = max_key != nullptr ? this->tkey(max_key) : nullptr;
+    IndexCursor *cursor = ordered(min_key);
+    Handles *handles = new Handles();
+    Tuple key;
+    Handle handle;
+    while (cursor->next(key, handle) && (max == nullptr || !(*max < key)))
+        handles->push_back(handle);
+    delete cursor;
+    delete max;
+    return handles;
+}
+
+// Walk the keys in order from min_key (or the first), starting in the leaf where a lookup of min_key would end up.
+IndexCursor *BTreeIndex::ordered(const ValueDict *min_key) const {
+    KeyValue *key = min_key != nullptr ? this->tkey(min_key) : new KeyValue();  // no values sorts before any key
+    BTreeNode *node = this->root;
+    for (uint height = stat->get_height(); height > 1; height--) {
+        BTreeNode *child = dynamic_cast<const BTreeInterior *>(node)->find(key, height);
+        if (node != this->root)
+            delete node;
+        node = child;
+    }
+    IndexCursor *cursor = new BTreeCursor(dynamic_cast<const BTreeLeaf *>(node), node != this->root, *key);
+    delete key;
+    return cursor;
+}
+
+BTreeCursor::BTreeCursor(const BTreeLeaf *leaf, bool owned, const KeyValue &min_key)
+        : leaf(leaf), owned(owned), entry(leaf->get_key_map().lower_bound(min_key)),
+          prefetching(Scheduler::instance()) {
+}
+
+BTreeCursor::~BTreeCursor() {
+    this->prefetching.cancel();  // then waits for any read already going when it goes
+    if (this->owned)
+        delete this->leaf;
+}
+
+// Hand out the next key in this leaf, moving on to the next leaf (or leaves, if some are empty) when it runs out.
+bool BTreeCursor::next(Tuple &key, Handle &handle) {
+    while (this->entry == this->leaf->get_key_map().end()) {
+        const BTreeLeaf *next = this->leaf->next();
+        if (next == nullptr)
+            return false;
+        if (this->owned)
+            delete this->leaf;
+        this->leaf = next;
+        this->owned = true;
+        this->entry = next->get_key_map().begin();
+        next->prefetch_next(this->prefetching);
+    }
+    key = this->entry->first;
+    handle = this->entry->second;
+    this->entry++;
+    return true;
 }
 
 // Insert a row with the given handle. Row must exist in relation already.
 void BTreeIndex::insert(Handle handle) {
     open();
-    ValueDict *key = relation.project(handle);
-    KeyValue *tkey = this->tkey(key);
+    KeyValue *key = relation.project(handle, key_ordinals);
+    insert(handle, key);
+    delete key;
+}
+
+// Insert a batch of rows, sorted by key first so that consecutive inserts go down the same path.
+void BTreeIndex::insert(const Handles *handles) {
+    open();
+    std::vector<std::pair<KeyValue, Handle>> entries;
+    for (auto const &handle: *handles) {
+        KeyValue *key = relation.project(handle, key_ordinals);
+        entries.push_back(std::make_pair(*key, handle));
+        delete key;
+    }
+    std::sort(entries.begin(), entries.end());
+    for (auto const &entry: entries)
+        insert(entry.second, &entry.first);
+}
+
+// Insert the given key (already in key_profile order) for the row with the given handle.
+void BTreeIndex::insert(Handle handle, const KeyValue *tkey) {
     Insertion insertion = _insert(root, stat->get_height(), tkey, handle);
     if (!BTreeNode::insertion_is_none(insertion)) {
         auto *new_root = new BTreeInterior(file, 0, key_profile, true);
@@ -119,8 +245,6 @@ void BTreeIndex::insert(Handle handle) {
         root = new_root;
         std::cout << "new root: " << *new_root << std::endl;
     }
-    delete key;
-    delete tkey;
 }
 
 // Recursive insert. If a split happens at this level, return the (new node, boundary) of the split.
@@ -137,9 +261,21 @@ Insertion BTreeIndex::_insert(BTreeNode *node, uint height, const KeyValue *key,
     }
 }
 
+// Delete the index entry for a row. Row must still be in relation. No rebalancing is done (yet).
 void BTreeIndex::del(Handle handle) {
-    throw DbRelationError("Don't know how to delete from a BTree index yet");
-    // FIXME
+    open();
+    KeyValue *tkey = relation.project(handle, key_ordinals);
+    BTreeNode *node = root;
+    for (uint height = stat->get_height(); height > 1; height--) {
+        BTreeNode *down = dynamic_cast<BTreeInterior *>(node)->find(tkey, height);
+        if (node != root)
+            delete node;
+        node = down;
+    }
+    dynamic_cast<BTreeLeaf *>(node)->del(tkey);
+    if (node != root)
+        delete node;
+    delete tkey;
 }
 
 KeyValue *BTreeIndex::tkey(const ValueDict *key) const {
@@ -233,6 +369,87 @@ bool test_btree() {
             delete handles;
             delete result;
         }
+
+    // batch of rows inserted out of key order, indexed in one pass
+    ValueDicts batch;
+    for (int i = 0; i < 500; i++) {
+        ValueDict *batch_row = new ValueDict();
+        (*batch_row)["a"] = Value(5000 - i);
+        (*batch_row)["b"] = Value(i);
+        batch.push_back(batch_row);
+    }
+    Handles *batch_handles = table.insert(&batch);
+    index.insert(batch_handles);
+    for (int i = 0; i < 500; i++) {
+        lookup["a"] = 5000 - i;
+        handles = index.lookup(&lookup);
+        bool found = handles->size() == 1 && handles->back() == batch_handles->at(i);
+        delete handles;
+        if (!found) {
+            std::cout << "batch lookup failed " << i << std::endl;
+            return false;
+        }
+    }
+    delete batch_handles;
+    for (auto const &batch_row: batch)
+        delete batch_row;
+
+    // walk the leaves in key order, all the way through and from part way along
+    IndexCursor *cursor = index.ordered();
+    KeyValue key, previous;
+    Handle handle;
+    uint walked = 0;
+    while (cursor->next(key, handle)) {
+        if (walked++ > 0 && !(previous < key)) {
+            std::cout << "ordered walk out of order at " << key[0] << std::endl;
+            delete cursor;
+            return false;
+        }
+        previous = key;
+    }
+    delete cursor;
+    ValueDict min_key, max_key;
+    min_key["a"] = Value(95);
+    max_key["a"] = Value(105);
+    handles = index.range(&min_key, &max_key);
+    bool ranged = handles->size() == 6;
+    for (uint i = 0; ranged && i < handles->size(); i++) {
+        result = table.project(handles->at(i));
+        ranged = (*result)["a"] == Value(100 + (int) i);
+        delete result;
+    }
+    delete handles;
+    if (walked != 2 + 1000 + 500 || !ranged) {
+        std::cout << "ordered walk or range failed" << std::endl;
+        return false;
+    }
+
+    // leaves emptied by deletes stay in use after a reopen, so new leaves don't take over their blocks
+    handles = index.range(&max_key, nullptr);
+    for (auto const &emptied: *handles)
+        index.del(emptied);
+    delete handles;
+    index.close();
+    index.open();
+    for (int i = 0; i < 1000; i++) {
+        ValueDict row;
+        row["a"] = Value(10000 + i);
+        row["b"] = Value(i);
+        index.insert(table.insert(&row));
+    }
+    cursor = index.ordered();
+    walked = 0;
+    while (cursor->next(key, handle))
+        walked++;
+    delete cursor;
+    lookup["a"] = 10999;
+    handles = index.lookup(&lookup);
+    bool reopened = walked == 7 + 1000 && handles->size() == 1;
+    delete handles;
+    if (!reopened) {
+        std::cout << "insert after emptying leaves and reopening failed" << std::endl;
+        return false;
+    }
     return true;  // FIXME
     // test delete
     ValueDict row;
@@ -26,8 +26,14 @@ public:
 
     virtual Handles *range(ValueDict *min_key, ValueDict *max_key) const;
 
+    virtual bool is_ordered() const { return true; }
+
+    virtual IndexCursor *ordered(const ValueDict *min_key = nullptr) const;
+
     virtual void insert(Handle handle);
 
+    virtual void insert(const Handles *handles);
+
     virtual void del(Handle handle);
 
     virtual KeyValue *tkey(const ValueDict *key) const; // pull out the key values from the ValueDict in order
@@ -39,12 +45,45 @@ protected:
     BTreeNode *root;
     HeapFile file;
     KeyProfile key_profile;
+    ColumnOrdinals *key_ordinals;  // where the key columns are in the relation's rows
 
     void build_key_profile();
 
     Handles *_lookup(BTreeNode *node, uint height, const KeyValue *key) const;
 
+    virtual void insert(Handle handle, const KeyValue *tkey);
+
     Insertion _insert(BTreeNode *node, uint height, const KeyValue *key, Handle handle);
 };
 
+/**
+ * @class BTreeCursor - walks a BTreeIndex's leaves along their chain, with one leaf in memory at a time
+ *
+ * Once the walk has gone past its first leaf, each leaf it comes to has the next one read ahead on the scheduler
+ * while its keys are handed out.
+ */
+class BTreeCursor : public IndexCursor {
+public:
+    /**
+     * @param leaf     the leaf to start in
+     * @param owned    whether the cursor is to delete leaf when it is done with it (not so for the root)
+     * @param min_key  the first key to hand out is the first in leaf that isn't less than this
+     */
+    BTreeCursor(const BTreeLeaf *leaf, bool owned, const KeyValue &min_key);
+
+    virtual ~BTreeCursor();
+
+    BTreeCursor(const BTreeCursor &other) = delete;
+
+    BTreeCursor &operator=(const BTreeCursor &other) = delete;
+
+    virtual bool next(Tuple &key, Handle &handle);
+
+protected:
+    const BTreeLeaf *leaf;
+    bool owned;
+    std::map<KeyValue, Handle>::const_iterator entry;
+    TaskGroup prefetching;  // reads of the leaf after this one
+};
+
 bool test_btree();
@@ -2,7 +2,11 @@
  * @file heap_storage.h - Implementation of storage_engine with a heap file structure.
  * SlottedPage: DbBlock
  * HeapFile: DbFile
+ * MmapFile: HeapFile
  * HeapTable: DbRelation
+ * ZoneMap
+ * PaxPage: DbBlock
+ * ColumnarTable: DbRelation
  *
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Spring 2022"
@@ -10,5 +14,8 @@
 #pragma once
 #include "SlottedPage.h"
 #include "HeapFile.h"
+#include "MmapFile.h"
 #include "HeapTable.h"
+#include "ZoneMap.h"
+#include "ColumnarTable.h"
 
@@ -41,6 +41,19 @@ bool is_acceptable_data_type(std::string dt) {
     return dt == "INT" || dt == "TEXT" || dt == "BOOLEAN";  // for now
 }
 
+bool is_acceptable_storage_engine(std::string engine) {
+    return engine == "HEAP" || engine == "MMAP" || engine == "COLUMNAR";
+}
+
+
+// The storage engine a _tables row names: HEAP if it has none (as in rows from before there was a choice).
+static Identifier storage_engine_of(const ValueDict *row) {
+    ValueDict::const_iterator engine = row->find("storage_engine");
+    if (engine == row->end() || engine->second.is_null())
+        return "HEAP";
+    return engine->second.s();
+}
+
 
 /*
  * ***************************
@@ -54,8 +67,10 @@ std::map<Identifier, DbRelation *> Tables::table_cache;
 // get the column name for _tables column
 ColumnNames &Tables::COLUMN_NAMES() {
     static ColumnNames cn;
-    if (cn.empty())
+    if (cn.empty()) {
         cn.push_back("table_name");
+        cn.push_back("storage_engine");
+    }
     return cn;
 }
 
@@ -65,11 +80,12 @@ ColumnAttributes &Tables::COLUMN_ATTRIBUTES() {
     if (cas.empty()) {
         ColumnAttribute ca(ColumnAttribute::TEXT);
         cas.push_back(ca);
+        cas.push_back(ca);
     }
     return cas;
 }
 
-// ctor - we have a fixed table structure of just one column: table_name
+// ctor - we have a fixed table structure of two columns: table_name, storage_engine
 Tables::Tables() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
     Tables::table_cache[TABLE_NAME] = this;
     if (Tables::columns_table == nullptr)
@@ -81,6 +97,7 @@ Tables::Tables() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
 void Tables::create() {
     HeapTable::create();
     ValueDict row;
+    row["storage_engine"] = Value("HEAP");
     row["table_name"] = Value("_tables");
     insert(&row);
     row["table_name"] = Value("_columns");
@@ -89,14 +106,20 @@ void Tables::create() {
     insert(&row);
 }
 
-// Manually check that table_name is unique.
+// Manually check that table_name is unique and the storage engine is one we know.
 Handle Tables::insert(const ValueDict *row) {
+    Identifier storage_engine = storage_engine_of(row);
+    if (!is_acceptable_storage_engine(storage_engine))
+        throw DbRelationError("unknown storage engine '" + storage_engine + "'");
+
     // Try SELECT * FROM _tables WHERE table_name = row["table_name"] and it should return nothing
-    Handles *handles = select(row);
+    ValueDict where;
+    where["table_name"] = row->at("table_name");
+    Handles *handles = select(&where);
     bool unique = handles->empty();
     delete handles;
     if (!unique)
-        throw DbRelationError(row->at("table_name").s + " already exists");
+        throw DbRelationError(row->at("table_name").s() + " already exists");
     return HeapTable::insert(row);
 }
 
@@ -105,7 +128,7 @@ Handle Tables::insert(const ValueDict *row) {
 void Tables::del(Handle handle) {
     // remove from cache, if there
     ValueDict *row = project(handle);
-    Identifier table_name = row->at("table_name").s;
+    Identifier table_name = row->at("table_name").s();
     delete row;
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end()) {
         DbRelation *table = Tables::table_cache.at(table_name);
@@ -128,15 +151,15 @@ void Tables::get_columns(Identifier table_name, ColumnNames &column_names, Colum
         ValueDict *row = Tables::columns_table->project(
                 handle);  // get the row's values: {'column_name': <name>, 'data_type': <type>}
 
-        Identifier column_name = (*row)["column_name"].s;
+        Identifier column_name = (*row)["column_name"].s();
         column_names.push_back(column_name);
 
         ColumnAttribute::DataType data_type;
-        if ((*row)["data_type"].s == "INT")
+        if ((*row)["data_type"].s() == "INT")
             data_type = ColumnAttribute::INT;
-        else if ((*row)["data_type"].s == "TEXT")
+        else if ((*row)["data_type"].s() == "TEXT")
             data_type = ColumnAttribute::TEXT;
-        else if ((*row)["data_type"].s == "BOOLEAN")
+        else if ((*row)["data_type"].s() == "BOOLEAN")
             data_type = ColumnAttribute::BOOLEAN;
         else
             throw DbRelationError("Unknown data type");
@@ -155,11 +178,27 @@ DbRelation &Tables::get_table(Identifier table_name) {
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end())
         return *Tables::table_cache[table_name];
 
-    // otherwise assume it is a HeapTable (for now)
+    // otherwise it is a ColumnarTable or a HeapTable kept in whichever storage engine it was created with
     ColumnNames column_names;
     ColumnAttributes column_attributes;
     get_columns(table_name, column_names, column_attributes);
-    DbRelation *table = new HeapTable(table_name, column_names, column_attributes);
+    DbRelation *tables = Tables::table_cache.at(TABLE_NAME);
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    Handles *handles = tables->select(&where);
+    if (handles->empty()) {
+        delete handles;
+        throw DbRelationError("table " + table_name + " does not exist");
+    }
+    ValueDict *row = tables->project(handles->at(0));
+    Identifier storage_engine = storage_engine_of(row);
+    delete row;
+    delete handles;
+    DbRelation *table;
+    if (storage_engine == "COLUMNAR")
+        table = new ColumnarTable(table_name, column_names, column_attributes);
+    else
+        table = new HeapTable(table_name, column_names, column_attributes, storage_engine);
     Tables::table_cache[table_name] = table;
     return *table;
 }
@@ -207,6 +246,8 @@ void Columns::create() {
     row["table_name"] = Value("_tables");
     row["column_name"] = Value("table_name");
     insert(&row);
+    row["column_name"] = Value("storage_engine");
+    insert(&row);
     row["table_name"] = Value("_columns");
     row["column_name"] = Value("table_name");
     insert(&row);
@@ -235,12 +276,12 @@ void Columns::create() {
 // Manually check that (table_name, column_name) is unique.
 Handle Columns::insert(const ValueDict *row) {
     // Check that datatype is acceptable
-    if (!is_acceptable_identifier(row->at("table_name").s))
-        throw DbRelationError("unacceptable table name '" + row->at("table_name").s + "'");
-    if (!is_acceptable_identifier(row->at("column_name").s))
-        throw DbRelationError("unacceptable column name '" + row->at("column_name").s + "'");
-    if (!is_acceptable_data_type(row->at("data_type").s))
-        throw DbRelationError("unacceptable data type '" + row->at("data_type").s + "'");
+    if (!is_acceptable_identifier(row->at("table_name").s()))
+        throw DbRelationError("unacceptable table name '" + row->at("table_name").s() + "'");
+    if (!is_acceptable_identifier(row->at("column_name").s()))
+        throw DbRelationError("unacceptable column name '" + row->at("column_name").s() + "'");
+    if (!is_acceptable_data_type(row->at("data_type").s()))
+        throw DbRelationError("unacceptable data type '" + row->at("data_type").s() + "'");
 
     // Try SELECT * FROM _columns WHERE table_name = row["table_name"] AND column_name = column_name["column_name"]
     // and it should return nothing
@@ -251,7 +292,7 @@ Handle Columns::insert(const ValueDict *row) {
     bool unique = handles->empty();
     delete handles;
     if (!unique)
-        throw DbRelationError("duplicate column " + row->at("table_name").s + "." + row->at("column_name").s);
+        throw DbRelationError("duplicate column " + row->at("table_name").s() + "." + row->at("column_name").s());
 
     return HeapTable::insert(row);
 }
@@ -304,8 +345,8 @@ Indices::Indices() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES())
 // Manually check constraints -- unique on (table, index, column)
 Handle Indices::insert(const ValueDict *row) {
     // Check that datatype is acceptable
-    if (!is_acceptable_identifier(row->at("index_name").s))
-        throw DbRelationError("unacceptable index name '" + row->at("index_name").s + "'");
+    if (!is_acceptable_identifier(row->at("index_name").s()))
+        throw DbRelationError("unacceptable index name '" + row->at("index_name").s() + "'");
 
     // Try SELECT * FROM _indices WHERE table_name = row["table_name"] AND index_name = row["index_name"]
     //     AND column_name = column_name["column_name"]
@@ -319,7 +360,7 @@ Handle Indices::insert(const ValueDict *row) {
     bool unique = handles->empty();
     delete handles;
     if (!unique)
-        throw DbRelationError("duplicate index " + row->at("table_name").s + " " + row->at("index_name").s);
+        throw DbRelationError("duplicate index " + row->at("table_name").s() + " " + row->at("index_name").s());
     return HeapTable::insert(row);
 }
 
@@ -328,8 +369,8 @@ Handle Indices::insert(const ValueDict *row) {
 void Indices::del(Handle handle) {
     // remove from cache, if there
     ValueDict *row = project(handle);
-    Identifier table_name = row->at("table_name").s;
-    Identifier index_name = row->at("index_name").s;
+    Identifier table_name = row->at("table_name").s();
+    Identifier index_name = row->at("index_name").s();
     delete row;
     std::pair<Identifier, Identifier> cache_key(table_name, index_name);
     if (Indices::index_cache.find(cache_key) != Indices::index_cache.end()) {
@@ -354,13 +395,13 @@ void Indices::get_columns(Identifier table_name, Identifier index_name, ColumnNa
     for (auto const &handle: *handles) {
         ValueDict *row = project(handle);
 
-        Identifier column_name = (*row)["column_name"].s;
+        Identifier column_name = (*row)["column_name"].s();
         uint which = (uint) (*row)["seq_in_index"].n;
         colnames[which - 1] = column_name;  // seq_in_index is 1-based
         if (which > size)
             size = which;
         is_unique = (*row)["is_unique"].n != 0;
-        is_hash = (*row)["index_type"].s == "HASH";
+        is_hash = (*row)["index_type"].s() == "HASH";
         delete row;
     }
     for (uint i = 0; i < size; i++)
@@ -419,7 +460,7 @@ IndexNames Indices::get_index_names(Identifier table_name) {
     Handles *handles = select(&where);
     for (auto const &handle: *handles) {
         ValueDict *row = project(handle);
-        ret.push_back((*row)["index_name"].s);
+        ret.push_back((*row)["index_name"].s());
         delete row;
     }
     delete handles;
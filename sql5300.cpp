@@ -3,14 +3,17 @@
  * @author Kevin Lundeen
  * @see "Seattle University, cpsc4300/5300, Spring 2022"
  */
+#include <cctype>
 #include <cstdlib>
 #include <iostream>
+#include <regex>
 #include <string>
 #include "db_cxx.h"
 #include "SQLParser.h"
 #include "ParseTreeToString.h"
 #include "SQLExec.h"
 #include "btree.h"
+#include "Scheduler.h"
 
 using namespace std;
 using namespace hsql;
@@ -20,6 +23,21 @@ using namespace hsql;
  */
 void initialize_environment(char *envHome);
 
+/*
+ * the Hyrise parser has no syntax for picking a table's storage engine
+ */
+string strip_storage_engine(string &query);
+
+/*
+ * nor for inserting more than one row at a time
+ */
+uint flatten_insert_rows(string &query);
+
+/*
+ * COPY isn't Hyrise syntax either
+ */
+bool copy_statement(string &query);
+
 
 /**
  * Main entry point of the sql5300 program
@@ -49,17 +67,23 @@ int main(int argc, char *argv[]) {
             continue;
         }
 
+        if (copy_statement(query))
+            continue;
+
         // parse and execute
+        string storage_engine = strip_storage_engine(query);
+        string typed = query;  // echoed as given, since a multi-row INSERT is parsed as a single flattened row
+        uint insert_rows = flatten_insert_rows(query);
         SQLParserResult *parse = SQLParser::parseSQLString(query);
         if (!parse->isValid()) {
-            cout << "invalid SQL: " << query << endl;
+            cout << "invalid SQL: " << typed << endl;
             cout << parse->errorMsg() << endl;
         } else {
             for (uint i = 0; i < parse->size(); ++i) {
                 const SQLStatement *statement = parse->getStatement(i);
                 try {
-                    cout << ParseTreeToString::statement(statement) << endl;
-                    QueryResult *result = SQLExec::execute(statement);
+                    cout << (insert_rows > 1 ? typed : ParseTreeToString::statement(statement)) << endl;
+                    QueryResult *result = SQLExec::execute(statement, storage_engine, insert_rows);
                     cout << *result << endl;
                     delete result;
                 } catch (SQLExecError &e) {
@@ -72,6 +96,103 @@ int main(int argc, char *argv[]) {
     return EXIT_SUCCESS;
 }
 
+/**
+ * Pull a trailing "USING <engine>" off of a CREATE TABLE statement.
+ * @param query  the statement (the USING clause is removed from it)
+ * @return       the requested storage engine in upper case, "HEAP" if none was given
+ */
+string strip_storage_engine(string &query) {
+    static const regex create_using("^(\\s*create\\s+table\\b.*\\))\\s*using\\s+(\\w+)\\s*;?\\s*$", regex::icase);
+    smatch match;
+    if (!regex_match(query, match, create_using))
+        return "HEAP";
+    string storage_engine = match[2];
+    for (auto &c: storage_engine)
+        c = (char) toupper(c);
+    query = match[1];
+    return storage_engine;
+}
+
+/**
+ * Turn INSERT INTO t ... VALUES (a, b), (c, d) into INSERT INTO t ... VALUES (a, b, c, d) so it can be
+ * parsed in one go, and report how many rows it holds.
+ * @param query  the statement (rewritten if it has more than one row)
+ * @return       number of rows in the VALUES clause (1 for anything else)
+ */
+uint flatten_insert_rows(string &query) {
+    static const regex insert_values("^(\\s*insert\\s+into\\s+.*?\\bvalues\\s*)(\\(.*\\))\\s*;?\\s*$", regex::icase);
+    smatch match;
+    if (!regex_match(query, match, insert_values))
+        return 1;
+    string tuples = match[2];
+    vector<string> rows;
+    string row;
+    uint commas = 0, row_commas = 0;  // every row has to have the same number of values
+    int depth = 0;
+    bool quoted = false;
+    for (char c: tuples) {
+        if (quoted) {
+            quoted = c != '\'';
+        } else if (c == '\'') {
+            quoted = true;
+        } else if (c == '(') {
+            if (depth++ == 0)
+                continue;
+        } else if (c == ')') {
+            if (--depth == 0) {
+                if (!rows.empty() && commas != row_commas)
+                    return 1;
+                rows.push_back(row);
+                row.clear();
+                row_commas = commas;
+                commas = 0;
+                continue;
+            }
+        } else if (c == ',' && depth == 1) {
+            commas++;
+        } else if (depth == 0) {
+            if (c != ',' && !isspace(c))
+                return 1;  // not a list of rows, so let the parser complain about it
+            continue;
+        }
+        row += c;
+    }
+    if (rows.size() < 2 || depth != 0)
+        return 1;
+    string flattened = match[1].str() + "(";
+    for (uint i = 0; i < rows.size(); i++)
+        flattened += (i == 0 ? "" : ", ") + rows[i];
+    query = flattened + ")";
+    return (uint) rows.size();
+}
+
+/**
+ * Handle COPY table TO 'file' here, since there's no parse tree for it, and turn COPY table FROM 'file' into
+ * the equivalent IMPORT FROM CSV FILE 'file' INTO table for the parser.
+ * @param query  the statement (rewritten if it is a COPY FROM)
+ * @return       true if the statement has been dealt with
+ */
+bool copy_statement(string &query) {
+    static const regex copy("^\\s*copy\\s+(\\w+)\\s+(from|to)\\s+'([^']*)'\\s*;?\\s*$", regex::icase);
+    smatch match;
+    if (!regex_match(query, match, copy))
+        return false;
+    string table_name = match[1], direction = match[2], path = match[3];
+    if (direction.size() == 4) {  // FROM
+        query = "IMPORT FROM CSV FILE '" + path + "' INTO " + table_name;
+        return false;
+    }
+    cout << "COPY " << table_name << " TO '" << path << "'" << endl;
+    try {
+        QueryResult *result = SQLExec::copy_to(table_name, path);
+        cout << *result << endl;
+        delete result;
+    } catch (SQLExecError &e) {
+        cout << "Error: " << e.what() << endl;
+    }
+    return true;
+}
+
 DbEnv *_DB_ENV;
 
 void initialize_environment(char *envHome) {
@@ -81,11 +202,12 @@ void initialize_environment(char *envHome) {
     env->set_message_stream(&cout);
     env->set_error_stream(&cerr);
     try {
-        env->open(envHome, DB_CREATE | DB_INIT_MPOOL, 0);
+        env->open(envHome, DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);  // parallel scans read from several threads
     } catch (DbException &exc) {
         cerr << "(sql5300: " << exc.what() << ")" << endl;
         exit(1);
     }
     _DB_ENV = env;
+    Scheduler::start();  // a worker per core for parallel scans, index builds and sorts
     initialize_schema_tables();
 }
\ No newline at end of file
@@ -4,14 +4,136 @@
  * @see "Seattle University, CPSC5300, Spring 2022"
  */
 #include <algorithm>
+#include <cstring>
 #include "storage_engine.h"
+#include "Batch.h"
+
+Value::Value(const Value &other) : data_type(other.data_type), storage(INLINE), inline_size(0), null_flag(false) {
+    if (other.data_type == ColumnAttribute::TEXT)
+        set_text(other.text_data(), other.text_size());
+    else
+        this->n = other.n;
+    this->null_flag = other.null_flag;
+}
+
+Value::Value(Value &&temp) noexcept : data_type(temp.data_type), storage(temp.storage), inline_size(temp.inline_size),
+                                      null_flag(temp.null_flag) {
+    memcpy(this->chars, temp.chars, INLINE_SZ);
+    temp.storage = INLINE;  // any allocation is ours now
+}
+
+Value &Value::operator=(const Value &other) {
+    if (this == &other)
+        return *this;
+    if (other.data_type == ColumnAttribute::TEXT) {
+        set_text(other.text_data(), other.text_size());
+    } else {
+        release();
+        this->data_type = other.data_type;
+        this->n = other.n;
+    }
+    this->null_flag = other.null_flag;
+    return *this;
+}
+
+Value &Value::operator=(Value &&temp) noexcept {
+    if (this == &temp)
+        return *this;
+    release();
+    this->data_type = temp.data_type;
+    this->storage = temp.storage;
+    this->inline_size = temp.inline_size;
+    this->null_flag = temp.null_flag;
+    memcpy(this->chars, temp.chars, INLINE_SZ);
+    temp.storage = INLINE;
+    return *this;
+}
+
+void Value::set_text(const char *data, uint32_t size) {
+    if (size <= INLINE_SZ) {
+        release();
+        this->data_type = ColumnAttribute::TEXT;
+        memmove(this->chars, data, size);  // data might be our own inline text
+        this->inline_size = (uint8_t) size;
+        this->null_flag = false;
+        return;
+    }
+    char *copy = new char[size];
+    memcpy(copy, data, size);  // before release, since data might be our own text
+    release();
+    set_pointer(copy, size, OWNED);
+}
+
+void Value::set_view(const char *data, uint32_t size) {
+    if (size <= INLINE_SZ) {
+        set_text(data, size);
+        return;
+    }
+    release();
+    set_pointer(data, size, VIEW);
+}
+
+Value Value::view() const {
+    if (this->data_type != ColumnAttribute::TEXT || this->storage == INLINE)
+        return *this;
+    Value ret;
+    ret.set_view(text_data(), text_size());
+    return ret;
+}
+
+Value Value::null(ColumnAttribute::DataType data_type) {
+    Value ret;
+    ret.set_null(data_type);
+    return ret;
+}
+
+void Value::set_null(ColumnAttribute::DataType data_type) {
+    release();
+    this->data_type = data_type;
+    this->n = 0;
+    this->null_flag = true;
+}
+
+const char *Value::text_data() const {
+    if (this->storage == INLINE)
+        return this->chars;
+    const char *data;
+    memcpy(&data, this->chars + sizeof(uint32_t), sizeof(data));
+    return data;
+}
+
+uint32_t Value::text_size() const {
+    if (this->storage == INLINE)
+        return this->inline_size;
+    uint32_t size;
+    memcpy(&size, this->chars, sizeof(size));
+    return size;
+}
+
+// Hold text of more than INLINE_SZ characters by address (the size goes in the first four bytes).
+void Value::set_pointer(const char *data, uint32_t size, Storage storage) {
+    this->data_type = ColumnAttribute::TEXT;
+    this->storage = storage;
+    this->null_flag = false;
+    memcpy(this->chars, &size, sizeof(size));
+    memcpy(this->chars + sizeof(uint32_t), &data, sizeof(data));
+}
+
+void Value::release() {
+    if (this->storage == OWNED)
+        delete[] text_data();
+    this->storage = INLINE;
+    this->inline_size = 0;
+}
 
 bool Value::operator==(const Value &other) const {
-    if (this->data_type != other.data_type)
+    if (this->data_type != other.data_type || this->null_flag != other.null_flag)
         return false;
-    if (this->data_type == ColumnAttribute::INT)
+    if (this->null_flag)
+        return true;
+    if (this->data_type != ColumnAttribute::TEXT)
         return this->n == other.n;
-    return this->s == other.s;
+    return text_size() == other.text_size() && memcmp(text_data(), other.text_data(), text_size()) == 0;
 }
 
 bool Value::operator!=(const Value &other) const {
@@ -31,14 +153,21 @@ bool Value::operator<(const Value &other) const {
             return false;
         return false; // should never reach this
     }
-    if (this->data_type == ColumnAttribute::TEXT)
-        return this->s < other.s;
+    if (this->null_flag || other.null_flag)
+        return this->null_flag && !other.null_flag;
+    if (this->data_type == ColumnAttribute::TEXT) {
+        uint32_t size = std::min(text_size(), other.text_size());
+        int cmp = memcmp(text_data(), other.text_data(), size);
+        return cmp < 0 || (cmp == 0 && text_size() < other.text_size());
+    }
     return this->n < other.n;
 }
 
 std::ostream &operator<<(std::ostream &out, const Value &value) {
-    if (value.data_type == ColumnAttribute::DataType::TEXT)
-        out << value.s;
+    if (value.null_flag)
+        out << "NULL";
+    else if (value.data_type == ColumnAttribute::DataType::TEXT)
+        out.write(value.text_data(), value.text_size());
     else if (value.data_type == ColumnAttribute::DataType::INT)
         out << value.n;
     else if (value.n)
@@ -97,4 +226,119 @@ ValueDicts *DbRelation::project(Handles *handles, const ValueDict *where) {
     for (auto const &handle: *handles)
         ret->push_back(project(handle, &t));
     return ret;
-}
\ No newline at end of file
+}
+
+// Default batch insert is just one insert after another; storage engines that can do better override it.
+Handles *DbRelation::insert(const ValueDicts *rows) {
+    Handles *handles = new Handles();
+    for (auto const &row: *rows)
+        handles->push_back(insert(row));
+    return handles;
+}
+
+// Name the values of the positional scan
+void DbRelation::scan(const ColumnNames *column_names, RowVisitor visit) {
+    ColumnOrdinals *ordinals = get_column_ordinals(column_names);
+    ValueDict row;
+    scan(ordinals, [&](Handle handle, const Tuple *values) {
+        for (uint i = 0; i < ordinals->size(); i++)
+            row[this->column_names[ordinals->at(i)]] = values->at(i);
+        visit(handle, &row);
+    });
+    delete ordinals;
+}
+
+
+// Default positional project goes through the ValueDict one; storage engines that can do better override it.
+Tuple *DbRelation::project(Handle handle, const ColumnOrdinals *ordinals) {
+    ValueDict *row = project(handle);
+    Tuple *ret = new Tuple();
+    for (auto const &ordinal: *ordinals)
+        ret->push_back(row->at(this->column_names[ordinal]));
+    delete row;
+    return ret;
+}
+
+// Do a positional projection for each of a list of handles
+Tuples *DbRelation::project(Handles *handles, const ColumnOrdinals *ordinals) {
+    Tuples *ret = new Tuples();
+    for (auto const &handle: *handles)
+        ret->push_back(project(handle, ordinals));
+    return ret;
+}
+
+// Default positional scan is a select followed by a project of each row.
+void DbRelation::scan(const ColumnOrdinals *ordinals, TupleVisitor visit) {
+    Handles *handles = select();
+    for (auto const &handle: *handles) {
+        Tuple *row = project(handle, ordinals);
+        visit(handle, row);
+        delete row;
+    }
+    delete handles;
+}
+
+// Default batch scan gathers the rows of the positional scan into batches, copying their text.
+void DbRelation::scan_batches(const ColumnOrdinals *ordinals, BatchVisitor visit, const Conjunction *where) {
+    std::vector<ColumnAttribute::DataType> data_types;
+    for (auto const &ordinal: *ordinals)
+        data_types.push_back(this->column_attributes[ordinal].get_data_type());
+    Batch batch(data_types);
+    scan(ordinals, [&](Handle handle, const Tuple *values) {
+        u_int16_t row = batch.add(handle);
+        for (uint i = 0; i < values->size(); i++)
+            batch.columns[i]->set(row, values->at(i));
+        if (batch.full())
+            batch.flush(visit);
+    });
+    if (batch.size > 0)
+        batch.flush(visit);
+}
+
+void DbRelation::scan_morsels(const ColumnOrdinals *ordinals, MorselVisitor visit, const Conjunction *where) {
+    scan_batches(ordinals, [&](Batch &batch) {
+        visit(0, batch);
+    }, where);
+}
+
+u_long DbRelation::estimate_rows() {
+    Handles *handles = select();
+    u_long rows = handles->size();
+    delete handles;
+    return rows;
+}
+
+// Find each column's position in column_names
+ColumnOrdinals *DbRelation::get_column_ordinals(const ColumnNames *column_names) const {
+    ColumnOrdinals *ret = new ColumnOrdinals();
+    if (column_names->empty()) {
+        for (uint i = 0; i < this->column_names.size(); i++)
+            ret->push_back(i);
+        return ret;
+    }
+    for (auto const &column_name: *column_names) {
+        auto it = std::find(this->column_names.begin(), this->column_names.end(), column_name);
+        if (it == this->column_names.end()) {
+            delete ret;
+            throw DbRelationError("table does not have column named '" + column_name + "'");
+        }
+        ret->push_back((uint) (it - this->column_names.begin()));
+    }
+    return ret;
+}
+
+// Key a where clause by column position instead of name
+Conjunction *DbRelation::get_conjunction(const ValueDict *where) const {
+    if (where->empty())
+        return new Conjunction();
+    ColumnNames names;
+    for (auto const &condition: *where)
+        names.push_back(condition.first);
+    ColumnOrdinals *ordinals = get_column_ordinals(&names);
+    Conjunction *ret = new Conjunction();
+    uint i = 0;
+    for (auto const &condition: *where)
+        ret->push_back(std::make_pair(ordinals->at(i++), condition.second));
+    delete ordinals;
+    return ret;
+}
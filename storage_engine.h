@@ -9,11 +9,15 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <exception>
+#include <functional>
 #include <map>
+#include <string>
 #include <utility>
 #include <vector>
 #include "db_cxx.h"
+#include "Arena.h"
 
 /**
  * Global variable to hold dbenv.
@@ -210,7 +214,7 @@ protected:
  */
 class ColumnAttribute {
 public:
-    enum DataType {
+    enum DataType : uint8_t {
         INT, TEXT, BOOLEAN
     };
 
@@ -231,18 +235,105 @@ protected:
 
 /**
  * @class Value - holds value for a field
+ *
+ * Sixteen bytes: the data type and how any text is held, then either the number or the text.
+ * Text of up to INLINE_SZ characters is kept inline; longer text is either owned (allocated and freed by
+ * the Value) or a view of bytes somewhere else, typically a record on a block that is pinned in memory.
+ * A view is only good while those bytes are; moving a Value keeps it a view but copying one always makes
+ * an owned (or inline) copy, so anything a view is copied into is safe to keep.
+ * A value of any type can also be NULL (see Value::null).
  */
 class Value {
 public:
+    static const uint INLINE_SZ = 12;
+
     ColumnAttribute::DataType data_type;
-    int32_t n;
-    std::string s;
 
-    Value() : n(0) { data_type = ColumnAttribute::INT; }
+private:
+    enum Storage : uint8_t {
+        INLINE, OWNED, VIEW
+    };
+    Storage storage;
+    uint8_t inline_size;
+    bool null_flag;
+
+public:
+    union {
+        int32_t n;
+        char chars[INLINE_SZ];  // inline text, or else the text's size then its address
+    };
+
+    Value() : data_type(ColumnAttribute::INT), storage(INLINE), inline_size(0), null_flag(false) { n = 0; }
+
+    Value(int32_t n) : data_type(ColumnAttribute::INT), storage(INLINE), inline_size(0), null_flag(false) { this->n = n; }
+
+    Value(const std::string &s) : Value(s.data(), (uint32_t) s.size()) {}
+
+    Value(const char *data, uint32_t size) : data_type(ColumnAttribute::TEXT), storage(INLINE), inline_size(0), null_flag(false) {
+        set_text(data, size);
+    }
+
+    Value(const Value &other);
+
+    Value(Value &&temp) noexcept;
+
+    ~Value() { release(); }
+
+    Value &operator=(const Value &other);
+
+    Value &operator=(Value &&temp) noexcept;
+
+    /**
+     * Make this an INT or BOOLEAN value (letting go of any text it had).
+     * @param data_type  INT or BOOLEAN
+     * @param n          the number (0 or 1 for a BOOLEAN)
+     */
+    void set_number(ColumnAttribute::DataType data_type, int32_t n) {
+        if (this->storage != INLINE)
+            release();
+        this->data_type = data_type;
+        this->n = n;
+        this->null_flag = false;
+    }
+
+    /**
+     * A NULL of the given type. NULLs compare equal to each other (of the same type) and sort first.
+     * @param data_type  type of the column it's for
+     */
+    static Value null(ColumnAttribute::DataType data_type);
+
+    /**
+     * Make this a NULL of the given type (letting go of any text it had).
+     */
+    void set_null(ColumnAttribute::DataType data_type);
+
+    bool is_null() const { return this->null_flag; }
 
-    Value(int32_t n) : n(n) { data_type = ColumnAttribute::INT; }
+    /**
+     * Make this a TEXT value holding a copy of the given characters.
+     * @param data  the text
+     * @param size  its length
+     */
+    void set_text(const char *data, uint32_t size);
 
-    Value(std::string s) : s(s) { data_type = ColumnAttribute::TEXT; }
+    /**
+     * Make this a TEXT value referring to the given characters without copying them (short text is
+     * still copied inline). The characters must outlive this Value and any Value it is moved into.
+     * @param data  the text
+     * @param size  its length
+     */
+    void set_view(const char *data, uint32_t size);
+
+    /**
+     * A value referring to the same text as this one without copying it (as for set_view).
+     */
+    Value view() const;
+
+    const char *text_data() const;
+
+    uint32_t text_size() const;
+
+    std::string s() const { return std::string(text_data(), text_size()); }
 
     bool operator==(const Value &other) const;
 
@@ -251,16 +342,34 @@ public:
     bool operator<(const Value &other) const;
 
     friend std::ostream &operator<<(std::ostream &out, const Value &value);
+
+private:
+    void set_pointer(const char *data, uint32_t size, Storage storage);
+
+    void release();
 };
+static_assert(sizeof(Value) == 16, "Value should be sixteen bytes");
 
 // More type aliases
 typedef std::string Identifier;
 typedef std::vector<Identifier> ColumnNames;
 typedef std::vector<ColumnAttribute> ColumnAttributes;
 typedef std::pair<BlockID, RecordID> Handle;
-typedef std::vector<Handle> Handles;  // FIXME: will need to turn this into an iterator at some point
+typedef std::vector<Handle, ArenaAllocator<Handle>> Handles;  // FIXME: will need to turn this into an iterator at some point
 typedef std::map<Identifier, Value> ValueDict;
 typedef std::vector<ValueDict *> ValueDicts;
+typedef std::function<void(Handle, const ValueDict *)> RowVisitor;  // see DbRelation::scan
+
+// Positional rows: a Tuple holds a row's values in the order given by a list of column ordinals (positions in
+// the relation's column_names), which are looked up once per statement rather than by name for every row.
+typedef std::vector<Value> Tuple;
+typedef std::vector<Tuple *> Tuples;
+typedef std::vector<uint> ColumnOrdinals;
+typedef std::vector<std::pair<uint, Value>> Conjunction;  // column ordinal = value AND ...
+typedef std::function<void(Handle, const Tuple *)> TupleVisitor;  // see DbRelation::scan
+class Batch;
+typedef std::function<void(Batch &)> BatchVisitor;  // see DbRelation::scan_batches
+typedef std::function<void(uint, Batch &)> MorselVisitor;  // see DbRelation::scan_morsels
 
 
 /**
@@ -335,6 +444,31 @@ public:
      */
     virtual Handle insert(const ValueDict *row) = 0;
 
+    /**
+     * Execute: INSERT INTO <table_name> ( <row_keys> ) VALUES ( <row_values> ), ... for a batch of rows.
+     * @param rows  dictionaries keyed by column names
+     * @returns     handles to the new rows, in the same order (freed by caller)
+     */
+    virtual Handles *insert(const ValueDicts *rows);
+
+    /**
+     * Execute: COPY <table_name> FROM '<path>' -- append the rows of a CSV file (one field per column, in order).
+     * @param path  file to read
+     * @returns     handles to the new rows (freed by caller)
+     */
+    virtual Handles *copy_from(const std::string &path) {
+        throw DbRelationError("COPY FROM not supported");
+    }
+
+    /**
+     * Execute: COPY <table_name> TO '<path>' -- write every row out to a CSV file.
+     * @param path  file to (over)write
+     * @returns     number of rows written
+     */
+    virtual u_long copy_to(const std::string &path) {
+        throw DbRelationError("COPY TO not supported");
+    }
+
     /**
      * Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
      * where handle is sufficient to identify one specific record (e.g., returned
@@ -344,6 +478,15 @@ public:
      */
     virtual void update(const Handle handle, const ValueDict *new_values) = 0;
 
+    /**
+     * Check, without changing anything, that update(handle, new_values) would succeed for each of the given
+     * rows in turn, so that an update of many rows can be refused before any of them is changed.
+     * @param handles     the rows to be updated, in the order they will be
+     * @param new_values  a dictionary keyed by column names for changing columns
+     * @throws DbRelationError if one of the updates would fail
+     */
+    virtual void check_update(const Handles *handles, const ValueDict *new_values) {}
+
     /**
      * Conceptually, execute: DELETE FROM <table_name> WHERE <handle>
      * where handle is sufficient to identify one specific record (e.g, returned
@@ -406,6 +549,75 @@ public:
 
     virtual ValueDicts *project(Handles *handles, const ValueDict *column_names);
 
+    /**
+     * Visit every row of the relation once, in storage order (SELECT <column_names> FROM <table>).
+     * The visitor must not change the relation and must not hang on to the row past the call.
+     * @param column_names  list of column names to project (all of them if empty)
+     * @param visit         called with each row's handle and projected values
+     */
+    virtual void scan(const ColumnNames *column_names, RowVisitor visit);
+
+    /**
+     * Positional version of project (SELECT <ordinals>).
+     * @param handle    row to get values from
+     * @param ordinals  positions of the columns to project, in the order wanted (see get_column_ordinals)
+     * @return          values from row, in the order of ordinals (freed by caller)
+     */
+    virtual Tuple *project(Handle handle, const ColumnOrdinals *ordinals);
+
+    virtual Tuples *project(Handles *handles, const ColumnOrdinals *ordinals);
+
+    /**
+     * Positional version of scan.
+     * @param ordinals  positions of the columns to project, in the order wanted (see get_column_ordinals)
+     * @param visit     called with each row's handle and projected values
+     */
+    virtual void scan(const ColumnOrdinals *ordinals, TupleVisitor visit);
+
+    /**
+     * Batch-at-a-time version of scan: the rows come in batches of up to Batch::BATCH_SZ, a column at a time
+     * (see Batch), with every row selected. The visitor may narrow the selection but must not hang on to
+     * the batch past the call.
+     * @param ordinals  positions of the columns to put in the batches, in the order wanted
+     * @param visit     called with each batch
+     * @param where     if given, the scan may leave out rows it knows don't satisfy these conditions (the
+     *                  visitor still has to check the rest)
+     */
+    virtual void scan_batches(const ColumnOrdinals *ordinals, BatchVisitor visit, const Conjunction *where = nullptr);
+
+    /**
+     * Parallel version of scan_batches: the relation is split into morsels (runs of blocks) which are scanned
+     * on the Scheduler's workers, each into batches of its own. So the visitor is called from several threads at
+     * once. It is told which morsel each batch is from: morsels are numbered in handle order, and the batches of
+     * any one morsel come in order, so the results can be put back in handle order if that is wanted.
+     * The default is just a scan_batches, all of it morsel 0.
+     * @param ordinals  positions of the columns to put in the batches, in the order wanted
+     * @param visit     called with each morsel's batches
+     * @param where     as for scan_batches
+     */
+    virtual void scan_morsels(const ColumnOrdinals *ordinals, MorselVisitor visit, const Conjunction *where = nullptr);
+
+    /**
+     * Rough count of the rows in the relation, for the planner. The default counts them.
+     */
+    virtual u_long estimate_rows();
+
+    /**
+     * Look up where the given columns are in this relation's rows.
+     * @param column_names  columns to find (all of them, in order, if empty)
+     * @return              position of each column (freed by caller)
+     * @throws DbRelationError if a column isn't in the relation
+     */
+    virtual ColumnOrdinals *get_column_ordinals(const ColumnNames *column_names) const;
+
+    /**
+     * Turn a where clause keyed by column names into one keyed by column positions.
+     * @param where  column name = value conditions
+     * @return       the same conditions by column ordinal (freed by caller)
+     * @throws DbRelationError if a column isn't in the relation
+     */
+    virtual Conjunction *get_conjunction(const ValueDict *where) const;
+
     /**
      * Accessor for column_names.
      * @returns column_names   list of column names for this relation, in order
@@ -446,6 +658,23 @@ protected:
 };
 
 
+/**
+ * @class IndexCursor - walks the entries of an ordered index in key order (see DbIndex::ordered)
+ */
+class IndexCursor {
+public:
+    virtual ~IndexCursor() {}
+
+    /**
+     * Move on to the next entry.
+     * @param key     set to its key values, in the order of the index's key columns
+     * @param handle  set to the handle of its record
+     * @return        false if there are no more
+     */
+    virtual bool next(Tuple &key, Handle &handle) = 0;
+};
+
+
 class DbIndex {
 public:
     /**
@@ -498,6 +727,20 @@ public:
         throw DbRelationError("range index query not supported");
     }
 
+    /**
+     * Whether the index keeps its entries in key order (so ordered can be used).
+     */
+    virtual bool is_ordered() const { return false; }
+
+    /**
+     * Walk the entries in key order, only reading as much of the index at a time as it needs to.
+     * @param min_key  dictionary of the search key to start from (inclusive), or nullptr to start at the first
+     * @returns        a cursor to walk them with (the caller deletes it, and must not change the index meanwhile)
+     */
+    virtual IndexCursor *ordered(const ValueDict *min_key = nullptr) const {
+        throw DbRelationError("ordered index scan not supported");
+    }
+
     /**
      * Insert the index entry for the given record.
      * @param record  handle (into relation) to the record to insert
@@ -505,6 +748,16 @@ public:
      */
     virtual void insert(Handle record) = 0;
 
+    /**
+     * Insert the index entries for a batch of records.
+     * @param records  handles (into relation) to the records to insert
+     *                 (must be in the relation at time of insertion)
+     */
+    virtual void insert(const Handles *records) {
+        for (auto const &record: *records)
+            insert(record);
+    }
+
     /**
      * Delete the index entry for the given record.
      * @param record  handle (into relation) to the record to remove
@@ -512,6 +765,11 @@ public:
      */
     virtual void del(Handle record) = 0;
 
+    /**
+     * The columns of the search key, in order.
+     */
+    virtual const ColumnNames &get_key_columns() const { return this->key_columns; }
+
 protected:
     DbRelation &relation;
     Identifier name;